@@ -1,4 +1,5 @@
 #include <app/controller.hpp>
+#include <misc/log.hpp>
 #include <GLFW/glfw3.h>
 
 namespace jk {
@@ -13,39 +14,77 @@ float seekTime(dibs::Event::Key const& key) noexcept {
 	}
 	return coeff * dir;
 }
+
+constexpr bool coalesces(Controller::Action action) noexcept { return action == Controller::Action::eSeek || action == Controller::Action::eVolume; }
 } // namespace
 
+Controller::Controller() : m_queue(std::make_unique<Queue>()) {}
+
 void Controller::onKey(dibs::Event::Key const& key) noexcept {
 	if (key.action == GLFW_PRESS || key.action == GLFW_REPEAT) {
 		float const magnitude = key.action == GLFW_REPEAT ? 0.01f : 0.05f;
 		switch (key.key) {
-		case GLFW_KEY_UP: add(Action::eVolume, magnitude); break;
-		case GLFW_KEY_DOWN: add(Action::eVolume, -magnitude); break;
+		case GLFW_KEY_UP: push(Action::eVolume, magnitude); break;
+		case GLFW_KEY_DOWN: push(Action::eVolume, -magnitude); break;
 		default: break;
 		}
 	}
 	if (key.action == GLFW_RELEASE) {
 		switch (key.key) {
 		case GLFW_KEY_SPACE:
-		case GLFW_KEY_ENTER: add(Action::ePlayPause); break;
-		case GLFW_KEY_ESCAPE: add(Action::eStop); break;
+		case GLFW_KEY_ENTER: push(Action::ePlayPause); break;
+		case GLFW_KEY_ESCAPE: push(Action::eStop); break;
 		case GLFW_KEY_LEFT:
-		case GLFW_KEY_RIGHT: add(Action::eSeek, seekTime(key)); break;
-		case GLFW_KEY_M: add(Action::eMute); break;
+		case GLFW_KEY_RIGHT: push(Action::eSeek, seekTime(key)); break;
+		case GLFW_KEY_M: push(Action::eMute); break;
+		case GLFW_KEY_DELETE: push(Action::eRemoveMarked); break;
 		default: break;
 		}
 		if (key.mods & GLFW_MOD_CONTROL) {
 			switch (key.key) {
-			case GLFW_KEY_P: add(Action::ePrev); break;
-			case GLFW_KEY_N: add(Action::eNext); break;
-			case GLFW_KEY_Q: add(Action::eQuit); break;
+			case GLFW_KEY_P: push(Action::ePrev); break;
+			case GLFW_KEY_N: push(Action::eNext); break;
+			case GLFW_KEY_Q: push(Action::eQuit); break;
+			case GLFW_KEY_Z: push((key.mods & GLFW_MOD_SHIFT) ? Action::eRedo : Action::eUndo); break;
+			case GLFW_KEY_Y: push(Action::eRedo); break;
+			case GLFW_KEY_A: push(Action::eMarkAll, 1.0f); break;
+			case GLFW_KEY_T:
+				if (key.mods & GLFW_MOD_SHIFT) { push(Action::eReopenList); }
+				break;
 			default: break;
 			}
 		}
 	}
 }
 
-void Controller::add(Action action, float value) noexcept {
-	if (m_list.has_space()) { m_list.push_back({value, action}); }
+bool Controller::push(Action action, float value) noexcept {
+	if (m_queue->responses.push({value, action})) { return true; }
+	m_queue->dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+Controller::ResponseList Controller::responses() noexcept {
+	ResponseList ret;
+	// a response that did not fit last frame goes first
+	if (m_pending) {
+		ret.push_back(*m_pending);
+		m_pending.reset();
+	}
+	while (auto response = m_queue->responses.pop()) {
+		if (!ret.empty() && coalesces(response->action) && ret.back().action == response->action) {
+			ret.back().value += response->value;
+			continue;
+		}
+		if (!ret.has_space()) {
+			m_pending = *response;
+			break;
+		}
+		ret.push_back(*response);
+	}
+	if (auto const drops = dropped(); drops != m_reported) {
+		Log::warn("[Controller] Dropped {} actions (queue full)", drops - m_reported);
+		m_reported = drops;
+	}
+	return ret;
 }
 } // namespace jk
@@ -1,25 +1,88 @@
 #pragma once
 #include <dibs/event.hpp>
 #include <ktl/fixed_vector.hpp>
+#include <misc/mpsc_queue.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
 
 namespace jk {
+///
+/// \brief Turns input into actions, queued from any thread and drained once per frame
+///
+/// Consecutive seek / volume deltas are coalesced into a single response.
+///
 class Controller {
   public:
-	enum class Action { eNone, ePlayPause, eStop, eMute, eNext, ePrev, eSeek, eVolume, eQuit };
+	// UI only: eSeekTo / eGain / eMode / eFindDuplicates carry absolute values, eSelect / eRemove / eEqualizer and the list actions an index, toggles 0 / 1
+	// Marks (the tracklist's multi-selection): eMark toggles and eMarkRange extends to an index, eMarkAll sets all 0 / 1,
+	// eMoveMarked carries the position to move to; the other bulk actions apply to what's marked
+	enum class Action {
+		eNone,
+		ePlayPause,
+		eStop,
+		eMute,
+		eNext,
+		ePrev,
+		eSeek,
+		eVolume,
+		eSeekTo,
+		eGain,
+		eSelect,
+		eRemove,
+		eSwapAhead,
+		eSwapBehind,
+		eClear,
+		eUndo,
+		eRedo,
+		eMode,
+		eNormalize,
+		eTrimSilence,
+		eSpectrum,
+		eEqualizer,
+		eFindDuplicates,
+		eRemoveDuplicates,
+		eNewList,
+		eCopyList,
+		eCloseList,
+		eSelectList,
+		eMark,
+		eMarkRange,
+		eMarkAll,
+		eMoveMarked,
+		ePlayNext,
+		eDedupeMarked,
+		eRemoveMarked,
+		eReopenList,
+		eQuit
+	};
 
 	struct Response {
 		float value{};
 		Action action{};
 	};
-	using ResponseList = ktl::fixed_vector<Response, 4>;
+	using ResponseList = ktl::fixed_vector<Response, 16>;
+
+	static constexpr std::size_t capacity_v = 64;
+
+	Controller();
 
 	void onKey(dibs::Event::Key const& key) noexcept;
-	ResponseList responses() noexcept { return std::move(m_list); }
+	// Thread safe; returns false (and counts the drop) if the queue is full
+	bool push(Action action, float value = {}) noexcept;
+	// Main thread only
+	ResponseList responses() noexcept;
+	std::uint64_t dropped() const noexcept { return m_queue->dropped.load(std::memory_order_relaxed); }
 
   private:
-	void add(Action action, float value = {}) noexcept;
-	void replaceBindings() noexcept;
+	struct Queue {
+		MpscQueue<Response, capacity_v> responses;
+		std::atomic<std::uint64_t> dropped{};
+	};
 
-	ResponseList m_list;
+	std::unique_ptr<Queue> m_queue;
+	std::optional<Response> m_pending;
+	std::uint64_t m_reported{};
 };
 } // namespace jk
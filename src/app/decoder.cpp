@@ -0,0 +1,59 @@
+#include <app/decoder.hpp>
+#include <app/track_source.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <utility>
+
+namespace jk {
+Decoder::Decoder() {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		Equalizer eq;
+		while (auto request = m_queue.pop()) {
+			if (request->generation != m_generation.load()) { continue; }
+			auto pcm = TrackSource::decode(request->path, MappedFile::Hint::eSequential);
+			if (!pcm) {
+				Log::warn("[Decoder] Failed to decode [{}]", request->path);
+				continue;
+			}
+			if (request->generation != m_generation.load()) { continue; }
+			if (!request->eq.flat()) { eq.apply(request->eq, float(pcm->meta.sampleRate), pcm->meta.channels, pcm->samples); }
+			Decoded ret;
+			if (request->samples) {
+				auto const channels = std::max(pcm->meta.channels, std::size_t(1));
+				ret.samples = std::make_shared<SampleStore const>(SampleStore::make(pcm->samples, channels, pcm->meta.sampleRate));
+			}
+			ret.pcm = std::make_shared<capo::PCM>(std::move(*pcm));
+			Log::debug("[Decoder] Decoded [{}]{}", request->path, ret.samples ? " (kept for analysis)" : "");
+			auto lock = std::scoped_lock(m_result.mutex);
+			m_result.decoded = std::move(ret);
+			m_result.path = std::move(request->path);
+		}
+	});
+}
+
+Decoder::~Decoder() noexcept { m_queue.active(false); }
+
+void Decoder::request(std::string_view path, Equalizer::Preset const& eq, bool samples) {
+	if (path == m_requested && eq == m_eq && samples == m_samples) { return; }
+	m_requested = path;
+	m_eq = eq;
+	m_samples = samples;
+	{
+		// release the previous track right away
+		auto lock = std::scoped_lock(m_result.mutex);
+		m_result.decoded = {};
+		m_result.path.clear();
+	}
+	if (!path.empty()) { m_queue.push({m_requested, m_eq, ++m_generation, m_samples}); }
+}
+
+Decoder::Decoded Decoder::take() {
+	auto lock = std::scoped_lock(m_result.mutex);
+	if (!m_result.decoded || m_result.path != m_requested) { return {}; }
+	m_result.path.clear();
+	m_requested.clear();
+	return std::exchange(m_result.decoded, {});
+}
+} // namespace jk
@@ -0,0 +1,59 @@
+#pragma once
+#include <capo/capo.hpp>
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <misc/equalizer.hpp>
+#include <misc/sample_store.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace jk {
+///
+/// \brief Decodes the requested track into memory on a worker thread
+///
+/// Only the most recent request is honoured; stale requests are skipped.
+/// The track is run through the requested equalizer preset, if any; on request, a copy of the result is kept for readers
+/// (analysers) alongside the PCM handed to capo.
+///
+class Decoder {
+  public:
+	struct Decoded {
+		std::shared_ptr<capo::PCM> pcm;
+		// set if requested
+		std::shared_ptr<SampleStore const> samples;
+
+		explicit operator bool() const noexcept { return pcm != nullptr; }
+	};
+
+	Decoder();
+	~Decoder() noexcept;
+
+	void request(std::string_view path, Equalizer::Preset const& eq = {}, bool samples = false);
+	std::string_view requested() const noexcept { return m_requested; }
+	// Hand over the decoded track, if ready; clears the request
+	Decoded take();
+
+  private:
+	struct Request {
+		std::string path;
+		Equalizer::Preset eq;
+		std::uint64_t generation{};
+		bool samples{};
+	};
+
+	struct {
+		Decoded decoded;
+		std::string path;
+		std::mutex mutex;
+	} m_result;
+	std::string m_requested;
+	Equalizer::Preset m_eq;
+	bool m_samples{};
+	std::atomic<std::uint64_t> m_generation{};
+	ktl::async_queue<Request> m_queue;
+	ktl::kthread m_thread;
+};
+} // namespace jk
@@ -0,0 +1,114 @@
+#include <app/duplicates.hpp>
+#include <app/track_source.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/hash.hpp>
+#include <misc/log.hpp>
+#include <misc/mapped_file.hpp>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace jk {
+namespace {
+struct Key {
+	std::uint64_t hash{};
+	std::uint64_t size{};
+
+	bool operator==(Key const&) const = default;
+};
+
+struct KeyHasher {
+	std::size_t operator()(Key const& key) const noexcept { return std::size_t(key.hash ^ (key.size * 0x9E3779B97F4A7C15ULL)); }
+};
+
+DuplicateScanner::Result hashFile(std::string path) {
+	DuplicateScanner::Result ret{std::move(path), {}, {}, DuplicateScanner::Mode::eFile};
+	auto file = MappedFile::open(ret.path.data());
+	if (!file || file->empty()) { return ret; }
+	file->advise(MappedFile::Hint::eSequential);
+	ret.hash = Hash64::of(file->bytes());
+	ret.bytes = file->size();
+	return ret;
+}
+
+DuplicateScanner::Result hashAudio(std::string path) {
+	DuplicateScanner::Result ret{std::move(path), {}, {}, DuplicateScanner::Mode::eAudio};
+	auto pcm = TrackSource::decode(ret.path, MappedFile::Hint::eSequential);
+	if (!pcm || pcm->samples.empty()) { return ret; }
+	// the same samples at a different rate / layout are not the same audio
+	auto const seed = (std::uint64_t(pcm->meta.channels) << 32) | std::uint64_t(pcm->meta.sampleRate);
+	auto const bytes = std::as_bytes(std::span(pcm->samples));
+	ret.hash = Hash64::of(bytes, seed);
+	ret.bytes = bytes.size();
+	return ret;
+}
+} // namespace
+
+std::vector<DuplicateScanner::Group> DuplicateScanner::group(Library const& library, std::span<std::string const> paths, Mode mode) {
+	std::unordered_map<Key, std::size_t, KeyHasher> first;
+	std::vector<Group> ret;
+	std::vector<std::size_t> groupOf(paths.size(), paths.size());
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+		auto const entry = library.entry(library.find(paths[i]));
+		if (!entry) { continue; }
+		// equal size as well as hash for raw files; decoded audio has no equivalent cheap check
+		auto const key = Key{hash(entry->meta.fingerprint, mode), mode == Mode::eFile ? entry->meta.size : 0};
+		if (key.hash == 0) { continue; }
+		auto const [it, inserted] = first.insert({key, i});
+		if (inserted) { continue; }
+		auto& index = groupOf[it->second];
+		if (index == paths.size()) {
+			index = ret.size();
+			ret.push_back({it->second});
+		}
+		ret[index].push_back(i);
+	}
+	return ret;
+}
+
+DuplicateScanner::DuplicateScanner(std::size_t threads) {
+	if (threads == 0) { threads = std::max(std::thread::hardware_concurrency(), 1U); }
+	m_threads.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i) {
+		m_threads.emplace_back([this]() {
+			alloc::Scope const scope(alloc::Tag::eIo);
+			while (auto job = m_queue.pop()) {
+				auto result = job->mode == Mode::eFile ? hashFile(std::move(job->path)) : hashAudio(std::move(job->path));
+				if (result.hash == 0) { Log::warn("[Duplicates] Failed to hash [{}]", result.path); }
+				auto lock = std::scoped_lock(m_done.mutex);
+				m_done.results.push_back(std::move(result));
+			}
+		});
+	}
+}
+
+DuplicateScanner::~DuplicateScanner() noexcept { m_queue.active(false); }
+
+bool DuplicateScanner::push(std::string path, Mode mode) {
+	if (!m_queued.insert(path).second) { return false; }
+	if (m_queued.size() == 1) { m_stats = {std::chrono::steady_clock::now()}; }
+	m_queue.push({std::move(path), mode});
+	return true;
+}
+
+std::vector<DuplicateScanner::Result> DuplicateScanner::results() {
+	std::vector<Result> ret;
+	{
+		auto lock = std::scoped_lock(m_done.mutex);
+		std::swap(ret, m_done.results);
+	}
+	if (ret.empty()) { return ret; }
+	for (auto const& result : ret) {
+		m_queued.erase(result.path);
+		m_stats.bytes += result.bytes;
+		++m_stats.tracks;
+	}
+	if (m_queued.empty()) {
+		auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_stats.start).count();
+		auto const mib = double(m_stats.bytes) / (1024.0 * 1024.0);
+		Log::info("[Duplicates] Hashed {} tracks ({:.1f} MiB) in {:.2f}s: {:.1f} MiB/s on {} threads", m_stats.tracks, mib, elapsed,
+				  elapsed > 0.0 ? mib / elapsed : 0.0, m_threads.size());
+	}
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,67 @@
+#pragma once
+#include <app/library.hpp>
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Hashes track contents on a pool of worker threads to find duplicates
+///
+/// eFile hashes the raw bytes of the mapped file; eAudio hashes decoded samples, so it also matches
+/// byte-different files with identical audio (eg retagged), as long as the codec is lossless.
+///
+class DuplicateScanner {
+  public:
+	enum class Mode { eFile, eAudio };
+
+	struct Result {
+		std::string path;
+		std::uint64_t hash{};
+		std::uint64_t bytes{};
+		Mode mode{};
+	};
+
+	// Indices into the scanned list, first occurrence first
+	using Group = std::vector<std::size_t>;
+
+	// Zero hash: not scanned
+	static std::uint64_t hash(Library::Fingerprint const& fingerprint, Mode mode) noexcept {
+		return mode == Mode::eFile ? fingerprint.file : fingerprint.audio;
+	}
+	// Groups tracks whose cached fingerprints match, ignoring tracks not yet scanned
+	static std::vector<Group> group(Library const& library, std::span<std::string const> paths, Mode mode);
+
+	// threads = 0: one per core
+	explicit DuplicateScanner(std::size_t threads = 0);
+	~DuplicateScanner() noexcept;
+
+	bool push(std::string path, Mode mode);
+	std::vector<Result> results();
+	std::size_t pending() const noexcept { return m_queued.size(); }
+	std::size_t threads() const noexcept { return m_threads.size(); }
+
+  private:
+	struct Job {
+		std::string path;
+		Mode mode{};
+	};
+
+	struct {
+		std::vector<Result> results;
+		std::mutex mutex;
+	} m_done;
+	struct {
+		std::chrono::steady_clock::time_point start{};
+		std::uint64_t bytes{};
+		std::size_t tracks{};
+	} m_stats;
+	std::unordered_set<std::string> m_queued;
+	ktl::async_queue<Job> m_queue;
+	std::vector<ktl::kthread> m_threads;
+};
+} // namespace jk
@@ -0,0 +1,181 @@
+#include <app/export.hpp>
+#include <app/loudness.hpp>
+#include <app/track_source.hpp>
+#include <ktl/async/kthread.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <misc/wav_writer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// decoded bytes per file byte, erring high so the budget is rarely overshot
+std::uint64_t estimate(std::string const& path) {
+	std::error_code ec;
+	auto const size = stdfs::file_size(path, ec);
+	if (ec) { return 0; }
+	auto const format = TrackSource::format(path);
+	if (format == capo::FileFormat::eWav) { return size; }
+	if (format == capo::FileFormat::eFlac) { return size * 3; }
+	return size * 12;
+}
+
+void applyGain(std::span<std::int16_t> samples, float gain) noexcept {
+	if (gain == 1.0f) { return; }
+	for (auto& sample : samples) { sample = std::int16_t(std::clamp(std::lrint(float(sample) * gain), -32768L, 32767L)); }
+}
+
+std::string outputPath(std::string const& dir, std::size_t index, std::string_view track) {
+	char prefix[16];
+	std::snprintf(prefix, sizeof(prefix), "%03zu ", index + 1);
+	return (stdfs::path(dir) / (prefix + stdfs::path(track).stem().generic_string() + ".wav")).generic_string();
+}
+
+struct State {
+	std::map<std::size_t, std::optional<capo::PCM>> ready;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::uint64_t used{};
+	// learnt from decoded tracks when the estimates turn out low
+	double scale{1.0};
+	std::size_t next{};
+	Export::Report report;
+
+	// call with mutex locked
+	void finish(capo::PCM const* pcm, std::uint64_t written) {
+		used -= pcm ? pcm->samples.size() * sizeof(capo::PCM::Sample) : 0;
+		if (pcm && written > 0) {
+			report.bytes += written;
+			report.audio += double(pcm->samples.size() / std::max(pcm->meta.channels, std::size_t(1))) / double(std::max(pcm->meta.sampleRate, std::size_t(1)));
+		} else {
+			++report.failed;
+		}
+		cv.notify_all();
+	}
+};
+} // namespace
+
+std::optional<Export::Report> Export::run(Playlist const& playlist, Options const& options) {
+	auto const& tracks = playlist.tracks;
+	if (tracks.empty()) {
+		Log::warn("[Export] Nothing to export");
+		return std::nullopt;
+	}
+	std::error_code ec;
+	auto const dir = options.concat ? stdfs::path(options.output).parent_path() : stdfs::path(options.output);
+	if (!dir.empty()) { stdfs::create_directories(dir, ec); }
+	std::vector<std::uint64_t> estimates;
+	estimates.reserve(tracks.size());
+	for (auto const& track : tracks) { estimates.push_back(estimate(track)); }
+	auto const gain = std::pow(10.0f, options.gainDb / 20.0f);
+	auto const jobs = options.jobs > 0 ? options.jobs : std::max(std::thread::hardware_concurrency(), 1U);
+
+	State state;
+	state.report.tracks = tracks.size();
+	state.report.threads = std::min(jobs, tracks.size());
+	auto const worker = [&] {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		while (true) {
+			std::size_t index{};
+			std::uint64_t reserved{};
+			{
+				// admit in playlist order, so concat never waits on a track that can't start
+				auto lock = std::unique_lock(state.mutex);
+				auto const cost = [&] { return std::uint64_t(double(estimates[state.next]) * state.scale); };
+				state.cv.wait(lock, [&] { return state.next >= tracks.size() || state.used == 0 || state.used + cost() <= options.memoryBudget; });
+				if (state.next >= tracks.size()) { return; }
+				reserved = cost();
+				index = state.next++;
+				state.used += reserved;
+				state.report.peakMemory = std::max(state.report.peakMemory, state.used);
+			}
+			auto const& path = tracks[index];
+			std::optional<capo::PCM> pcm;
+			if (auto decoded = TrackSource::decode(path, MappedFile::Hint::eSequential)) {
+				auto const trackGain = options.normalize ? gain * Loudness::measure(*decoded).gain() : gain;
+				applyGain(decoded->samples, trackGain);
+				pcm = std::move(*decoded);
+			} else {
+				Log::warn("[Export] Failed to decode [{}]", path);
+			}
+			{
+				auto lock = std::scoped_lock(state.mutex);
+				auto const actual = pcm ? pcm->samples.size() * sizeof(capo::PCM::Sample) : 0;
+				if (estimates[index] > 0) { state.scale = std::max(state.scale, double(actual) / double(estimates[index])); }
+				state.used = state.used - reserved + actual;
+				state.report.peakMemory = std::max(state.report.peakMemory, state.used);
+				if (options.concat) {
+					state.ready.emplace(index, std::move(pcm));
+					state.cv.notify_all();
+					continue;
+				}
+			}
+			std::uint64_t written{};
+			if (pcm) {
+				WavWriter out;
+				auto const file = outputPath(options.output, index, path);
+				if (out.open(file, pcm->meta.channels, pcm->meta.sampleRate) && out.write(pcm->samples) && out.finish()) {
+					written = out.bytes();
+					Log::debug("[Export] Wrote [{}]", file);
+				} else {
+					Log::error("[Export] Failed to write [{}]", file);
+				}
+			}
+			auto lock = std::scoped_lock(state.mutex);
+			state.finish(pcm ? &*pcm : nullptr, written);
+		}
+	};
+
+	auto const start = Clock::now();
+	std::vector<ktl::kthread> threads;
+	threads.reserve(state.report.threads);
+	for (std::size_t i = 0; i < state.report.threads; ++i) { threads.emplace_back(worker); }
+	if (options.concat) {
+		WavWriter out;
+		for (std::size_t i = 0; i < tracks.size(); ++i) {
+			std::optional<capo::PCM> pcm;
+			{
+				auto lock = std::unique_lock(state.mutex);
+				state.cv.wait(lock, [&] { return state.ready.contains(i); });
+				auto it = state.ready.find(i);
+				pcm = std::move(it->second);
+				state.ready.erase(it);
+			}
+			std::uint64_t written{};
+			if (pcm) {
+				if (!out.isOpen() && !out.open(options.output, pcm->meta.channels, pcm->meta.sampleRate)) {
+					Log::error("[Export] Failed to open [{}]", options.output);
+				} else if (pcm->meta.channels != out.channels() || pcm->meta.sampleRate != out.sampleRate()) {
+					// no resampler: a concatenated file has one format
+					Log::warn("[Export] Skipping [{}]: {} ch / {} Hz doesn't match {} ch / {} Hz", tracks[i], pcm->meta.channels, pcm->meta.sampleRate,
+							  out.channels(), out.sampleRate());
+				} else {
+					auto const before = out.bytes();
+					if (out.write(pcm->samples)) { written = out.bytes() - before; }
+				}
+			}
+			auto lock = std::scoped_lock(state.mutex);
+			state.finish(pcm ? &*pcm : nullptr, written);
+		}
+		if (out.isOpen() && !out.finish()) { Log::error("[Export] Failed to write [{}]", options.output); }
+	}
+	threads.clear();
+	auto ret = state.report;
+	ret.elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	Log::info("[Export] Exported {} tracks ({} failed) to [{}]: {:.1f}s of audio in {:.2f}s ({:.1f}x realtime) on {} threads", ret.tracks, ret.failed,
+			  options.output, ret.audio, ret.elapsed, ret.realtime(), ret.threads);
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,43 @@
+#pragma once
+#include <app/playlist.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace jk {
+///
+/// \brief Renders a playlist to WAV offline: tracks decode on a worker pool, as fast as the cores allow
+///
+/// Tracks start decoding in playlist order, and only while the decoded audio in flight fits in the memory budget
+/// (estimated from file size until decoded); one track always proceeds, however large.
+/// With concat, finished tracks are appended to a single file in order, so they are held until their turn.
+///
+struct Export {
+	struct Options {
+		// directory, or file with concat
+		std::string output;
+		float gainDb{};
+		// per track, to Loudness::target_v
+		bool normalize{};
+		bool concat{};
+		// 0: one per core
+		std::size_t jobs{};
+		std::size_t memoryBudget{512U * 1024U * 1024U};
+	};
+
+	struct Report {
+		std::size_t tracks{};
+		std::size_t failed{};
+		std::size_t threads{};
+		std::uint64_t bytes{};
+		std::uint64_t peakMemory{};
+		// seconds
+		double audio{};
+		double elapsed{};
+
+		double realtime() const noexcept { return elapsed > 0.0 ? audio / elapsed : 0.0; }
+	};
+
+	static std::optional<Report> run(Playlist const& playlist, Options const& options);
+};
+} // namespace jk
@@ -0,0 +1,320 @@
+#include <app/folder_watch.hpp>
+#include <app/track_source.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+namespace {
+bool audio(std::string_view path) noexcept { return TrackSource::format(path).has_value(); }
+
+///
+/// \brief Folds a stream of file events into the net change per path
+///
+class Coalescer {
+  public:
+	void added(std::string path) { m_state.insert_or_assign(std::move(path), Op::eAdd); }
+
+	void removed(std::string path) {
+		if (auto it = m_renames.find(path); it != m_renames.end()) {
+			// renamed and then removed: the original is what the playlist knows about
+			m_state.insert_or_assign(std::move(it->second), Op::eRemove);
+			m_renames.erase(it);
+		}
+		m_state.insert_or_assign(std::move(path), Op::eRemove);
+	}
+
+	void removedDir(std::string path) {
+		std::erase_if(m_state, [&path](auto const& kvp) { return under(kvp.first, path); });
+		for (auto it = m_renames.begin(); it != m_renames.end();) {
+			if (!under(it->first, path)) {
+				++it;
+				continue;
+			}
+			// moved in and then gone with the directory: the original is what the playlist knows about
+			if (!under(it->second, path)) { m_state.insert_or_assign(std::move(it->second), Op::eRemove); }
+			it = m_renames.erase(it);
+		}
+		m_dirs.push_back(std::move(path));
+	}
+
+	void renamed(std::string from, std::string to) {
+		if (auto it = m_state.find(from); it != m_state.end() && it->second == Op::eAdd) {
+			// not published yet under the old name
+			m_state.erase(it);
+			added(std::move(to));
+			return;
+		}
+		if (auto it = m_renames.find(from); it != m_renames.end()) {
+			from = std::move(it->second);
+			m_renames.erase(it);
+		}
+		m_state.erase(to);
+		m_renames.insert_or_assign(std::move(to), std::move(from));
+	}
+
+	// A batch flushed after everything seen so far: each of its paths is a net change, so the order within it doesn't matter
+	// beyond directories (which it has already folded in) going first
+	void fold(FolderWatch::Batch batch) {
+		for (auto& dir : batch.removedDirs) { removedDir(std::move(dir)); }
+		for (auto& [from, to] : batch.renamed) { renamed(std::move(from), std::move(to)); }
+		for (auto& path : batch.removed) { removed(std::move(path)); }
+		for (auto& path : batch.added) { added(std::move(path)); }
+	}
+
+	std::size_t size() const noexcept { return m_state.size() + m_renames.size() + m_dirs.size(); }
+	bool empty() const noexcept { return size() == 0; }
+
+	FolderWatch::Batch flush() {
+		FolderWatch::Batch ret;
+		for (auto& [path, op] : m_state) { (op == Op::eAdd ? ret.added : ret.removed).push_back(path); }
+		for (auto& [to, from] : m_renames) { ret.renamed.emplace_back(std::move(from), to); }
+		ret.removedDirs = std::move(m_dirs);
+		m_state.clear();
+		m_renames.clear();
+		m_dirs.clear();
+		return ret;
+	}
+
+  private:
+	enum class Op { eAdd, eRemove };
+
+	static bool under(std::string_view path, std::string_view dir) noexcept {
+		return path.size() > dir.size() && path.starts_with(dir) && path[dir.size()] == '/';
+	}
+
+	std::unordered_map<std::string, Op> m_state;
+	// to => from
+	std::unordered_map<std::string, std::string> m_renames;
+	std::vector<std::string> m_dirs;
+};
+
+std::string normalize(std::string_view path) {
+	std::error_code ec;
+	auto ret = stdfs::absolute(stdfs::path(path), ec).lexically_normal().generic_string();
+	while (ret.size() > 1 && ret.back() == '/') { ret.pop_back(); }
+	return ret;
+}
+} // namespace
+
+#if defined(__linux__)
+namespace {
+constexpr std::uint32_t mask_v = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+class Watches {
+  public:
+	Watches(int fd, std::atomic<std::size_t>& out_count) : m_fd(fd), m_count(out_count) {}
+
+	// Watches dir and everything under it, reporting files found under it to coalescer (pass null when seeding)
+	void add(std::string const& dir, Coalescer* coalescer) {
+		watch(dir);
+		std::error_code ec;
+		auto it = stdfs::recursive_directory_iterator(dir, stdfs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != stdfs::recursive_directory_iterator(); it.increment(ec)) {
+			auto const path = it->path().generic_string();
+			if (it->is_directory(ec)) {
+				watch(path);
+			} else if (coalescer && audio(path)) {
+				coalescer->added(path);
+			}
+		}
+	}
+
+	// Stops watching dir and everything under it (the kernel keeps following moved directories by inode)
+	void remove(std::string_view dir) {
+		for (auto it = m_dirs.begin(); it != m_dirs.end();) {
+			if (it->second == dir || (it->second.starts_with(dir) && it->second.size() > dir.size() && it->second[dir.size()] == '/')) {
+				inotify_rm_watch(m_fd, it->first);
+				it = m_dirs.erase(it);
+			} else {
+				++it;
+			}
+		}
+		m_count.store(m_dirs.size());
+	}
+
+	void forget(int wd) {
+		m_dirs.erase(wd);
+		m_count.store(m_dirs.size());
+	}
+
+	std::string const* dir(int wd) const noexcept {
+		auto it = m_dirs.find(wd);
+		return it == m_dirs.end() ? nullptr : &it->second;
+	}
+
+  private:
+	void watch(std::string const& dir) {
+		auto const wd = inotify_add_watch(m_fd, dir.data(), mask_v);
+		if (wd < 0) {
+			if (!m_warned) { Log::warn("[FolderWatch] Failed to watch [{}] (errno {}), raise fs.inotify.max_user_watches?", dir, errno); }
+			m_warned = true;
+			return;
+		}
+		m_dirs.insert_or_assign(wd, dir);
+		m_count.store(m_dirs.size());
+	}
+
+	std::unordered_map<int, std::string> m_dirs;
+	int m_fd{};
+	std::atomic<std::size_t>& m_count;
+	bool m_warned{};
+};
+} // namespace
+
+FolderWatch::FolderWatch(std::vector<std::string> roots) {
+	for (auto const& root : roots) { m_roots.push_back(normalize(root)); }
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_fd < 0 || m_wake < 0) {
+		Log::error("[FolderWatch] Failed to initialize inotify (errno {})", errno);
+		return;
+	}
+	m_thread = ktl::kthread([this]() { run(); });
+}
+
+FolderWatch::~FolderWatch() noexcept {
+	if (m_wake >= 0) {
+		std::uint64_t const one = 1;
+		[[maybe_unused]] auto const written = write(m_wake, &one, sizeof(one));
+	}
+	m_thread.join();
+	if (m_fd >= 0) { close(m_fd); }
+	if (m_wake >= 0) { close(m_wake); }
+}
+
+void FolderWatch::run() {
+	using Clock = std::chrono::steady_clock;
+	alloc::Scope const scope(alloc::Tag::eIo);
+	Watches watches(m_fd, m_watches);
+	for (auto const& root : m_roots) { watches.add(root, nullptr); }
+	Log::info("[FolderWatch] Watching {} folders ({} directories)", m_roots.size(), m_watches.load());
+	Coalescer coalescer;
+	// moved out of a directory, waiting for the matching IN_MOVED_TO
+	std::unordered_map<std::uint32_t, std::pair<std::string, bool>> moved;
+	auto first = Clock::time_point{};
+	auto const publish = [&] {
+		// moved somewhere we don't watch
+		for (auto& [_, from] : moved) {
+			if (from.second) {
+				watches.remove(from.first);
+				coalescer.removedDir(std::move(from.first));
+			} else {
+				coalescer.removed(std::move(from.first));
+			}
+		}
+		moved.clear();
+		if (coalescer.empty()) { return; }
+		auto batch = coalescer.flush();
+		Log::debug("[FolderWatch] {} added, {} removed, {} renamed", batch.added.size(), batch.removed.size() + batch.removedDirs.size(), batch.renamed.size());
+		auto lock = std::scoped_lock(m_done.mutex);
+		m_done.batches.push_back(std::move(batch));
+	};
+	alignas(inotify_event) char buffer[16 * 1024];
+	while (true) {
+		pollfd fds[] = {{m_fd, POLLIN, 0}, {m_wake, POLLIN, 0}};
+		bool const idle = coalescer.empty() && moved.empty();
+		auto const ready = poll(fds, 2, idle ? -1 : settle_v);
+		if (ready < 0 && errno != EINTR) {
+			Log::error("[FolderWatch] poll failed (errno {})", errno);
+			break;
+		}
+		if (fds[1].revents != 0) { break; }
+		if (ready == 0) {
+			publish();
+			continue;
+		}
+		if ((fds[0].revents & POLLIN) == 0) { continue; }
+		for (auto length = read(m_fd, buffer, sizeof(buffer)); length > 0; length = read(m_fd, buffer, sizeof(buffer))) {
+			for (char const* ptr = buffer; ptr < buffer + length;) {
+				auto const& event = *reinterpret_cast<inotify_event const*>(ptr);
+				ptr += sizeof(inotify_event) + event.len;
+				if (event.mask & IN_Q_OVERFLOW) {
+					Log::warn("[FolderWatch] Event queue overflowed, some changes were missed");
+					continue;
+				}
+				if (event.mask & IN_IGNORED) {
+					watches.forget(event.wd);
+					continue;
+				}
+				auto const* dir = watches.dir(event.wd);
+				if (!dir || event.len == 0) { continue; }
+				auto path = *dir + '/' + event.name;
+				bool const isDir = (event.mask & IN_ISDIR) != 0;
+				if (!isDir && !audio(path)) { continue; }
+				if (event.mask & IN_MOVED_FROM) {
+					moved.insert_or_assign(event.cookie, std::pair{std::move(path), isDir});
+				} else if (event.mask & IN_MOVED_TO) {
+					auto it = moved.find(event.cookie);
+					if (isDir) {
+						// contents keep their relative paths, but watches and track paths are keyed by the old name
+						if (it != moved.end()) {
+							watches.remove(it->second.first);
+							coalescer.removedDir(std::move(it->second.first));
+						}
+						watches.add(path, &coalescer);
+					} else if (it != moved.end()) {
+						coalescer.renamed(std::move(it->second.first), std::move(path));
+					} else {
+						coalescer.added(std::move(path));
+					}
+					if (it != moved.end()) { moved.erase(it); }
+				} else if (event.mask & (IN_CREATE | IN_CLOSE_WRITE)) {
+					// files created in a new directory before its watch was added are picked up by the walk
+					if (isDir) {
+						watches.add(path, &coalescer);
+					} else if (event.mask & IN_CLOSE_WRITE) {
+						coalescer.added(std::move(path));
+					}
+				} else if (event.mask & IN_DELETE) {
+					if (isDir) {
+						coalescer.removedDir(std::move(path));
+					} else {
+						coalescer.removed(std::move(path));
+					}
+				}
+			}
+		}
+		auto const now = Clock::now();
+		if (idle) { first = now; }
+		if (coalescer.size() >= max_batch_v || now - first >= std::chrono::milliseconds(max_latency_v)) {
+			publish();
+			first = now;
+		}
+	}
+}
+#else
+FolderWatch::FolderWatch(std::vector<std::string> roots) {
+	for (auto const& root : roots) { m_roots.push_back(normalize(root)); }
+	Log::warn("[FolderWatch] Watched folders are only supported on Linux");
+}
+
+FolderWatch::~FolderWatch() noexcept = default;
+
+void FolderWatch::run() {}
+#endif
+
+FolderWatch::Batch FolderWatch::take() {
+	std::vector<Batch> batches;
+	{
+		auto lock = std::scoped_lock(m_done.mutex);
+		std::swap(batches, m_done.batches);
+	}
+	if (batches.size() < 2) { return batches.empty() ? Batch{} : std::move(batches.front()); }
+	Coalescer coalescer;
+	for (auto& batch : batches) { coalescer.fold(std::move(batch)); }
+	return coalescer.flush();
+}
+} // namespace jk
@@ -0,0 +1,57 @@
+#pragma once
+#include <ktl/async/kthread.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Watches folders (recursively) for audio files being added, removed and renamed
+///
+/// Events are coalesced on a worker thread and published as a batch once the folders have been quiet for settle_v,
+/// or max_latency_v has passed during continuous changes. Only the changed paths are reported: nothing is rescanned.
+/// New files are reported when closed after writing, so tracks still being copied in are not picked up half way.
+/// Linux (inotify) only; elsewhere nothing is watched.
+///
+class FolderWatch {
+  public:
+	static constexpr int settle_v = 250;		// ms
+	static constexpr int max_latency_v = 2000; // ms
+	static constexpr std::size_t max_batch_v = 4096;
+
+	struct Batch {
+		std::vector<std::string> added;
+		std::vector<std::string> removed;
+		// every file under these is gone
+		std::vector<std::string> removedDirs;
+		// from, to
+		std::vector<std::pair<std::string, std::string>> renamed;
+
+		bool empty() const noexcept { return added.empty() && removed.empty() && removedDirs.empty() && renamed.empty(); }
+	};
+
+	explicit FolderWatch(std::vector<std::string> roots);
+	FolderWatch& operator=(FolderWatch&&) = delete;
+	~FolderWatch() noexcept;
+
+	// Everything published since the last call, folded into one batch of net changes
+	Batch take();
+	std::vector<std::string> const& roots() const noexcept { return m_roots; }
+	std::size_t watches() const noexcept { return m_watches.load(); }
+
+  private:
+	void run();
+
+	std::vector<std::string> m_roots;
+	struct {
+		std::vector<Batch> batches;
+		std::mutex mutex;
+	} m_done;
+	std::atomic<std::size_t> m_watches{};
+	int m_fd{-1};
+	int m_wake{-1};
+	ktl::kthread m_thread;
+};
+} // namespace jk
@@ -0,0 +1,349 @@
+#include <app/history.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+namespace {
+constexpr char log_magic_v[8] = {'j', 'k', 'h', 'i', 's', 'l', 'o', 'g'};
+constexpr char index_magic_v[8] = {'j', 'k', 'h', 'i', 's', 'i', 'd', 'x'};
+constexpr std::uint32_t format_version_v = 1;
+constexpr std::uint32_t byte_order_v = 0x01020304;
+// path definition: seconds holds the path's size, its bytes follow (padded to a whole record)
+constexpr std::uint8_t path_v = 0xff;
+
+struct LogHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+};
+
+struct IndexHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+	std::uint64_t records;
+	std::uint64_t offset;
+	std::int64_t firstDay;
+	std::uint32_t tracks;
+	std::uint32_t days;
+};
+
+template <typename T>
+void writePod(std::ostream& out, T const& t) {
+	out.write(reinterpret_cast<char const*>(&t), sizeof(T));
+}
+
+template <typename T>
+bool readPod(std::istream& in, T& out) {
+	return bool(in.read(reinterpret_cast<char*>(&out), sizeof(T)));
+}
+
+std::int64_t dayOf(std::int64_t time) noexcept { return time >= 0 ? time / History::day_v : (time - History::day_v + 1) / History::day_v; }
+} // namespace
+
+struct History::Record {
+	std::int64_t time;
+	std::uint32_t track;
+	std::uint16_t seconds;
+	std::uint8_t type;
+	std::uint8_t reserved;
+};
+
+static_assert(sizeof(History::Stats) == 24 && std::is_trivially_copyable_v<History::Stats>);
+
+struct History::Checkpoint {
+	IndexHeader header;
+	std::vector<std::string> paths;
+	std::vector<Stats> stats;
+	std::vector<std::uint32_t> days;
+
+	bool write(std::string const& path) const {
+		auto const temp = path + ".tmp";
+		{
+			auto file = std::ofstream(temp, std::ios::binary | std::ios::trunc);
+			if (!file) { return false; }
+			writePod(file, header);
+			file.write(reinterpret_cast<char const*>(stats.data()), std::streamsize(stats.size() * sizeof(Stats)));
+			file.write(reinterpret_cast<char const*>(days.data()), std::streamsize(days.size() * sizeof(std::uint32_t)));
+			for (auto const& str : paths) {
+				writePod(file, std::uint32_t(str.size()));
+				file.write(str.data(), std::streamsize(str.size()));
+			}
+			if (!file.flush()) { return false; }
+		}
+		std::error_code ec;
+		stdfs::rename(temp, path, ec);
+		return !ec;
+	}
+};
+
+std::unique_ptr<History> History::open(std::string path) {
+	auto ret = std::unique_ptr<History>(new History(std::move(path)));
+	auto const loaded = ret->load();
+	auto const end = ret->replay(loaded ? ret->m_offset : 0);
+	ret->m_offset = end;
+	std::error_code ec;
+	if (end == 0) {
+		// a checkpoint without its log counts for nothing
+		ret->m_paths.clear();
+		ret->m_ids.clear();
+		ret->m_stats.clear();
+		ret->m_days.clear();
+		ret->m_total = {};
+		ret->m_records = 0;
+		auto file = std::ofstream(ret->m_path, std::ios::binary | std::ios::trunc);
+		LogHeader header{};
+		std::memcpy(header.magic, log_magic_v, sizeof(log_magic_v));
+		header.version = format_version_v;
+		header.byteOrder = byte_order_v;
+		writePod(file, header);
+		ret->m_offset = sizeof(header);
+		if (!file.flush()) { Log::warn("[History] Failed to create [{}], plays will not persist", ret->m_path); }
+	} else if (stdfs::file_size(ret->m_path, ec) != end) {
+		// drop a record torn by a crash, so appends stay aligned
+		Log::warn("[History] Truncating [{}] to the last whole record", ret->m_path);
+		stdfs::resize_file(ret->m_path, end, ec);
+	}
+	ret->m_thread = ktl::kthread([h = ret.get()]() {
+		alloc::Scope const scope(alloc::Tag::eIo);
+		auto file = std::ofstream(h->m_path, std::ios::binary | std::ios::app);
+		while (auto job = h->m_queue.pop()) {
+			file.write(job->bytes.data(), std::streamsize(job->bytes.size()));
+			if (!file.flush()) { Log::warn("[History] Failed to write [{}]", h->m_path); }
+			// written after the records it covers: a crash in between only costs a longer replay
+			if (job->checkpoint && !job->checkpoint->write(h->m_indexPath)) { Log::warn("[History] Failed to write index [{}]", h->m_indexPath); }
+		}
+	});
+	Log::info("[History] Opened [{}]: {} records of {} tracks{}", ret->m_path, ret->m_records, ret->m_paths.size(), loaded ? " (from checkpoint)" : "");
+	return ret;
+}
+
+std::int64_t History::now() {
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+History::History(std::string path) : m_path(std::move(path)) { m_indexPath = m_path + ".idx"; }
+
+History::~History() noexcept {
+	auto residue = m_queue.active(false);
+	m_thread.join();
+	// write out what was still queued, and a final checkpoint so the next open has nothing to replay
+	auto file = std::ofstream(m_path, std::ios::binary | std::ios::app);
+	for (auto const& job : residue) { file.write(job.bytes.data(), std::streamsize(job.bytes.size())); }
+	if (!file.flush()) { Log::warn("[History] Failed to write [{}]", m_path); }
+	if (m_records > 0 && !checkpoint()->write(m_indexPath)) { Log::warn("[History] Failed to write index [{}]", m_indexPath); }
+}
+
+void History::record(Type type, std::string_view path, float seconds, std::int64_t time) {
+	Job job;
+	auto const append = [&job](void const* data, std::size_t size) {
+		auto const* bytes = static_cast<char const*>(data);
+		job.bytes.insert(job.bytes.end(), bytes, bytes + size);
+	};
+	auto it = m_ids.find(std::string(path));
+	if (it == m_ids.end()) {
+		auto const id = std::uint32_t(m_paths.size());
+		Record const def{time, id, std::uint16_t(std::min(path.size(), std::size_t(0xffff))), path_v, 0};
+		append(&def, sizeof(def));
+		append(path.data(), def.seconds);
+		job.bytes.resize(job.bytes.size() + (sizeof(Record) - def.seconds % sizeof(Record)) % sizeof(Record));
+		m_paths.emplace_back(path.substr(0, def.seconds));
+		m_stats.emplace_back();
+		it = m_ids.emplace(m_paths.back(), id).first;
+	}
+	Record const record{time, it->second, std::uint16_t(std::clamp(seconds, 0.0f, 65535.0f)), std::uint8_t(type), 0};
+	append(&record, sizeof(record));
+	apply(record);
+	m_offset += job.bytes.size();
+	if (m_records % checkpoint_v == 0) { job.checkpoint = checkpoint(); }
+	m_queue.push(std::move(job));
+}
+
+std::vector<History::Entry> History::top(std::size_t count) const {
+	std::vector<std::uint32_t> ids;
+	for (std::uint32_t id = 0; id < m_stats.size(); ++id) {
+		if (m_stats[id].plays > 0) { ids.push_back(id); }
+	}
+	count = std::min(count, ids.size());
+	auto const before = [this](std::uint32_t a, std::uint32_t b) {
+		auto const &lhs = m_stats[a], &rhs = m_stats[b];
+		return lhs.plays != rhs.plays ? lhs.plays > rhs.plays : lhs.last > rhs.last;
+	};
+	std::partial_sort(ids.begin(), ids.begin() + std::ptrdiff_t(count), ids.end(), before);
+	std::vector<Entry> ret;
+	ret.reserve(count);
+	for (std::size_t i = 0; i < count; ++i) { ret.push_back({m_paths[ids[i]], m_stats[ids[i]]}); }
+	return ret;
+}
+
+std::vector<std::uint32_t> History::playsPerDay(std::size_t days, std::int64_t time) const {
+	std::vector<std::uint32_t> ret(days);
+	auto const last = dayOf(time);
+	for (std::size_t i = 0; i < days; ++i) {
+		auto const day = last - std::int64_t(days - 1 - i) - m_firstDay;
+		if (day >= 0 && day < std::int64_t(m_days.size())) { ret[i] = m_days[std::size_t(day)]; }
+	}
+	return ret;
+}
+
+std::optional<History::Stats> History::stats(std::string_view path) const {
+	auto it = m_ids.find(std::string(path));
+	if (it == m_ids.end()) { return std::nullopt; }
+	return m_stats[it->second];
+}
+
+std::vector<History::Entry> History::entries() const {
+	std::vector<Entry> ret;
+	ret.reserve(m_stats.size());
+	for (std::size_t id = 0; id < m_stats.size(); ++id) { ret.push_back({m_paths[id], m_stats[id]}); }
+	return ret;
+}
+
+float History::skipRate(Stats const& stats) noexcept {
+	auto const ended = stats.skips + stats.completes;
+	return ended > 0 ? float(stats.skips) / float(ended) : 0.0f;
+}
+
+bool History::load() {
+	auto file = std::ifstream(m_indexPath, std::ios::binary);
+	if (!file) { return false; }
+	IndexHeader header;
+	if (!readPod(file, header) || std::memcmp(header.magic, index_magic_v, sizeof(index_magic_v)) != 0 || header.version != format_version_v ||
+		header.byteOrder != byte_order_v) {
+		Log::warn("[History] Ignoring invalid index [{}]", m_indexPath);
+		return false;
+	}
+	std::error_code ec;
+	if (auto const size = stdfs::file_size(m_path, ec); ec || size < header.offset) {
+		Log::warn("[History] Index [{}] is ahead of the log, replaying all of it", m_indexPath);
+		return false;
+	}
+	std::vector<Stats> stats(header.tracks);
+	std::vector<std::uint32_t> days(header.days);
+	std::vector<std::string> paths(header.tracks);
+	file.read(reinterpret_cast<char*>(stats.data()), std::streamsize(stats.size() * sizeof(Stats)));
+	file.read(reinterpret_cast<char*>(days.data()), std::streamsize(days.size() * sizeof(std::uint32_t)));
+	for (auto& path : paths) {
+		std::uint32_t size{};
+		if (!readPod(file, size)) { break; }
+		path.resize(size);
+		file.read(path.data(), std::streamsize(size));
+	}
+	if (!file) {
+		Log::warn("[History] Truncated index [{}]", m_indexPath);
+		return false;
+	}
+	m_stats = std::move(stats);
+	m_days = std::move(days);
+	m_paths = std::move(paths);
+	m_ids.clear();
+	for (std::uint32_t id = 0; id < m_paths.size(); ++id) { m_ids.emplace(m_paths[id], id); }
+	m_firstDay = header.firstDay;
+	m_records = header.records;
+	m_offset = header.offset;
+	m_total = {};
+	for (auto const& s : m_stats) {
+		m_total.plays += s.plays;
+		m_total.skips += s.skips;
+		m_total.completes += s.completes;
+		m_total.seconds += s.seconds;
+		m_total.last = std::max(m_total.last, s.last);
+	}
+	return true;
+}
+
+std::uint64_t History::replay(std::uint64_t offset) {
+	auto file = std::ifstream(m_path, std::ios::binary);
+	if (!file) { return 0; }
+	LogHeader header;
+	if (!readPod(file, header) || std::memcmp(header.magic, log_magic_v, sizeof(log_magic_v)) != 0 || header.version != format_version_v ||
+		header.byteOrder != byte_order_v) {
+		Log::warn("[History] Discarding log [{}] from another version", m_path);
+		return 0;
+	}
+	if (offset > sizeof(header)) { file.seekg(std::streamoff(offset)); }
+	auto end = std::max(offset, std::uint64_t(sizeof(header)));
+	Record record;
+	std::uint64_t replayed{};
+	while (readPod(file, record)) {
+		if (record.type == path_v) {
+			std::string path(record.seconds, '\0');
+			auto const padded = (record.seconds + sizeof(Record) - 1) / sizeof(Record) * sizeof(Record);
+			if (!file.read(path.data(), std::streamsize(record.seconds)) || !file.ignore(std::streamsize(padded - record.seconds))) { break; }
+			if (record.track != m_paths.size()) {
+				Log::warn("[History] Corrupt log [{}], discarding remainder", m_path);
+				break;
+			}
+			m_ids.emplace(path, record.track);
+			m_paths.push_back(std::move(path));
+			m_stats.emplace_back();
+			end += sizeof(Record) + padded;
+			continue;
+		}
+		if (record.track >= m_paths.size() || record.type > std::uint8_t(Type::eComplete)) {
+			Log::warn("[History] Corrupt log [{}], discarding remainder", m_path);
+			break;
+		}
+		apply(record);
+		end += sizeof(Record);
+		++replayed;
+	}
+	if (replayed > 0) { Log::debug("[History] Replayed {} records", replayed); }
+	return end;
+}
+
+void History::apply(Record const& record) {
+	auto& stats = m_stats[record.track];
+	switch (Type(record.type)) {
+	case Type::ePlay: {
+		++stats.plays;
+		++m_total.plays;
+		stats.last = std::max(stats.last, record.time);
+		m_total.last = std::max(m_total.last, record.time);
+		auto const day = dayOf(record.time);
+		if (m_days.empty()) { m_firstDay = day; }
+		if (day < m_firstDay) {
+			m_days.insert(m_days.begin(), std::size_t(m_firstDay - day), 0);
+			m_firstDay = day;
+		}
+		if (auto const index = std::size_t(day - m_firstDay); index >= m_days.size()) { m_days.resize(index + 1); }
+		++m_days[std::size_t(day - m_firstDay)];
+		break;
+	}
+	case Type::eSkip:
+		++stats.skips;
+		++m_total.skips;
+		break;
+	case Type::eComplete:
+		++stats.completes;
+		++m_total.completes;
+		break;
+	}
+	stats.seconds += record.seconds;
+	m_total.seconds += record.seconds;
+	++m_records;
+}
+
+std::shared_ptr<History::Checkpoint const> History::checkpoint() const {
+	auto ret = std::make_shared<Checkpoint>();
+	std::memcpy(ret->header.magic, index_magic_v, sizeof(index_magic_v));
+	ret->header.version = format_version_v;
+	ret->header.byteOrder = byte_order_v;
+	ret->header.records = m_records;
+	ret->header.offset = m_offset;
+	ret->header.firstDay = m_firstDay;
+	ret->header.tracks = std::uint32_t(m_paths.size());
+	ret->header.days = std::uint32_t(m_days.size());
+	ret->paths = m_paths;
+	ret->stats = m_stats;
+	ret->days = m_days;
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,90 @@
+#pragma once
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Append-only log of every play, skip and completion, with totals kept up to date in memory
+///
+/// Records are fixed size and appended by a worker thread, so recording never waits on the disk.
+/// Every checkpoint_v records the per track and per day totals (and the path table) are written to an index next to the log;
+/// opening loads the last checkpoint and replays only the records after it. Queries read the in-memory totals.
+///
+class History {
+  public:
+	enum class Type : std::uint8_t { ePlay, eSkip, eComplete };
+
+	struct Stats {
+		std::uint32_t plays{};
+		std::uint32_t skips{};
+		std::uint32_t completes{};
+		std::uint32_t seconds{}; // listened
+		std::int64_t last{};	 // unix time of the last play
+	};
+
+	struct Entry {
+		std::string_view path; // valid until the next record()
+		Stats stats;
+	};
+
+	static constexpr std::size_t checkpoint_v = 4096;
+	static constexpr std::int64_t day_v = 24 * 60 * 60;
+
+	static std::unique_ptr<History> open(std::string path);
+	static std::int64_t now();
+
+	History& operator=(History&&) = delete;
+	~History() noexcept;
+
+	void record(Type type, std::string_view path, float seconds, std::int64_t time = now());
+
+	// Most played first (ties: most recently played)
+	std::vector<Entry> top(std::size_t count) const;
+	// Plays on each of the last days days up to and including the day of time, oldest first (UTC days)
+	std::vector<std::uint32_t> playsPerDay(std::size_t days, std::int64_t time = now()) const;
+	std::optional<Stats> stats(std::string_view path) const;
+	// Every track's totals, in the order first played
+	std::vector<Entry> entries() const;
+	Stats const& total() const noexcept { return m_total; }
+	// skips / (skips + completes)
+	static float skipRate(Stats const& stats) noexcept;
+
+	std::size_t tracks() const noexcept { return m_paths.size(); }
+	// Plays, skips and completions recorded; also serves as a revision
+	std::uint64_t records() const noexcept { return m_records; }
+
+  private:
+	struct Record;
+	struct Checkpoint;
+	struct Job {
+		std::vector<char> bytes; // appended to the log
+		std::shared_ptr<Checkpoint const> checkpoint;
+	};
+
+	explicit History(std::string path);
+
+	bool load();
+	std::uint64_t replay(std::uint64_t offset);
+	void apply(Record const& record);
+	std::shared_ptr<Checkpoint const> checkpoint() const;
+
+	std::string m_path;
+	std::string m_indexPath;
+	std::vector<std::string> m_paths;
+	std::unordered_map<std::string, std::uint32_t> m_ids;
+	std::vector<Stats> m_stats;
+	std::vector<std::uint32_t> m_days; // plays per day, from m_firstDay
+	std::int64_t m_firstDay{};
+	Stats m_total{};
+	std::uint64_t m_records{};
+	std::uint64_t m_offset{}; // log size once the worker has caught up
+	ktl::async_queue<Job> m_queue;
+	ktl::kthread m_thread;
+};
+} // namespace jk
@@ -0,0 +1,183 @@
+#include <app/input_log.hpp>
+#include <misc/log.hpp>
+#include <bit>
+#include <filesystem>
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+std::unique_ptr<InputRecorder> InputRecorder::open(std::string path) {
+	auto ret = std::unique_ptr<InputRecorder>(new InputRecorder());
+	ret->m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!ret->m_file) {
+		Log::error("[InputRecorder] Failed to open [{}]", path);
+		return {};
+	}
+	ret->m_path = std::move(path);
+	ret->m_buffer.reserve(flush_threshold_v * 2);
+	ret->m_buffer.insert(ret->m_buffer.end(), InputLog::magic_v.begin(), InputLog::magic_v.end());
+	ret->m_buffer.push_back(InputLog::version_v);
+	Log::info("[InputRecorder] Recording input to [{}]", ret->m_path);
+	return ret;
+}
+
+InputRecorder::~InputRecorder() noexcept {
+	flush();
+	Log::info("[InputRecorder] Recorded {} frames to [{}]", m_frames, m_path);
+}
+
+void InputRecorder::frame(std::uint32_t micros) {
+	// frames are the bulk of a log; only flush on boundaries so a crash loses at most a partial frame
+	if (m_buffer.size() >= flush_threshold_v) { flush(); }
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eFrame));
+	put(micros);
+	++m_frames;
+}
+
+void InputRecorder::key(dibs::Event::Key const& key, bool captured) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eKey));
+	put(std::uint64_t(std::uint32_t(key.key)));
+	put(std::uint64_t(std::uint32_t(key.scancode)));
+	m_buffer.push_back(std::uint8_t(key.action));
+	m_buffer.push_back(std::uint8_t(key.mods));
+	m_buffer.push_back(std::uint8_t(captured));
+}
+
+void InputRecorder::fileDrop(std::span<std::string const> paths) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eFileDrop));
+	put(paths.size());
+	for (auto const& path : paths) { put(path); }
+}
+
+void InputRecorder::add(std::string_view path) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eAdd));
+	put(path);
+}
+
+void InputRecorder::action(Controller::Response response) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eAction));
+	m_buffer.push_back(std::uint8_t(response.action));
+	put(std::bit_cast<std::uint32_t>(response.value));
+}
+
+void InputRecorder::renameList(std::size_t list, std::string_view name) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eRenameList));
+	put(list);
+	put(name);
+}
+
+void InputRecorder::ruleList(std::size_t list, std::string_view rule) {
+	m_buffer.push_back(std::uint8_t(InputLog::Type::eRuleList));
+	put(list);
+	put(rule);
+}
+
+void InputRecorder::put(std::uint64_t value) {
+	while (value >= 0x80) {
+		m_buffer.push_back(std::uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	m_buffer.push_back(std::uint8_t(value));
+}
+
+void InputRecorder::put(std::string_view str) {
+	put(str.size());
+	m_buffer.insert(m_buffer.end(), str.begin(), str.end());
+}
+
+void InputRecorder::flush() {
+	if (m_buffer.empty()) { return; }
+	if (!m_file.write(reinterpret_cast<char const*>(m_buffer.data()), std::streamsize(m_buffer.size())).flush()) {
+		Log::warn("[InputRecorder] Failed to write [{}]", m_path);
+	}
+	m_buffer.clear();
+}
+
+std::optional<InputReplay> InputReplay::load(char const* path) {
+	auto file = std::ifstream(path, std::ios::binary);
+	if (!file) {
+		Log::error("[InputReplay] Failed to open [{}]", path);
+		return std::nullopt;
+	}
+	std::error_code ec;
+	auto const size = stdfs::file_size(path, ec);
+	InputReplay ret;
+	ret.m_data.resize(ec ? 0 : std::size_t(size));
+	file.read(reinterpret_cast<char*>(ret.m_data.data()), std::streamsize(ret.m_data.size()));
+	auto const header = InputLog::magic_v.size() + 1;
+	if (!file || ret.m_data.size() < header || std::string_view(reinterpret_cast<char const*>(ret.m_data.data()), InputLog::magic_v.size()) != InputLog::magic_v) {
+		Log::error("[InputReplay] Invalid input log [{}]", path);
+		return std::nullopt;
+	}
+	if (auto const version = ret.m_data[InputLog::magic_v.size()]; version != InputLog::version_v) {
+		Log::error("[InputReplay] Unsupported input log version [{}]", version);
+		return std::nullopt;
+	}
+	ret.m_pos = header;
+	return ret;
+}
+
+std::optional<InputLog::Entry> InputReplay::next() {
+	if (m_pos >= m_data.size()) { return std::nullopt; }
+	InputLog::Entry ret;
+	ret.type = InputLog::Type(m_data[m_pos++]);
+	std::uint64_t value{};
+	bool valid = true;
+	switch (ret.type) {
+	case InputLog::Type::eFrame:
+		valid = get(value);
+		ret.micros = std::uint32_t(value);
+		break;
+	case InputLog::Type::eKey:
+		valid = get(value);
+		ret.key.key = int(std::uint32_t(value));
+		valid = valid && get(value);
+		ret.key.scancode = int(std::uint32_t(value));
+		valid = valid && m_pos + 3 <= m_data.size();
+		if (valid) {
+			ret.key.action = m_data[m_pos++];
+			ret.key.mods = m_data[m_pos++];
+			ret.captured = m_data[m_pos++] != 0;
+		}
+		break;
+	case InputLog::Type::eFileDrop:
+		valid = get(value) && value <= m_data.size() - m_pos;
+		for (std::uint64_t i = 0; valid && i < value; ++i) { valid = get(ret.paths.emplace_back()); }
+		break;
+	case InputLog::Type::eAdd: valid = get(ret.paths.emplace_back()); break;
+	case InputLog::Type::eAction:
+		valid = m_pos < m_data.size();
+		if (valid) { ret.action.action = Controller::Action(m_data[m_pos++]); }
+		valid = valid && get(value);
+		ret.action.value = std::bit_cast<float>(std::uint32_t(value));
+		break;
+	case InputLog::Type::eRenameList:
+	case InputLog::Type::eRuleList: valid = get(ret.list) && get(ret.text); break;
+	default: valid = false; break;
+	}
+	if (!valid) {
+		Log::error("[InputReplay] Corrupt entry at offset {}", m_pos);
+		m_pos = m_data.size();
+		return std::nullopt;
+	}
+	return ret;
+}
+
+bool InputReplay::get(std::uint64_t& out) noexcept {
+	out = 0;
+	for (unsigned shift = 0; m_pos < m_data.size() && shift < 64; shift += 7) {
+		auto const byte = m_data[m_pos++];
+		out |= std::uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) { return true; }
+	}
+	return false;
+}
+
+bool InputReplay::get(std::string& out) {
+	std::uint64_t size{};
+	if (!get(size) || size > m_data.size() - m_pos) { return false; }
+	out.assign(reinterpret_cast<char const*>(m_data.data() + m_pos), std::size_t(size));
+	m_pos += std::size_t(size);
+	return true;
+}
+} // namespace jk
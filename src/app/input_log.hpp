@@ -0,0 +1,84 @@
+#pragma once
+#include <app/controller.hpp>
+#include <dibs/event.hpp>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Compact binary log of input: dibs events, UI actions and frame boundaries
+///
+/// Entries are tied to frames, not wall time: replaying a log feeds the same input into the same frames.
+/// Layout: magic, version, then a stream of [type][payload] with LEB128 integers; each eFrame entry starts a frame.
+///
+struct InputLog {
+	enum class Type : std::uint8_t { eFrame, eKey, eFileDrop, eAdd, eAction, eRenameList, eRuleList };
+
+	struct Entry {
+		std::vector<std::string> paths;
+		dibs::Event::Key key{};
+		Controller::Response action{};
+		// eRenameList / eRuleList: the playlist and its new name / rule
+		std::string text{};
+		std::uint64_t list{};
+		// recorded duration of the frame
+		std::uint32_t micros{};
+		Type type{};
+		// key went to a focused text field, not the controller
+		bool captured{};
+	};
+
+	static constexpr std::string_view magic_v = "jkin";
+	static constexpr std::uint8_t version_v = 2;
+};
+
+class InputRecorder {
+  public:
+	static std::unique_ptr<InputRecorder> open(std::string path);
+	~InputRecorder() noexcept;
+
+	void frame(std::uint32_t micros);
+	void key(dibs::Event::Key const& key, bool captured);
+	void fileDrop(std::span<std::string const> paths);
+	void add(std::string_view path);
+	void action(Controller::Response response);
+	void renameList(std::size_t list, std::string_view name);
+	void ruleList(std::size_t list, std::string_view rule);
+
+	std::uint64_t frames() const noexcept { return m_frames; }
+
+  private:
+	static constexpr std::size_t flush_threshold_v = 64 * 1024;
+
+	InputRecorder() = default;
+
+	void put(std::uint64_t value);
+	void put(std::string_view str);
+	void flush();
+
+	std::vector<std::uint8_t> m_buffer;
+	std::ofstream m_file;
+	std::string m_path;
+	std::uint64_t m_frames{};
+};
+
+class InputReplay {
+  public:
+	static std::optional<InputReplay> load(char const* path);
+
+	std::optional<InputLog::Entry> next();
+
+  private:
+	bool get(std::uint64_t& out) noexcept;
+	bool get(std::string& out);
+
+	std::vector<std::uint8_t> m_data;
+	std::size_t m_pos{};
+};
+} // namespace jk
@@ -1,12 +1,16 @@
 #include <app/jukebox.hpp>
 #include <app/playlist.hpp>
+#include <app/track_source.hpp>
 #include <capo/utils/format_unit.hpp>
 #include <dibs/vec2.hpp>
+#include <ktl/kformat.hpp>
 #include <misc/log.hpp>
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 #include <imgui_internal.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <filesystem>
 #include <map>
 #include <set>
@@ -28,10 +32,19 @@ std::istream& operator>>(std::istream& in, tvec2<T>& out) {
 
 namespace jk {
 namespace stdfs = std::filesystem;
-namespace stdch = std::chrono;
-using namespace std::chrono_literals;
 
 namespace {
+constexpr std::string_view replay_dir_v = "jukebox_replay/";
+
+// seeded into jukebox_eq.ini if missing; "<type>:<frequency>:<q>:<gain dB>" per band
+constexpr std::pair<std::string_view, std::string_view> builtin_presets_v[] = {
+	{"Bass Boost", "low:100:0.7:6"},
+	{"Treble Boost", "high:6000:0.7:5"},
+	{"Loudness", "low:80:0.7:5 high:10000:0.7:4"},
+	{"Vocal", "low:120:0.7:-3 peak:2500:1:3 high:10000:0.7:-1"},
+	{"Smile", "low:100:0.7:4 peak:1000:0.7:-2 high:8000:0.7:4"},
+};
+
 constexpr std::string_view filename(std::string_view path, bool ext) noexcept {
 	if (path.empty()) { return "--"; }
 	auto it = path.find_last_of('/');
@@ -41,19 +54,8 @@ constexpr std::string_view filename(std::string_view path, bool ext) noexcept {
 	return path;
 }
 
-std::string length(capo::utils::Length const& len) noexcept {
-	static constexpr std::string_view options[] = {"{}:0{}:0{}", "{}:0{}:{}", "{}:{}:0{}"};
-	std::string_view fmt = "{}:{}:{}";
-	if (len.minutes < stdch::minutes(10)) {
-		if (len.seconds < 10s) {
-			fmt = options[0];
-		} else {
-			fmt = options[1];
-		}
-	} else {
-		if (len.seconds < 10s) { fmt = options[2]; }
-	}
-	return ktl::kformat(fmt.data(), len.hours.count(), len.minutes.count(), len.seconds.count());
+char const* length(FrameArena& arena, capo::utils::Length const& len) {
+	return arena.format("%d:%02d:%02d", int(len.hours.count()), int(len.minutes.count()), int(len.seconds.count()));
 }
 
 dibs::uvec2 framebufferSize(GLFWwindow* window) noexcept {
@@ -74,6 +76,43 @@ dibs::ivec2 windowPos(GLFWwindow* window) noexcept {
 	return {std::int32_t(w), std::int32_t(h)};
 }
 
+void drawPeaks(Waveform::Peaks const& peaks, ImVec2 const origin, ImVec2 const size) {
+	static constexpr ImU32 peak_colour = IM_COL32(90, 110, 150, 160);
+	static constexpr ImU32 rms_colour = IM_COL32(130, 160, 210, 200);
+	auto const columns = peaks.level(size.x);
+	auto const width = std::size_t(size.x);
+	if (columns.empty() || width == 0) { return; }
+	auto* drawList = ImGui::GetWindowDrawList();
+	float const mid = origin.y + size.y * 0.5f;
+	float const scale = size.y * 0.5f / 32768.0f;
+	for (std::size_t x = 0; x < width; ++x) {
+		auto const begin = columns.size() * x / width;
+		auto const end = std::max(begin + 1, columns.size() * (x + 1) / width);
+		auto column = columns[begin];
+		for (auto i = begin + 1; i < end; ++i) {
+			column.min = std::min(column.min, columns[i].min);
+			column.max = std::max(column.max, columns[i].max);
+			column.rms = std::max(column.rms, columns[i].rms);
+		}
+		float const px = origin.x + float(x);
+		drawList->AddLine({px, mid - float(column.max) * scale}, {px, mid - float(column.min) * scale}, peak_colour);
+		drawList->AddLine({px, mid - float(column.rms) * scale}, {px, mid + float(column.rms) * scale}, rms_colour);
+	}
+}
+
+// .txt playlists are expanded here, where library ids (@<id>) resolve
+void expand(std::span<std::string const> paths, Library const* library, std::vector<std::string>& out) {
+	for (auto const& path : paths) {
+		if (!path.ends_with(".txt")) {
+			out.push_back(path);
+			continue;
+		}
+		Playlist list;
+		list.library = library;
+		if (list.load(path.data()) > 0) { expand(list.tracks, library, out); }
+	}
+}
+
 [[maybe_unused]] void tooltipMarker(char const* desc, char const* marker = "(?)") {
 	ImGui::SameLine();
 	ImGui::TextDisabled("%s", marker);
@@ -97,64 +136,102 @@ std::optional<float> LazySliderFloat::operator()(char const* name, float value,
 
 struct FileBrowser::Impl {
 	enum Ext { eFlac, eMp3, eWav, eTxt };
+	struct Entry {
+		stdfs::path path;
+		std::string name;
+		Library::Id id{Library::null_id};
+	};
+
 	stdfs::path m_pwd;
+	std::string m_pwdName;
+	std::vector<Entry> m_dirs;
+	std::vector<Entry> m_files;
 	bool exts[4] = {true, true, true, false};
+	bool m_dirty = true;
 
-	stdfs::path operator()(bool& out_show) {
+	stdfs::path operator()(bool& out_show, Library const* library) {
 		stdfs::path ret;
-		if (out_show) {
-			ImGui::SetNextWindowSize({450.0f, 200.0f}, ImGuiCond_Once);
-			if (ImGui::Begin(jk::FileBrowser::title_v.data(), &out_show)) {
-				ImGui::Text("%s", m_pwd.generic_string().data());
-				ImGui::Checkbox("FLAC", &exts[eFlac]);
-				ImGui::SameLine();
-				ImGui::Checkbox("MP3", &exts[eMp3]);
-				ImGui::SameLine();
-				ImGui::Checkbox("WAV", &exts[eWav]);
-				ImGui::SameLine();
-				ImGui::Checkbox("Playlist", &exts[eTxt]);
-				ktl::fixed_vector<std::string_view, 4> extNames;
-				if (exts[eFlac]) { extNames.push_back(".flac"); }
-				if (exts[eMp3]) { extNames.push_back(".mp3"); }
-				if (exts[eWav]) { extNames.push_back(".wav"); }
-				if (exts[eTxt]) { extNames.push_back(".txt"); }
-				std::set<stdfs::path> dirs;
-				std::map<std::string, std::set<stdfs::path>> files;
-				for (auto const& path : stdfs::directory_iterator(m_pwd)) {
-					if (path.is_directory()) {
-						auto p = path.path();
-						if (!p.filename().generic_string().starts_with('.')) { dirs.insert(std::move(p)); }
-					} else {
-						auto p = path.path();
-						auto const ext = p.extension().string();
-						if (std::find(extNames.begin(), extNames.end(), ext) != extNames.end()) {
-							if (ext != ".txt" || Playlist::valid(p.string().data(), true)) { files[ext].insert(std::move(p)); }
+		if (!out_show) {
+			// rescan on reopen
+			m_dirty = true;
+			return ret;
+		}
+		ImGui::SetNextWindowSize({450.0f, 200.0f}, ImGuiCond_Once);
+		if (ImGui::Begin(jk::FileBrowser::title_v.data(), &out_show)) {
+			ImGui::Text("%s", m_pwdName.data());
+			m_dirty |= ImGui::Checkbox("FLAC", &exts[eFlac]);
+			ImGui::SameLine();
+			m_dirty |= ImGui::Checkbox("MP3", &exts[eMp3]);
+			ImGui::SameLine();
+			m_dirty |= ImGui::Checkbox("WAV", &exts[eWav]);
+			ImGui::SameLine();
+			m_dirty |= ImGui::Checkbox("Playlist", &exts[eTxt]);
+			if (m_dirty) { refresh(library); }
+			if (ImGui::BeginChild("Playlist", {ImGui::GetWindowSize().x - 20.0f, 0.0f}, true, ImGuiWindowFlags_HorizontalScrollbar)) {
+				if (m_pwd.has_parent_path() && ImGui::Selectable("..##go_up", false)) {
+					pwd(m_pwd.parent_path());
+				} else {
+					for (auto& dir : m_dirs) {
+						if (ImGui::Selectable(dir.name.data(), false)) {
+							pwd(std::move(dir.path));
+							break;
 						}
 					}
-				}
-				if (ImGui::BeginChild("Playlist", {ImGui::GetWindowSize().x - 20.0f, 0.0f}, true, ImGuiWindowFlags_HorizontalScrollbar)) {
-					if (m_pwd.has_parent_path() && ImGui::Selectable("..##go_up", false)) {
-						pwd(m_pwd.parent_path());
-					} else {
-						for (auto& path : dirs) {
-							std::string const name = path.filename().generic_string() + '/';
-							if (ImGui::Selectable(name.data(), false)) { pwd(std::move(path)); }
-						}
-						for (auto& [_, set] : files) {
-							for (auto const& path : set) {
-								if (ImGui::Selectable(path.filename().generic_string().data(), false)) { ret = std::move(path); }
-							}
+					for (auto& file : m_files) {
+						if (ImGui::Selectable(file.name.data(), false)) { ret = file.path; }
+						if (auto const entry = library ? library->entry(file.id) : std::nullopt) {
+							auto const seconds = int(entry->meta.length);
+							ImGui::SameLine();
+							ImGui::TextDisabled("%d:%02d", seconds / 60, seconds % 60);
 						}
 					}
 				}
-				ImGui::EndChild();
 			}
-			ImGui::End();
+			ImGui::EndChild();
 		}
+		ImGui::End();
 		return ret;
 	}
 
-	void pwd(stdfs::path path) { m_pwd = std::move(path); }
+	// directory listing is cached: only rescanned when the directory or the filter changes
+	void refresh(Library const* library) {
+		ktl::fixed_vector<std::string_view, 4> extNames;
+		if (exts[eFlac]) { extNames.push_back(".flac"); }
+		if (exts[eMp3]) { extNames.push_back(".mp3"); }
+		if (exts[eWav]) { extNames.push_back(".wav"); }
+		if (exts[eTxt]) { extNames.push_back(".txt"); }
+		std::set<stdfs::path> dirs;
+		std::map<std::string, std::set<stdfs::path>> files;
+		std::error_code ec;
+		for (auto const& path : stdfs::directory_iterator(m_pwd, ec)) {
+			if (path.is_directory()) {
+				auto p = path.path();
+				if (!p.filename().generic_string().starts_with('.')) { dirs.insert(std::move(p)); }
+			} else {
+				auto p = path.path();
+				auto const ext = p.extension().string();
+				if (std::find(extNames.begin(), extNames.end(), ext) != extNames.end()) {
+					if (ext != ".txt" || Playlist::valid(p.string().data(), true)) { files[ext].insert(std::move(p)); }
+				}
+			}
+		}
+		m_dirs.clear();
+		m_files.clear();
+		for (auto const& dir : dirs) { m_dirs.push_back({dir, dir.filename().generic_string() + '/'}); }
+		for (auto const& [_, set] : files) {
+			for (auto const& file : set) {
+				auto const id = library ? library->find(file.generic_string()) : Library::null_id;
+				m_files.push_back({file, file.filename().generic_string(), id});
+			}
+		}
+		m_pwdName = m_pwd.generic_string();
+		m_dirty = false;
+	}
+
+	void pwd(stdfs::path path) {
+		m_pwd = std::move(path);
+		m_dirty = true;
+	}
 };
 
 FileBrowser::FileBrowser() : m_impl(std::make_unique<Impl>()) { m_impl->m_pwd = stdfs::current_path(); }
@@ -162,7 +239,7 @@ FileBrowser::FileBrowser(FileBrowser&&) noexcept = default;
 FileBrowser& FileBrowser::operator=(FileBrowser&&) noexcept = default;
 FileBrowser::~FileBrowser() noexcept = default;
 
-std::string FileBrowser::operator()() { return (*m_impl)(m_show).generic_string(); }
+std::string FileBrowser::operator()() { return (*m_impl)(m_show, m_library).generic_string(); }
 
 std::optional<Jukebox> Jukebox::make(ktl::not_null<GLFWwindow*> window) {
 	auto capo = std::make_unique<capo::Instance>();
@@ -170,39 +247,109 @@ std::optional<Jukebox> Jukebox::make(ktl::not_null<GLFWwindow*> window) {
 		Log::error("[Jukebox] Failed to initialize capo instance!");
 		return {};
 	}
-	return Jukebox(window, std::move(capo));
+	auto library = Library::open("jukebox_library.bin");
+	return Jukebox(window, std::move(capo), std::move(library));
+}
+
+std::optional<Jukebox> Jukebox::headless() {
+	auto capo = std::make_unique<capo::Instance>();
+	if (!capo->valid()) {
+		Log::error("[Jukebox] Failed to initialize capo instance (configure with JUKEBOX_STUB_AUDIO to run without a device)!");
+		return {};
+	}
+	// start cold every time, and never touch the user's library / cache / session
+	std::error_code ec;
+	stdfs::remove_all(replay_dir_v, ec);
+	stdfs::create_directories(replay_dir_v, ec);
+	auto library = Library::open(std::string(replay_dir_v) + "jukebox_library.bin");
+	return Jukebox(nullptr, std::move(capo), std::move(library));
 }
 
-Jukebox::Jukebox(ktl::not_null<GLFWwindow*> window, std::unique_ptr<capo::Instance>&& capo)
-	: m_capo(std::move(capo)), m_window(window), m_player(m_capo.get()) {
-	ImGui::GetStyle().ScaleAllSizes(1.33f);
-	ImGui::GetIO().FontGlobalScale = 1.33f;
-	ImGui::GetIO().IniFilename = {};
-	loadConfig();
+Jukebox::Jukebox(GLFWwindow* window, std::unique_ptr<capo::Instance>&& capo, std::unique_ptr<Library>&& library)
+	: m_capo(std::move(capo)), m_library(std::move(library)), m_window(window),
+	  // headless (replays): commands apply in the frame they are sent in, not whenever the player thread gets to them
+	  m_player(std::make_unique<PlayerThread>(m_capo.get(), window ? PlayerThread::Drive::eThread : PlayerThread::Drive::eCaller)) {
+	auto const dir = std::string(m_window ? std::string_view() : replay_dir_v);
+	if (m_window) {
+		ImGui::GetStyle().ScaleAllSizes(1.33f);
+		ImGui::GetIO().FontGlobalScale = 1.33f;
+		ImGui::GetIO().IniFilename = {};
+	}
+	m_data.waveform = std::make_unique<Waveform>(dir + "jukebox_cache");
+	m_data.scanner = std::make_unique<LoudnessScanner>();
+	m_data.writer = std::make_unique<PlaylistWriter>();
+	m_data.session = std::make_unique<Session>(dir + "jukebox_session.txt", m_library.get());
+	m_data.browser.m_library = m_library.get();
+	m_data.history = History::open(dir + "jukebox_history.bin");
+	loadPresets(dir + "jukebox_eq.ini");
+	if (m_window) { loadConfig(); }
+	if (m_window) { restoreSession(); }
 }
 
-void Jukebox::onKey(dibs::Event::Key const& key) { m_controller.onKey(key); }
+void Jukebox::onKey(dibs::Event::Key const& key) {
+	// typing in the rename / rule fields: Ctrl+A, Delete, Ctrl+Z etc. belong to the field, not the playlist
+	bool const captured = m_window && ImGui::GetIO().WantCaptureKeyboard;
+	if (m_data.recorder) { m_data.recorder->key(key, captured); }
+	if (!captured) { m_controller.onKey(key); }
+}
 
 void Jukebox::onFileDrop(std::span<std::string const> paths) {
-	bool const empty = m_player.empty();
-	if (m_player.add(paths) && empty) { m_player.play(); }
+	if (m_data.recorder) { m_data.recorder->fileDrop(paths); }
+	add(paths, true);
+}
+
+void Jukebox::onAdd(std::string path) {
+	if (m_data.recorder) { m_data.recorder->add(path); }
+	std::string const paths[] = {std::move(path)};
+	add(paths, false);
+}
+
+void Jukebox::onAction(Controller::Action action, float value) {
+	if (m_data.recorder) { m_data.recorder->action({value, action}); }
+	m_controller.push(action, value);
+}
+
+void Jukebox::onRenameList(std::size_t index, std::string name) {
+	if (m_data.recorder) { m_data.recorder->renameList(index, name); }
+	m_player->renameList(index, std::move(name), m_player->state().revision);
+}
+
+void Jukebox::onRuleList(std::size_t index, std::string rule) {
+	if (m_data.recorder) { m_data.recorder->ruleList(index, rule); }
+	m_player->ruleList(index, std::move(rule), m_player->state().revision);
+}
+
+bool Jukebox::record(std::string path) {
+	m_data.recorder = InputRecorder::open(std::move(path));
+	return m_data.recorder != nullptr;
 }
 
 void Jukebox::update() {
-	m_player.update();
-	using Action = Controller::Action;
-	for (auto const& response : m_controller.responses()) {
-		switch (response.action) {
-		case Action::ePlayPause: playPause(); break;
-		case Action::eStop: m_player.stop(); break;
-		case Action::eMute: muteUnmute(); break;
-		case Action::eNext: next(); break;
-		case Action::ePrev: prev(); break;
-		case Action::eSeek: seek(capo::Time(response.value)); break;
-		case Action::eVolume: m_player.gain(std::clamp(m_player.gain() + response.value, 0.0f, 1.0f)); break;
-		case Action::eQuit: glfwSetWindowShouldClose(m_window, GLFW_TRUE); return;
-		case Action::eNone: break;
+	alloc::Scope const scope(alloc::Tag::eUi);
+	auto const start = alloc::thread();
+	// input recorded before this point was handled before this frame; UI actions after it, during
+	if (m_data.recorder) { m_data.recorder->frame(std::uint32_t(ImGui::GetIO().DeltaTime * 1000000.0f)); }
+	m_data.arena.reset();
+	m_player->sync();
+	m_library->update();
+	updateAdded();
+	updateHistory();
+	updateSmart();
+	updateLoudness();
+	updateDuplicates();
+	updateWatch();
+	updateSession();
+	auto const responses = m_controller.responses();
+	for (auto const& response : responses) {
+		if (response.action == Controller::Action::eQuit) {
+			if (m_window) { glfwSetWindowShouldClose(m_window, GLFW_TRUE); }
+			return;
 		}
+		dispatch(response);
+	}
+	if (!m_window) {
+		steady(alloc::thread() - start, !responses.empty());
+		return;
 	}
 	static constexpr auto flags =
 		ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar;
@@ -211,10 +358,11 @@ void Jukebox::update() {
 	ImGui::SetNextWindowSize({float(fb.x), float(fb.y)});
 	if (ImGui::Begin("Jukebox", nullptr, flags)) {
 		// main window
-		ImGui::Text("%s", filename(m_player.path(), false).data());
+		ImGui::Text("%s", filename(m_player->state().path, false).data());
 		ImGui::Separator();
 		mainControls();
 		seekBar();
+		if (m_data.flags[Flag::eShowSpectrum]) { visualiser(); }
 		ImGui::Separator();
 		trackControls();
 		ImGui::Separator();
@@ -228,7 +376,13 @@ void Jukebox::update() {
 			m_data.flags.assign(Flag::eShowImGuiDemo, b);
 		}
 	}
+	if constexpr (alloc::enabled_v) {
+		if (m_data.flags[Flag::eShowAllocations]) { allocations(); }
+	}
+	if (m_data.flags[Flag::eShowStream]) { stream(); }
+	if (m_data.flags[Flag::eShowHistory]) { history(); }
 	updateConfig();
+	endFrame(alloc::thread() - start, !responses.empty() || ImGui::IsAnyMouseDown() || ImGui::IsAnyItemActive());
 }
 
 void Jukebox::mainControls() {
@@ -236,13 +390,14 @@ void Jukebox::mainControls() {
 	ImVec2 const playBtnSize = {playWidth, playWidth};
 	ImVec2 const btnSize = {playWidth, playWidth * 0.75f};
 	float stopOffsetX{};
+	auto const& state = m_player->state();
 	auto const playPauseBtn = [&]() {
-		return m_player.playing() ? ImGui::Button("||##pause", playBtnSize) : ImGui::ArrowButtonEx("play", ImGuiDir_Right, playBtnSize);
+		return state.playing() ? ImGui::Button("||##pause", playBtnSize) : ImGui::ArrowButtonEx("play", ImGuiDir_Right, playBtnSize);
 	};
-	if (playPauseBtn()) { playPause(); }
+	if (playPauseBtn()) { onAction(Controller::Action::ePlayPause); }
 	stopOffsetX += playBtnSize.x + 10.0f;
 	ImGui::SameLine();
-	if (ImGui::Button("##stop", btnSize)) { m_player.stop(); }
+	if (ImGui::Button("##stop", btnSize)) { onAction(Controller::Action::eStop); }
 	{
 		float const rect = 10.0f;
 		ImVec2 const c = ImGui::GetCursorPos();
@@ -251,152 +406,753 @@ void Jukebox::mainControls() {
 		ImGui::GetWindowDrawList()->AddRectFilled(p_min, p_max, 0xffffffff);
 	}
 	ImGui::SameLine();
-	if (ImGui::Button("<<##previous", btnSize)) { prev(); }
+	if (ImGui::Button("<<##previous", btnSize)) { onAction(Controller::Action::ePrev); }
 	ImGui::SameLine();
-	if (ImGui::Button(">>##next", btnSize)) { next(); }
+	if (ImGui::Button(">>##next", btnSize)) { onAction(Controller::Action::eNext); }
 	ImGui::SameLine();
 	ImGui::SetCursorPosX(ImGui::GetWindowWidth() - 240.0f - 20.0f);
-	auto const volumeStr = m_player.muted() ? "<x##mute" : "<))##mute";
-	if (ImGui::Button(volumeStr, {40.0f, 23.0f})) { muteUnmute(); }
+	auto const volumeStr = state.muted ? "<x##mute" : "<))##mute";
+	if (ImGui::Button(volumeStr, {40.0f, 23.0f})) { onAction(Controller::Action::eMute); }
 	ImGui::SameLine();
 	ImGui::SetNextItemWidth(200.0f);
-	int gain = int(m_player.gain() * 100.0f);
-	if (ImGui::SliderInt("##volume", &gain, 0, 100, "%1.2f")) { m_player.gain(float(gain) / 100.0f); }
-	if (m_player.muted() && ImGui::IsItemClicked()) { m_player.unmute(); }
-	if (ImGui::IsItemHovered() && ImGui::GetIO().MouseWheel != 0.0f) {
-		m_player.gain(std::clamp(m_player.gain() + ImGui::GetIO().MouseWheel * 0.1f, 0.0f, 1.0f));
-	}
+	int gain = int(state.gain * 100.0f);
+	if (ImGui::SliderInt("##volume", &gain, 0, 100, "%1.2f")) { onAction(Controller::Action::eGain, float(gain) / 100.0f); }
+	if (state.muted && ImGui::IsItemClicked()) { onAction(Controller::Action::eMute); }
+	if (ImGui::IsItemHovered() && ImGui::GetIO().MouseWheel != 0.0f) { onAction(Controller::Action::eVolume, ImGui::GetIO().MouseWheel * 0.1f); }
 }
 
 void Jukebox::seekBar() {
-	auto const position = m_player.music().position();
-	auto const total = m_player.music().meta().length();
+	auto const& state = m_player->state();
+	auto const position = state.position;
+	auto const total = state.length;
 	float pos = position.count();
-	ImGui::Text("%s", length(capo::utils::Length(position)).data());
+	ImGui::Text("%s", length(m_data.arena, capo::utils::Length(position)));
 	ImGui::SameLine();
-	auto totalLength = length(capo::utils::Length(total));
-	ImGui::SetCursorPosX(ImGui::GetWindowWidth() - ImGui::CalcTextSize(totalLength.data()).x - 10.0f);
-	ImGui::Text("%s", totalLength.data());
+	auto const totalLength = length(m_data.arena, capo::utils::Length(total));
+	ImGui::SetCursorPosX(ImGui::GetWindowWidth() - ImGui::CalcTextSize(totalLength).x - 10.0f);
+	ImGui::Text("%s", totalLength);
+	m_data.waveform->request(state.path);
+	if (auto const peaks = m_data.waveform->peaks()) {
+		drawPeaks(*peaks, ImGui::GetCursorScreenPos(), {ImGui::GetContentRegionAvail().x, ImGui::GetFrameHeight()});
+	}
 	ImGui::SetNextItemWidth(-1.0f);
-	if (auto seek = m_data.seek("##seek", pos, 0.0f, total.count())) { m_player.seek(capo::Time(*seek)); }
+	if (auto seek = m_data.seek("##seek", pos, 0.0f, total.count())) { onAction(Controller::Action::eSeekTo, *seek); }
+}
+
+void Jukebox::visualiser() {
+	auto const& state = m_player->state();
+	if (state.samples != m_data.samples) {
+		m_data.samples = state.samples;
+		m_data.spectrum->source(state.samples);
+	}
+	m_data.spectrum->position(state.position, state.playing(), state.muted ? 0.0f : state.gain * state.trackGain);
+	auto const& frame = m_data.spectrum->frame();
+	static constexpr float height = 60.0f;
+	static constexpr float vuWidth = 12.0f;
+	static constexpr ImU32 band_colour = IM_COL32(110, 170, 230, 220);
+	static constexpr ImU32 rms_colour = IM_COL32(90, 200, 120, 220);
+	static constexpr ImU32 peak_colour = IM_COL32(240, 200, 90, 255);
+	auto* drawList = ImGui::GetWindowDrawList();
+	auto const origin = ImGui::GetCursorScreenPos();
+	float const width = ImGui::GetContentRegionAvail().x;
+	float const bandsWidth = width - (vuWidth + 4.0f) * float(frame.rms.size());
+	float const bandWidth = bandsWidth / float(frame.bands.size());
+	for (std::size_t i = 0; i < frame.bands.size(); ++i) {
+		float const x = origin.x + bandWidth * float(i);
+		drawList->AddRectFilled({x + 1.0f, origin.y + height * (1.0f - frame.bands[i])}, {x + bandWidth - 1.0f, origin.y + height}, band_colour);
+	}
+	for (std::size_t c = 0; c < frame.rms.size(); ++c) {
+		float const x = origin.x + bandsWidth + 4.0f + (vuWidth + 4.0f) * float(c);
+		drawList->AddRectFilled({x, origin.y + height * (1.0f - frame.rms[c])}, {x + vuWidth, origin.y + height}, rms_colour);
+		float const peakY = origin.y + height * (1.0f - frame.peak[c]);
+		drawList->AddLine({x, peakY}, {x + vuWidth, peakY}, peak_colour, 2.0f);
+	}
+	ImGui::Dummy({width, height});
+	if constexpr (jk_debug) {
+		if (ImGui::IsItemHovered()) {
+			auto const resident = m_data.samples ? float(m_data.samples->bytes()) / float(1 << 20) : 0.0f;
+			auto const* note = m_data.samples ? "" : " (streaming: nothing to analyse)";
+			ImGui::SetTooltip("Analyser load: %.3f%%\nRendered track: %.1f MiB%s", m_data.spectrum->load() * 100.0f, resident, note);
+		}
+	}
+}
+
+void Jukebox::showSpectrum(bool show) {
+	m_data.flags.assign(Flag::eShowSpectrum, show);
+	if (!show) {
+		// stop the analyser and release the player's copy of the track
+		m_data.spectrum.reset();
+		m_data.samples.reset();
+	} else if (!m_data.spectrum) {
+		m_data.spectrum = std::make_unique<Spectrum>();
+	}
+	m_player->analyse(show);
 }
 
 void Jukebox::trackControls() {
 	static ImVec2 const upDnSize = {25.0f, 25.0f};
-	if (ImGui::ArrowButtonEx("move_down", ImGuiDir_Down, upDnSize)) { m_player.swapAhead(); }
+	auto const& state = m_player->state();
+	if (ImGui::ArrowButtonEx("move_down", ImGuiDir_Down, upDnSize)) { onAction(Controller::Action::eSwapAhead); }
 	ImGui::SameLine();
-	if (ImGui::ArrowButtonEx("move_up", ImGuiDir_Up, upDnSize)) { m_player.swapBehind(); }
+	if (ImGui::ArrowButtonEx("move_up", ImGuiDir_Up, upDnSize)) { onAction(Controller::Action::eSwapBehind); }
 	ImGui::SameLine();
 	if (ImGui::Button("+##push", upDnSize)) { m_data.browser.m_show = !m_data.browser.m_show; }
-	if (!m_player.empty()) {
+	if (state.canUndo) {
 		ImGui::SameLine();
-		if (ImGui::Button("Clear", {0.0f, upDnSize.y})) { m_player.clear(); }
+		if (ImGui::Button("Undo", {0.0f, upDnSize.y})) { onAction(Controller::Action::eUndo); }
+		if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Ctrl+Z"); }
+	}
+	if (state.canRedo) {
+		ImGui::SameLine();
+		if (ImGui::Button("Redo", {0.0f, upDnSize.y})) { onAction(Controller::Action::eRedo); }
+		if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Ctrl+Y / Ctrl+Shift+Z"); }
+	}
+	if (!state.empty()) {
+		ImGui::SameLine();
+		if (ImGui::Button("Clear", {0.0f, upDnSize.y})) { onAction(Controller::Action::eClear); }
 		ImGui::SameLine();
 		if (ImGui::Button("Save", {0.0f, upDnSize.y})) {
 			ImGui::OpenPopup("save_playlist");
-			m_data.flags.reset(Flag::eSaveFailure);
+			m_data.flags.reset(Flag::eSaving);
 		}
 		if (ImGui::BeginPopup("save_playlist")) {
-			if (m_data.flags[Flag::eSaveFailure]) {
-				auto text = ktl::kformat("Save to {} failed!", m_data.savePath);
-				ImGui::Text("%s", text.data());
+			auto const status = m_data.writer->status();
+			if (status == PlaylistWriter::Status::eBusy) {
+				ImGui::Text("Saving...");
 			} else {
+				if (m_data.flags[Flag::eSaving] && status == PlaylistWriter::Status::eFailed) {
+					ImGui::TextColored({1.0f, 0.3f, 0.3f, 1.0f}, "Save to %s failed!", m_data.savePath.data());
+				}
 				ImGui::Text("Path:");
 				ImGui::SameLine();
 				ImGui::InputText("##save_path", m_data.savePath.data(), m_data.savePath.capacity());
-			}
-			if (ImGui::Button("OK")) {
-				Playlist list{{m_player.paths().begin(), m_player.paths().end()}};
-				if (!m_data.flags[Flag::eSaveFailure] && !list.save(m_data.savePath.data())) {
-					m_data.flags.set(Flag::eSaveFailure);
-				} else {
-					ImGui::CloseCurrentPopup();
+				bool ids = m_data.flags[Flag::eSaveLibraryIds];
+				if (ImGui::Checkbox("Library IDs", &ids)) { m_data.flags.assign(Flag::eSaveLibraryIds, ids); }
+				tooltipMarker("Smaller file, only valid with this library");
+				if (ImGui::Button("OK")) {
+					Playlist list{state.tracks->paths()};
+					if (m_data.flags[Flag::eSaveLibraryIds]) { list.library = m_library.get(); }
+					m_data.writer->save(list.snapshot(), m_data.savePath.data());
+					m_data.flags.set(Flag::eSaving);
 				}
 			}
+			// close once the save started from this popup has succeeded
+			if (m_data.flags[Flag::eSaving] && m_data.writer->status() == PlaylistWriter::Status::eSaved) {
+				m_data.flags.reset(Flag::eSaving);
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::EndPopup();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Duplicates", {0.0f, upDnSize.y})) { ImGui::OpenPopup("duplicates"); }
+		if (ImGui::BeginPopup("duplicates")) {
+			duplicates();
 			ImGui::EndPopup();
 		}
 	}
-	if (auto path = m_data.browser(); !path.empty()) { m_player.push(std::move(path), false); }
+	if (auto path = m_data.browser(); !path.empty()) { onAdd(std::move(path)); }
+	ImGui::SameLine();
+	static constexpr char const* modes[] = {"Stream", "Preload", "Auto"};
+	int mode = int(state.mode);
+	ImGui::SetNextItemWidth(90.0f);
+	if (ImGui::Combo("##mode", &mode, modes, int(std::size(modes)))) { onAction(Controller::Action::eMode, float(mode)); }
+	ImGui::SameLine();
+	tooltipMarker("Stream: fast to open, slower to seek\nPreload: fast to seek, slower to open\nAuto: stream, then switch to preloaded once decoded");
+	if (state.mode != Player::Mode::ePreload) {
+		ImGui::SameLine();
+		bool show = m_data.flags[Flag::eShowStream];
+		if (ImGui::Checkbox("Buffer", &show)) { m_data.flags.assign(Flag::eShowStream, show); }
+	}
+	ImGui::SameLine();
+	bool normalize = state.flag(Player::Flag::eNormalize);
+	if (ImGui::Checkbox("Normalize", &normalize)) { onAction(Controller::Action::eNormalize, normalize ? 1.0f : 0.0f); }
+	ImGui::SameLine();
+	bool trim = state.flag(Player::Flag::eTrimSilence);
+	if (ImGui::Checkbox("Trim", &trim)) { onAction(Controller::Action::eTrimSilence, trim ? 1.0f : 0.0f); }
+	ImGui::SameLine();
+	tooltipMarker("Normalize: match loudness across tracks\nTrim: skip leading / trailing silence\nTracks are analysed in the background");
+	ImGui::SameLine();
+	bool spectrum = m_data.flags[Flag::eShowSpectrum];
+	if (ImGui::Checkbox("Spectrum", &spectrum)) { onAction(Controller::Action::eSpectrum, spectrum ? 1.0f : 0.0f); }
+	ImGui::SameLine();
+	ktl::fixed_vector<char const*, Presets::max_v> labels;
+	for (auto const& name : m_data.presets.names) { labels.push_back(name.data()); }
+	int preset = int(m_data.presets.selected);
+	ImGui::SetNextItemWidth(110.0f);
+	if (ImGui::Combo("##eq", &preset, labels.data(), int(labels.size()))) { onAction(Controller::Action::eEqualizer, float(preset)); }
+	ImGui::SameLine();
+	tooltipMarker("Equalizer: applies to in-memory tracks (Preload / Auto)\nPresets are read from jukebox_eq.ini");
+	ImGui::SameLine();
+	bool plays = m_data.flags[Flag::eShowHistory];
+	if (ImGui::Checkbox("History", &plays)) { m_data.flags.assign(Flag::eShowHistory, plays); }
+	if constexpr (alloc::enabled_v) {
+		ImGui::SameLine();
+		bool show = m_data.flags[Flag::eShowAllocations];
+		if (ImGui::Checkbox("Allocs", &show)) { m_data.flags.assign(Flag::eShowAllocations, show); }
+	}
+}
+
+void Jukebox::duplicates() {
+	auto const& dupes = m_data.duplicates;
+	static constexpr char const* modes[] = {"File", "Audio"};
+	int mode = int(dupes.mode);
+	ImGui::SetNextItemWidth(80.0f);
+	if (ImGui::Combo("##dupe_mode", &mode, modes, int(std::size(modes)))) { onAction(Controller::Action::eFindDuplicates, float(mode)); }
 	ImGui::SameLine();
-	bool preload = m_player.mode() == Player::Mode::ePreload;
-	if (ImGui::Checkbox("Preload", &preload)) { m_player.mode(preload ? Player::Mode::ePreload : Player::Mode::eStream); }
+	tooltipMarker("File: identical files\nAudio: identical decoded samples, also matches retagged copies of lossless tracks\nHashes are cached in the library");
 	ImGui::SameLine();
-	tooltipMarker("Faster to seek, slower to open");
+	auto const pending = m_data.hasher ? m_data.hasher->pending() : 0;
+	if (pending > 0) {
+		ImGui::Text("Hashing, %zu left...", pending);
+	} else if (ImGui::Button("Scan")) {
+		onAction(Controller::Action::eFindDuplicates, float(mode));
+	}
+	if (dupes.groups.empty()) {
+		ImGui::TextDisabled("No duplicates found");
+		return;
+	}
+	ImGui::Text("%zu groups, %zu duplicates", dupes.groups.size(), dupes.surplus);
+	if (ImGui::BeginChild("##dupe_groups", {360.0f, 160.0f}, true)) {
+		// groups index the tracklist they were found in
+		auto const& tracks = *dupes.tracks;
+		for (auto const& group : dupes.groups) {
+			ImGui::Text("%s", tracks.filename(group.front()).data());
+			for (std::size_t i = 1; i < group.size(); ++i) { ImGui::TextDisabled("  %s", tracks.filename(group[i]).data()); }
+		}
+	}
+	ImGui::EndChild();
+	if (ImGui::Button(m_data.arena.format("Remove %zu duplicates", dupes.surplus))) { onAction(Controller::Action::eRemoveDuplicates); }
+	ImGui::SameLine();
+	tooltipMarker("Keeps the first of each group");
+}
+
+void Jukebox::playlists() {
+	auto const& state = m_player->state();
+	auto const& lists = state.tracks->lists;
+	auto& tabs = m_data.tabs;
+	static constexpr auto bar_flags = ImGuiTabBarFlags_FittingPolicyScroll | ImGuiTabBarFlags_NoCloseWithMiddleMouseButton;
+	if (!ImGui::BeginTabBar("playlists", bar_flags)) { return; }
+	// ImGui owns which tab is shown: follow the player unless a switch from here is still in flight
+	bool const follow = state.tracks->active != tabs.shown && state.revision != tabs.revision;
+	for (std::size_t i = 0; i < lists.size(); ++i) {
+		auto const& list = lists[i];
+		bool const force = follow && i == state.tracks->active;
+		auto const label = m_data.arena.format("%s%s (%zu)###list%zu", list.rule.empty() ? "" : "* ", list.name.data(), list.tracks.size(), i);
+		if (ImGui::BeginTabItem(label, nullptr, force ? ImGuiTabItemFlags_SetSelected : ImGuiTabItemFlags_None)) {
+			if (i != tabs.shown) {
+				tabs.shown = i;
+				if (!force) {
+					tabs.revision = state.revision;
+					onAction(Controller::Action::eSelectList, float(i));
+				}
+			}
+			ImGui::EndTabItem();
+		}
+		if (ImGui::BeginPopupContextItem()) {
+			if (ImGui::IsWindowAppearing()) {
+				std::snprintf(tabs.name.data(), tabs.name.size(), "%s", list.name.data());
+				std::snprintf(tabs.rule.data(), tabs.rule.size(), "%s", list.rule.data());
+				tabs.invalid = false;
+			}
+			ImGui::SetNextItemWidth(160.0f);
+			if (ImGui::InputText("##name", tabs.name.data(), tabs.name.size(), ImGuiInputTextFlags_EnterReturnsTrue) && tabs.name[0] != '\0') {
+				onRenameList(i, tabs.name.data());
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::SetNextItemWidth(320.0f);
+			// an empty rule makes it a plain playlist again
+			if (ImGui::InputTextWithHint("##rule", "smart: length > 5m and played > 30d", tabs.rule.data(), tabs.rule.size(),
+										 ImGuiInputTextFlags_EnterReturnsTrue)) {
+				tabs.invalid = tabs.rule[0] != '\0' && !SmartRule::parse(tabs.rule.data());
+				if (!tabs.invalid) {
+					onRuleList(i, tabs.rule.data());
+					ImGui::CloseCurrentPopup();
+				}
+			}
+			if (tabs.invalid) { ImGui::TextColored({1.0f, 0.3f, 0.3f, 1.0f}, "Invalid rule"); }
+			if (ImGui::MenuItem("Copy")) { onAction(Controller::Action::eCopyList, float(i)); }
+			if (ImGui::MenuItem(lists.size() > 1 ? "Close" : "Clear")) { onAction(Controller::Action::eCloseList, float(i)); }
+			if (ImGui::MenuItem("Reopen closed", "Ctrl+Shift+T", false, state.canReopen)) { onAction(Controller::Action::eReopenList); }
+			ImGui::EndPopup();
+		}
+	}
+	if (ImGui::TabItemButton("+", ImGuiTabItemFlags_Trailing | ImGuiTabItemFlags_NoTooltip)) { onAction(Controller::Action::eNewList); }
+	ImGui::EndTabBar();
 }
 
 void Jukebox::tracklist() {
 	ImGui::Text("Playlist");
-	tooltipMarker("Drag files / use + to add\nLeft click to play\nRight click to remove");
+	tooltipMarker("Drag files / use + to add\nLeft click to play\nCtrl / Shift click to mark tracks (Ctrl+A: all) for bulk actions\n"
+				  "Right click to remove (every marked track, on a marked one)\nRight click a tab to rename / copy / close it, or give it a smart rule");
+	playlists();
+	markedControls();
 	if (ImGui::BeginChild("Playlist", {ImGui::GetWindowSize().x - 20.0f, 0.0f}, true, ImGuiWindowFlags_HorizontalScrollbar)) {
-		auto const& paths = m_player.paths();
-		std::size_t idx{};
 		std::optional<std::size_t> select;
-		std::optional<std::string_view> pop;
-		for (auto const& path : paths) {
-			auto const file = filename(path, true);
-			bool const selected = idx == m_player.head();
-			if (ImGui::Selectable(file.data(), selected)) { select = idx; }
-			if (!select && ImGui::IsItemClicked(ImGuiMouseButton_Right)) { pop = path; }
-			++idx;
-		}
-		if (select) {
-			m_player.navIndex(*select);
-			if (!m_player.playing()) { m_player.play(); }
+		std::optional<std::size_t> pop;
+		std::optional<std::pair<Controller::Action, std::size_t>> mark;
+		auto const& state = m_player->state();
+		auto const& tracks = *state.tracks;
+		auto const& marks = this->marks();
+		// only the rows in view
+		ImGuiListClipper clipper;
+		clipper.Begin(int(tracks.size()));
+		while (clipper.Step()) {
+			for (auto idx = std::size_t(clipper.DisplayStart); idx < std::size_t(clipper.DisplayEnd); ++idx) {
+				auto const file = tracks.filename(idx);
+				bool const selected = marks.count > 0 ? bool(marks.rows[idx]) : idx == state.head;
+				bool const missing = m_data.session->missingCount() > 0 && m_data.session->missing(tracks.directory(idx), file);
+				if (missing) { ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled)); }
+				if (ImGui::Selectable(file.data(), selected)) {
+					if (ImGui::GetIO().KeyCtrl) {
+						mark = {Controller::Action::eMark, idx};
+					} else if (ImGui::GetIO().KeyShift) {
+						mark = {Controller::Action::eMarkRange, idx};
+					} else {
+						select = idx;
+					}
+				}
+				if (missing) {
+					ImGui::PopStyleColor();
+					if (ImGui::IsItemHovered()) { ImGui::SetTooltip("File not found"); }
+				}
+				if (!select && !mark && ImGui::IsItemClicked(ImGuiMouseButton_Right)) { pop = idx; }
+			}
+		}
+		clipper.End();
+		if (mark) {
+			onAction(mark->first, float(mark->second));
+		} else if (select) {
+			if (marks.count > 0) { onAction(Controller::Action::eMarkAll, 0.0f); }
+			onAction(Controller::Action::eSelect, float(*select));
 		} else if (pop) {
-			m_player.pop(*pop);
+			onAction(marks.rows[*pop] ? Controller::Action::eRemoveMarked : Controller::Action::eRemove, float(*pop));
 		}
 	}
 	ImGui::EndChild();
 }
 
-void Jukebox::playPause() {
-	if (m_player.playing()) {
-		m_player.pause();
-	} else {
-		m_player.play();
+void Jukebox::markedControls() {
+	auto& marks = this->marks();
+	if (marks.count == 0) { return; }
+	ImGui::Text("%zu marked", marks.count);
+	ImGui::SameLine();
+	if (ImGui::Button("Play next")) { onAction(Controller::Action::ePlayNext); }
+	ImGui::SameLine();
+	if (ImGui::Button("Move to")) { onAction(Controller::Action::eMoveMarked, float(marks.moveTo - 1)); }
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(90.0f);
+	if (ImGui::InputInt("##move_to", &marks.moveTo)) { marks.moveTo = std::clamp(marks.moveTo, 1, int(marks.rows.size()) + 1); }
+	ImGui::SameLine();
+	if (ImGui::Button("Dedupe")) { onAction(Controller::Action::eDedupeMarked); }
+	if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Remove repeats of the same file among the marked tracks"); }
+	ImGui::SameLine();
+	if (ImGui::Button("Remove##marked")) { onAction(Controller::Action::eRemoveMarked); }
+	ImGui::SameLine();
+	if (ImGui::Button("Unmark")) { onAction(Controller::Action::eMarkAll, 0.0f); }
+}
+
+void Jukebox::allocations() {
+	bool show = true;
+	ImGui::SetNextWindowSize({320.0f, 0.0f}, ImGuiCond_Once);
+	if (ImGui::Begin("Allocations", &show)) {
+		auto const& allocs = m_data.allocs;
+		ImGui::Text("Last frame: %llu allocs, %llu bytes", (unsigned long long)allocs.frame.count, (unsigned long long)allocs.frame.bytes);
+		ImGui::Text("Frame arena: %zu / %zu bytes", m_data.arena.used(), m_data.arena.capacity());
+		ImGui::Text("Quiet frames: %zu", allocs.quietFrames);
+		ImGui::Separator();
+		for (std::size_t i = 0; i < allocs.rate.size(); ++i) {
+			auto const name = alloc::tag_names_v[i].data();
+			auto const& rate = allocs.rate[i];
+			ImGui::Text("%-6s %8llu /s %10llu B/s", name, (unsigned long long)rate.count, (unsigned long long)rate.bytes);
+		}
 	}
+	ImGui::End();
+	m_data.flags.assign(Flag::eShowAllocations, show);
 }
 
-void Jukebox::next() {
-	if (m_player.isLastTrack()) {
-		m_player.navFirst();
-	} else {
-		m_player.navNext();
+void Jukebox::stream() {
+	bool show = true;
+	ImGui::SetNextWindowSize({320.0f, 0.0f}, ImGuiCond_Once);
+	if (ImGui::Begin("Stream buffer", &show)) {
+		auto const& state = m_player->state();
+		auto const& stats = state.stream;
+		auto const& config = state.streamConfig;
+		auto const kib = [](std::uint64_t bytes) { return (unsigned long long)(bytes / 1024); };
+		if (!stats.active) {
+			ImGui::TextDisabled("%s", state.preloaded ? "Track is in memory" : "Idle");
+		} else {
+			auto const target = std::min(stats.size - std::min(stats.position, stats.size), std::uint64_t(stats.depth * config.chunk));
+			auto const fill = target > 0 ? float(double(stats.ahead) / double(target)) : 1.0f;
+			ImGui::ProgressBar(std::min(fill, 1.0f), {-1.0f, 0.0f}, m_data.arena.format("%llu / %llu KiB ahead", kib(stats.ahead), kib(target)));
+			ImGui::Text("Position: %llu / %llu KiB", kib(stats.position), kib(stats.size));
+		}
+		ImGui::Text("Depth: %zu x %zu KiB (%zu - %zu)%s", stats.depth, config.chunk / 1024, config.minDepth, config.maxDepth, config.adaptive ? ", adaptive" : "");
+		ImGui::Text("Chunk read: %.2f ms (plays for %.0f ms), %.1f MiB/s", stats.readMs, stats.playMs, stats.mibPerSecond);
+		ImGui::Text("Underruns: %llu (grown %llu, shrunk %llu)", (unsigned long long)stats.underruns, (unsigned long long)stats.grown,
+					(unsigned long long)stats.shrunk);
 	}
+	ImGui::End();
+	m_data.flags.assign(Flag::eShowStream, show);
 }
 
-void Jukebox::prev() {
-	if (m_player.isFirstTrack() || m_player.music().position() > 2s) {
-		m_player.seek({});
-	} else {
-		m_player.navPrev();
+void Jukebox::history() {
+	bool show = true;
+	ImGui::SetNextWindowSize({360.0f, 0.0f}, ImGuiCond_Once);
+	if (ImGui::Begin("History", &show)) {
+		auto const& history = *m_data.history;
+		auto& plays = m_data.plays;
+		auto const now = History::now();
+		if (auto const day = now / History::day_v; plays.revision != history.records() || plays.day != day || plays.days.empty()) {
+			plays.top.clear();
+			for (auto const& entry : history.top(Plays::top_v)) { plays.top.emplace_back(entry.path, entry.stats); }
+			auto const days = history.playsPerDay(Plays::days_v, now);
+			plays.days.assign(days.begin(), days.end());
+			plays.peak = days.empty() ? 0 : *std::max_element(days.begin(), days.end());
+			plays.revision = history.records();
+			plays.day = day;
+		}
+		auto const& total = history.total();
+		ImGui::Text("%u plays of %zu tracks, %.1f h listened", total.plays, history.tracks(), float(total.seconds) / 3600.0f);
+		ImGui::Text("Skip rate: %.0f%% (%u skipped, %u completed)", History::skipRate(total) * 100.0f, total.skips, total.completes);
+		ImGui::PlotHistogram("##days", plays.days.data(), int(plays.days.size()), 0, m_data.arena.format("Plays per day (last %zu)", Plays::days_v), 0.0f,
+							 float(std::max(plays.peak, 1U)), {-1.0f, 60.0f});
+		ImGui::Separator();
+		if (plays.top.empty()) { ImGui::TextDisabled("Nothing played yet"); }
+		for (auto const& [path, stats] : plays.top) {
+			auto const ago = (now - stats.last) / History::day_v;
+			ImGui::Text("%4u", stats.plays);
+			ImGui::SameLine();
+			ImGui::TextDisabled("%3.0f%% skip, %lldd ago", History::skipRate(stats) * 100.0f, (long long)ago);
+			ImGui::SameLine();
+			auto const name = filename(path, false);
+			ImGui::Text("%.*s", int(name.size()), name.data());
+			if (ImGui::IsItemHovered()) { ImGui::SetTooltip("%s", path.data()); }
+		}
 	}
+	ImGui::End();
+	m_data.flags.assign(Flag::eShowHistory, show);
 }
 
-void Jukebox::seek(capo::Time delta) {
-	auto const remain = m_player.music().meta().length() - m_player.music().position();
-	if (delta >= remain) {
-		if (m_player.isLastTrack()) {
-			m_player.stop();
-		} else {
-			next();
+void Jukebox::dispatch(Controller::Response const& response) {
+	using Action = Controller::Action;
+	bool const on = response.value != 0.0f;
+	auto& player = *m_player;
+	auto const& state = player.state();
+	switch (response.action) {
+	case Action::ePlayPause: player.playPause(); break;
+	case Action::eStop: player.stop(); break;
+	case Action::eMute: player.muteUnmute(); break;
+	case Action::eNext: player.next(); break;
+	case Action::ePrev: player.prev(); break;
+	case Action::eSeek: player.seek(capo::Time(response.value)); break;
+	case Action::eVolume: player.volume(response.value); break;
+	case Action::eSeekTo: player.seekTo(capo::Time(response.value)); break;
+	case Action::eGain: player.gain(response.value); break;
+	case Action::eSelect:
+		player.select(std::size_t(response.value), state.revision);
+		m_data.marks.anchor = std::size_t(response.value);
+		break;
+	case Action::eRemove: player.edit({.removed = {std::size_t(response.value)}}, state.revision); break;
+	case Action::eSwapAhead: player.swapAhead(); break;
+	case Action::eSwapBehind: player.swapBehind(); break;
+	case Action::eClear: player.clear(); break;
+	case Action::eUndo: player.undo(); break;
+	case Action::eRedo: player.redo(); break;
+	case Action::eMode: player.mode(Player::Mode(std::clamp(int(response.value), 0, 2))); break;
+	case Action::eNormalize:
+	case Action::eTrimSilence:
+		player.flag(response.action == Action::eNormalize ? Player::Flag::eNormalize : Player::Flag::eTrimSilence, on);
+		// state catches up next tick
+		if (on) { scan(state.tracks->paths(), true); }
+		break;
+	case Action::eSpectrum: showSpectrum(on); break;
+	case Action::eEqualizer:
+		m_data.presets.selected = std::min(std::size_t(response.value), m_data.presets.presets.size() - 1);
+		player.equalizer(m_data.presets.presets[m_data.presets.selected]);
+		break;
+	case Action::eFindDuplicates: findDuplicates(DuplicateScanner::Mode(std::clamp(int(response.value), 0, 1))); break;
+	case Action::eRemoveDuplicates: removeDuplicates(); break;
+	case Action::eNewList: player.newList(ktl::kformat("{} {}", Player::default_list_v, state.tracks->lists.size() + 1)); break;
+	case Action::eCopyList:
+		if (auto const index = std::size_t(response.value); index < state.tracks->lists.size()) {
+			player.copyList(index, ktl::kformat("{} (copy)", state.tracks->lists[index].name), state.revision);
+		}
+		break;
+	case Action::eCloseList: player.closeList(std::size_t(response.value), state.revision); break;
+	case Action::eReopenList: player.reopenList(); break;
+	case Action::eSelectList: player.selectList(std::size_t(response.value), state.revision); break;
+	case Action::eMark:
+	case Action::eMarkRange:
+	case Action::eMarkAll: mark(response.action, std::size_t(response.value)); break;
+	case Action::eMoveMarked: player.move(marked(), std::size_t(response.value), state.revision); break;
+	case Action::ePlayNext: player.playNext(marked(), state.revision); break;
+	case Action::eDedupeMarked: player.dedupe(marked(), state.revision); break;
+	case Action::eRemoveMarked: player.edit({.removed = marked()}, state.revision); break;
+	case Action::eQuit:
+	case Action::eNone: break;
+	}
+}
+
+void Jukebox::add(std::span<std::string const> paths, bool autoplay) {
+	std::vector<std::string> expanded;
+	expand(paths, m_library.get(), expanded);
+	if (expanded.empty()) { return; }
+	// queued first, so unchanged files are not probed again
+	known(expanded);
+	m_player->add(std::move(expanded), autoplay);
+}
+
+void Jukebox::known(std::span<std::string const> paths) {
+	std::vector<std::string> knownPaths;
+	std::vector<Library::Meta> metas;
+	for (auto const& path : paths) {
+		if (auto const entry = m_library->entry(m_library->find(path))) {
+			knownPaths.push_back(path);
+			metas.push_back(entry->meta);
 		}
 	}
-	m_player.seek(m_player.music().position() + delta);
+	m_player->known(std::move(knownPaths), std::move(metas));
+}
+
+void Jukebox::scan(std::span<std::string const> paths, bool force) {
+	auto const& state = m_player->state();
+	if (!force && !state.flag(Player::Flag::eNormalize) && !state.flag(Player::Flag::eTrimSilence)) { return; }
+	std::size_t queued{};
+	for (auto const& path : paths) {
+		auto const entry = m_library->entry(m_library->find(path));
+		if (entry && !entry->meta.loudness.measured() && m_data.scanner->push(path)) { ++queued; }
+	}
+	if (queued > 0) { Log::info("[Jukebox] Analysing loudness of {} tracks", queued); }
 }
 
-void Jukebox::muteUnmute() {
-	if (m_player.muted()) {
-		m_player.unmute();
-	} else {
-		m_player.mute();
+void Jukebox::updateAdded() {
+	auto added = m_player->added();
+	if (added.empty()) { return; }
+	std::vector<std::string> paths;
+	paths.reserve(added.size());
+	for (auto& [path, meta] : added) {
+		if (meta) { m_library->upsert(path, *meta); }
+		paths.push_back(std::move(path));
+	}
+	scan(paths);
+}
+
+void Jukebox::updateHistory() {
+	for (auto const& event : m_player->events()) {
+		auto type = History::Type::ePlay;
+		switch (event.type) {
+		case Player::Event::Type::ePlay: type = History::Type::ePlay; break;
+		case Player::Event::Type::eSkip: type = History::Type::eSkip; break;
+		case Player::Event::Type::eComplete: type = History::Type::eComplete; break;
+		}
+		m_data.history->record(type, event.path, event.seconds);
+		m_data.smart.played.push_back(event.path);
+	}
+}
+
+void Jukebox::updateSmart() {
+	auto const& state = m_player->state();
+	auto& smart = m_data.smart;
+	auto const& lists = state.tracks->lists;
+	if (smart.revision != state.revision) {
+		smart.revision = state.revision;
+		smart.rules.clear();
+		for (auto const& list : lists) {
+			if (list.rule.empty() || std::find(smart.rules.begin(), smart.rules.end(), list.rule) != smart.rules.end()) { continue; }
+			smart.rules.push_back(list.rule);
+		}
+	}
+	auto results = smart.lists.update(smart.rules, *m_library, m_data.history.get(), smart.played);
+	smart.played.clear();
+	for (auto& result : results) {
+		for (std::size_t i = 0; i < lists.size(); ++i) {
+			if (lists[i].rule == result.rule) { m_player->fill(i, result.rule, result.paths); }
+		}
+	}
+}
+
+Jukebox::Marks& Jukebox::marks() {
+	auto const& state = m_player->state();
+	auto& marks = m_data.marks;
+	if (marks.revision != state.revision || marks.rows.size() != state.size()) {
+		marks.rows.assign(state.size(), false);
+		marks.count = 0;
+		marks.revision = state.revision;
+	}
+	return marks;
+}
+
+void Jukebox::mark(Controller::Action action, std::size_t index) {
+	auto& marks = this->marks();
+	auto& rows = marks.rows;
+	switch (action) {
+	case Controller::Action::eMark:
+		if (index >= rows.size()) { break; }
+		rows[index] = !rows[index];
+		marks.count = rows[index] ? marks.count + 1 : marks.count - 1;
+		marks.anchor = index;
+		break;
+	case Controller::Action::eMarkRange:
+		if (index >= rows.size()) { break; }
+		for (auto i = std::min(index, marks.anchor); i <= std::max(index, marks.anchor) && i < rows.size(); ++i) {
+			if (!rows[i]) {
+				rows[i] = true;
+				++marks.count;
+			}
+		}
+		break;
+	case Controller::Action::eMarkAll:
+		rows.assign(rows.size(), index != 0);
+		marks.count = index != 0 ? rows.size() : 0;
+		break;
+	default: break;
+	}
+}
+
+std::vector<std::size_t> Jukebox::marked() {
+	auto const& marks = this->marks();
+	std::vector<std::size_t> ret;
+	ret.reserve(marks.count);
+	for (std::size_t i = 0; i < marks.rows.size() && ret.size() < marks.count; ++i) {
+		if (marks.rows[i]) { ret.push_back(i); }
+	}
+	return ret;
+}
+
+void Jukebox::updateLoudness() {
+	for (auto& result : m_data.scanner->results()) {
+		if (!result.loudness.measured()) { continue; }
+		auto entry = m_library->entry(m_library->find(result.path));
+		if (!entry) { continue; }
+		auto meta = entry->meta;
+		meta.loudness = result.loudness;
+		m_library->upsert(result.path, meta);
+		m_player->known({result.path}, {meta});
+	}
+}
+
+void Jukebox::findDuplicates(DuplicateScanner::Mode mode) {
+	if (!m_data.hasher) { m_data.hasher = std::make_unique<DuplicateScanner>(); }
+	m_data.duplicates.mode = mode;
+	m_data.duplicates.dirty = true;
+	std::size_t queued{}, cached{};
+	for (auto& path : m_player->state().tracks->paths()) {
+		auto const entry = m_library->entry(m_library->find(path));
+		if (entry && DuplicateScanner::hash(entry->meta.fingerprint, mode) != 0) {
+			++cached;
+		} else if (m_data.hasher->push(std::move(path), mode)) {
+			++queued;
+		}
+	}
+	Log::info("[Jukebox] Hashing {} tracks on {} threads ({} cached)", queued, m_data.hasher->threads(), cached);
+}
+
+void Jukebox::removeDuplicates() {
+	auto const& state = m_player->state();
+	auto const groups = DuplicateScanner::group(*m_library, state.tracks->paths(), m_data.duplicates.mode);
+	PlayerThread::Edit edit;
+	for (auto const& group : groups) { edit.removed.insert(edit.removed.end(), group.begin() + 1, group.end()); }
+	m_player->edit(std::move(edit), state.revision);
+	// gone with the edit (or stale if it's dropped): Scan regroups
+	m_data.duplicates.groups.clear();
+	m_data.duplicates.surplus = 0;
+}
+
+void Jukebox::updateDuplicates() {
+	if (!m_data.hasher) { return; }
+	auto& dupes = m_data.duplicates;
+	for (auto& result : m_data.hasher->results()) {
+		if (result.hash == 0) { continue; }
+		auto const entry = m_library->entry(m_library->find(result.path));
+		// restored tracks may not have been probed into the library yet
+		auto meta = entry ? std::optional(entry->meta) : Library::Meta::stat(result.path);
+		if (!meta) { continue; }
+		(result.mode == DuplicateScanner::Mode::eFile ? meta->fingerprint.file : meta->fingerprint.audio) = result.hash;
+		m_library->upsert(result.path, *meta);
+		dupes.dirty = true;
+	}
+	// regroup when a scan finishes, not on every tracklist change: Scan again to pick up edits
+	if (!dupes.dirty || m_data.hasher->pending() > 0) { return; }
+	auto const& state = m_player->state();
+	dupes.groups = DuplicateScanner::group(*m_library, state.tracks->paths(), dupes.mode);
+	dupes.surplus = 0;
+	for (auto const& group : dupes.groups) { dupes.surplus += group.size() - 1; }
+	dupes.tracks = state.tracks;
+	dupes.dirty = false;
+}
+
+void Jukebox::updateWatch() {
+	if (!m_data.watch) { return; }
+	auto batch = m_data.watch->take();
+	if (batch.empty()) { return; }
+	Log::info("[Jukebox] Watched folders: {} added, {} removed, {} renamed", batch.added.size(), batch.removed.size() + batch.removedDirs.size(),
+			  batch.renamed.size());
+	auto paths = batch.added;
+	for (auto const& [_, to] : batch.renamed) { paths.push_back(to); }
+	known(paths);
+	// resolved by path on the player thread, against the tracklist as it is by then
+	m_player->watched(
+		{.added = std::move(batch.added), .removed = std::move(batch.removed), .removedDirs = std::move(batch.removedDirs), .renamed = std::move(batch.renamed)});
+}
+
+void Jukebox::loadPresets(std::string const& path) {
+	Props props;
+	if (props.load(path.data()) == 0) {
+		for (auto const& [name, bands] : builtin_presets_v) { props.add(true, std::string(name), bands); }
+		if (props.save(path.data())) { Log::info("[Jukebox] Wrote default equalizer presets to [{}]", path); }
+	}
+	std::vector<std::pair<std::string, Equalizer::Preset>> sorted;
+	for (auto const& [name, _] : props) {
+		auto const preset = props.get<Equalizer::Preset>(name);
+		if (preset.count == 0) {
+			Log::warn("[Jukebox] Invalid equalizer preset [{}]", name);
+			continue;
+		}
+		sorted.emplace_back(name, preset);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+	if (sorted.size() >= Presets::max_v) { sorted.resize(Presets::max_v - 1); }
+	m_data.presets.names = {"Off"};
+	m_data.presets.presets = {Equalizer::Preset{}};
+	for (auto& [name, preset] : sorted) {
+		m_data.presets.names.push_back(std::move(name));
+		m_data.presets.presets.push_back(preset);
 	}
 }
 
 void Jukebox::loadConfig() {
 	m_data.config.path = "jukebox_config.ini";
 	if (m_data.config.props.load(m_data.config.path.data())) {
-		m_player.gain(float(m_data.config.props.get<int>("volume", 100)) / 100.0f);
+		m_player->gain(float(m_data.config.props.get<int>("volume", 100)) / 100.0f);
+		showSpectrum(m_data.config.props.get<int>("spectrum", 0) != 0);
+		m_player->mode(Player::Mode(std::clamp(m_data.config.props.get<int>("mode", 0), 0, 2)));
+		m_player->preloadLimit(std::size_t(m_data.config.props.get<int>("preload_limit_mb", 512)) * 1024U * 1024U);
+		auto const cueLeadMs = m_data.config.props.get<int>("cue_lead_ms", int(Player::cue_lead_v.count() * 1000.0f));
+		m_player->cueLead(capo::Time(float(std::max(cueLeadMs, 0)) / 1000.0f));
+		m_player->flag(Player::Flag::eNormalize, m_data.config.props.get<int>("normalize", 0) != 0);
+		m_player->flag(Player::Flag::eTrimSilence, m_data.config.props.get<int>("trim_silence", 0) != 0);
+		TrackSource::input(m_data.config.props.get<int>("mapped_input", 1) != 0 ? TrackSource::Input::eMapped : TrackSource::Input::eBuffered);
+		auto stream = m_player->state().streamConfig;
+		stream.chunk = std::size_t(m_data.config.props.get<int>("stream_chunk_kb", int(stream.chunk / 1024))) * 1024U;
+		stream.depth = std::size_t(m_data.config.props.get<int>("stream_depth", int(stream.depth)));
+		stream.minDepth = std::size_t(m_data.config.props.get<int>("stream_depth_min", int(stream.minDepth)));
+		stream.maxDepth = std::size_t(m_data.config.props.get<int>("stream_depth_max", int(stream.maxDepth)));
+		stream.adaptive = m_data.config.props.get<int>("stream_adaptive", stream.adaptive ? 1 : 0) != 0;
+		m_player->stream(stream);
+		auto const preset = m_data.config.props.get<std::string>("eq_preset");
+		if (auto it = std::find(m_data.presets.names.begin(), m_data.presets.names.end(), preset); it != m_data.presets.names.end()) {
+			m_data.presets.selected = std::size_t(it - m_data.presets.names.begin());
+			m_player->equalizer(m_data.presets.presets[m_data.presets.selected]);
+		}
+		if (auto const folders = m_data.config.props.get<std::string>("watch_folders"); !folders.empty()) {
+			std::vector<std::string> roots;
+			for (std::string_view str = folders; !str.empty();) {
+				auto const sep = str.find('|');
+				if (auto const root = str.substr(0, sep); !root.empty()) { roots.emplace_back(root); }
+				str = sep == std::string_view::npos ? std::string_view() : str.substr(sep + 1);
+			}
+			if (!roots.empty()) { m_data.watch = std::make_unique<FolderWatch>(std::move(roots)); }
+		}
 		if (m_data.config.props.contains("window_size")) {
 			auto const size = m_data.config.props.get<dibs::uvec2>("window_size");
 			glfwSetWindowSize(m_window, int(size.x), int(size.y));
@@ -410,9 +1166,108 @@ void Jukebox::loadConfig() {
 }
 
 void Jukebox::updateConfig() {
-	m_data.config.props.add(true, "volume", int(m_player.gain() * 100.0f));
-	m_data.config.props.add(true, "window_size", windowSize(m_window));
-	m_data.config.props.add(true, "window_pos", windowPos(m_window));
+	auto const size = windowSize(m_window);
+	auto const pos = windowPos(m_window);
+	auto const& state = m_player->state();
+	Settings const settings{
+		.volume = int(state.gain * 100.0f),
+		.mode = int(state.mode),
+		.preloadLimitMB = int(state.preloadLimit / (1024U * 1024U)),
+		.spectrum = m_data.flags[Flag::eShowSpectrum],
+		.normalize = state.flag(Player::Flag::eNormalize),
+		.trimSilence = state.flag(Player::Flag::eTrimSilence),
+		.mappedInput = TrackSource::input() == TrackSource::Input::eMapped,
+		.preset = m_data.presets.selected,
+		.window = {int(size.x), int(size.y), pos.x, pos.y},
+	};
+	// Props formats through a stringstream: only write what changed
+	if (settings == m_data.settings) { return; }
+	m_data.settings = settings;
+	m_data.config.props.add(true, "volume", settings.volume);
+	m_data.config.props.add(true, "spectrum", settings.spectrum ? 1 : 0);
+	m_data.config.props.add(true, "mode", settings.mode);
+	m_data.config.props.add(true, "preload_limit_mb", settings.preloadLimitMB);
+	m_data.config.props.add(true, "normalize", settings.normalize ? 1 : 0);
+	m_data.config.props.add(true, "trim_silence", settings.trimSilence ? 1 : 0);
+	m_data.config.props.add(true, "mapped_input", settings.mappedInput ? 1 : 0);
+	m_data.config.props.add(true, "eq_preset", m_data.presets.names[settings.preset]);
+	m_data.config.props.add(true, "window_size", size);
+	m_data.config.props.add(true, "window_pos", pos);
+}
+
+void Jukebox::restoreSession() {
+	auto playlists = m_data.session->load();
+	if (playlists.tracks.empty() && playlists.sections.size() < 2) { return; }
+	auto const active = std::size_t(std::max(m_data.config.props.get<int>("session_list", 0), 0));
+	auto const head = std::size_t(std::max(m_data.config.props.get<int>("session_head", 0), 0));
+	auto const position = capo::Time(float(std::max(m_data.config.props.get<int>("session_position_ms", 0), 0)) / 1000.0f);
+	auto tracks = playlists.tracks;
+	known(tracks);
+	m_player->restore(std::move(playlists), active, head, position);
+	// restoring is the fresh player's first change to its tracklist: nothing new to save
+	m_data.sessionRevision = m_player->state().revision + 1;
+	scan(tracks);
+	m_data.session->validate(std::move(tracks));
+}
+
+void Jukebox::updateSession() {
+	m_data.session->update();
+	auto const& state = m_player->state();
+	if (state.revision != m_data.sessionRevision) {
+		m_data.session->snapshot(state.tracks);
+		m_data.sessionRevision = state.revision;
+	}
+}
+
+void Jukebox::endFrame(alloc::Counter const& frame, bool input) {
+	if constexpr (alloc::enabled_v) {
+		auto& allocs = m_data.allocs;
+		allocs.frame = frame;
+		allocs.elapsed += ImGui::GetIO().DeltaTime;
+		if (allocs.elapsed >= 1.0f) {
+			auto const total = alloc::global();
+			for (std::size_t i = 0; i < total.size(); ++i) { allocs.rate[i] = total[i] - allocs.total[i]; }
+			allocs.total = total;
+			allocs.elapsed = 0.0f;
+		}
+	}
+	steady(frame, input);
+}
+
+void Jukebox::steady(alloc::Counter const& frame, bool input) {
+	if constexpr (alloc::enabled_v) {
+		auto& allocs = m_data.allocs;
+		auto const& state = m_player->state();
+		bool const quiet = !input && state.playing() && state.head == allocs.head && state.revision == allocs.revision;
+		if (!quiet) {
+			if (state.head != allocs.head || state.revision != allocs.revision) { allocs.reported = false; }
+			allocs.quietFrames = 0;
+			allocs.head = state.head;
+			allocs.revision = state.revision;
+			return;
+		}
+		static constexpr std::size_t warmup_v = 120;
+		if (++allocs.quietFrames <= warmup_v) { return; }
+		++allocs.steady.frames;
+		allocs.steady.allocs.count += frame.count;
+		allocs.steady.allocs.bytes += frame.bytes;
+		if (frame.count > 0 && !allocs.reported) {
+			Log::warn("[Jukebox] Steady state frame allocated {} times ({} bytes)", frame.count, frame.bytes);
+			allocs.reported = true;
+		}
+	}
+}
+
+Jukebox::~Jukebox() {
+	// moved-from
+	if (!m_data.session) { return; }
+	// the latest snapshot: the player thread is stopped after this
+	m_player->sync();
+	updateHistory();
+	auto const& state = m_player->state();
+	m_data.config.props.add(true, "session_list", int(state.tracks->active));
+	m_data.config.props.add(true, "session_head", int(state.head));
+	m_data.config.props.add(true, "session_position_ms", int(state.position.count() * 1000.0f));
 }
 
 Jukebox::Config::~Config() {
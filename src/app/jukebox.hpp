@@ -1,11 +1,24 @@
 #pragma once
 #include <app/controller.hpp>
-#include <app/player.hpp>
+#include <app/duplicates.hpp>
+#include <app/folder_watch.hpp>
+#include <app/history.hpp>
+#include <app/input_log.hpp>
+#include <app/library.hpp>
+#include <app/player_thread.hpp>
+#include <app/playlist.hpp>
 #include <app/props.hpp>
+#include <app/session.hpp>
+#include <app/smart_lists.hpp>
+#include <app/spectrum.hpp>
+#include <app/waveform.hpp>
 #include <dibs/event.hpp>
 #include <ktl/delegate.hpp>
 #include <ktl/enum_flags/enum_flags.hpp>
 #include <ktl/fixed_vector.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/frame_arena.hpp>
+#include <array>
 #include <memory>
 #include <optional>
 
@@ -29,6 +42,8 @@ class FileBrowser {
 
 	std::string operator()();
 
+	// Files already in the library are listed by id, with their length from it
+	Library const* m_library{};
 	bool m_show{};
 
   private:
@@ -41,15 +56,36 @@ class Jukebox {
   public:
 	enum class Status { eRun, eQuit };
 
+	// Steady state: playing the same track with no input; such frames should not touch the heap
+	struct Steady {
+		// past the warm up
+		std::size_t frames{};
+		// allocations on the calling thread during those frames (with alloc::enabled_v)
+		alloc::Counter allocs{};
+	};
+
 	static std::optional<Jukebox> make(ktl::not_null<GLFWwindow*> window);
+	// No window or UI, and a scratch library / cache / session: for replaying input logs
+	static std::optional<Jukebox> headless();
+
+	Jukebox(Jukebox&&) = default;
+	Jukebox& operator=(Jukebox&&) = default;
+	~Jukebox();
 
 	void onKey(dibs::Event::Key const& key);
 	void onFileDrop(std::span<std::string const> paths);
+	void onAdd(std::string path);
+	void onAction(Controller::Action action, float value = {});
+	void onRenameList(std::size_t index, std::string name);
+	void onRuleList(std::size_t index, std::string rule);
+
+	bool record(std::string path);
 
 	void update();
+	Steady const& steady() const noexcept { return m_data.allocs.steady; }
 
   private:
-	enum class Flag { eSaveFailure, eShowImGuiDemo };
+	enum class Flag { eSaving, eSaveLibraryIds, eShowSpectrum, eShowAllocations, eShowStream, eShowHistory, eShowImGuiDemo };
 	using Flags = ktl::enum_flags<Flag>;
 
 	struct Config {
@@ -62,33 +98,164 @@ class Jukebox {
 		~Config();
 	};
 
-	Jukebox(ktl::not_null<GLFWwindow*> window, std::unique_ptr<capo::Instance>&& capo);
+	// Persisted settings, compared against the previous frame so config is only touched on change
+	struct Settings {
+		int volume{};
+		int mode{};
+		int preloadLimitMB{};
+		bool spectrum{};
+		bool normalize{};
+		bool trimSilence{};
+		bool mappedInput{};
+		std::size_t preset{};
+		std::array<int, 4> window{};
+
+		bool operator==(Settings const&) const = default;
+	};
+
+	struct Presets {
+		static constexpr std::size_t max_v = 16;
+
+		// [0] is "Off" (flat)
+		std::vector<std::string> names;
+		std::vector<Equalizer::Preset> presets;
+		std::size_t selected{};
+	};
+
+	struct Duplicates {
+		std::vector<DuplicateScanner::Group> groups;
+		std::shared_ptr<Player::Tracklist const> tracks;
+		std::size_t surplus{}; // tracks removed by eRemoveDuplicates
+		DuplicateScanner::Mode mode{};
+		bool dirty{}; // regroup once the scan in flight is done
+	};
+
+	struct Tabs {
+		std::array<char, 64> name{};
+		std::array<char, 256> rule{};
+		bool invalid{}; // rule failed to parse
+		std::size_t shown{};	   // the playlist ImGui is showing
+		std::uint64_t revision{}; // when shown was last picked from here
+	};
+
+	// Tracklist rows marked with ctrl / shift click for the bulk actions; dropped once the tracklist moves on from revision
+	struct Marks {
+		std::vector<bool> rows{};
+		std::size_t count{};
+		std::size_t anchor{}; // shift click marks from here
+		std::uint64_t revision{};
+		int moveTo{1}; // 1 based, as shown
+	};
+
+	// Rules in use are gathered when the tracklist changes, not every frame; matches go back through PlayerThread::fill
+	struct Smart {
+		SmartLists lists;
+		std::vector<std::string> rules;
+		std::vector<std::string> played; // since the last update
+		std::uint64_t revision{~std::uint64_t{}};
+	};
+
+	// Rebuilt when the history changes (or the day rolls over), not every frame
+	struct Plays {
+		static constexpr std::size_t days_v = 30;
+		static constexpr std::size_t top_v = 10;
+
+		std::vector<std::pair<std::string, History::Stats>> top;
+		std::vector<float> days;
+		std::uint64_t revision{};
+		std::int64_t day{};
+		std::uint32_t peak{};
+	};
+
+	struct Allocations {
+		alloc::Counter frame;
+		alloc::Stats total{};
+		alloc::Stats rate{};
+		float elapsed{};
+		std::size_t quietFrames{};
+		std::size_t head{};
+		std::uint64_t revision{};
+		Steady steady{};
+		bool reported{};
+	};
+
+	Jukebox(GLFWwindow* window, std::unique_ptr<capo::Instance>&& capo, std::unique_ptr<Library>&& library);
 
 	void mainControls();
 	void seekBar();
+	void visualiser();
+	void showSpectrum(bool show);
 	void trackControls();
+	void duplicates();
+	void playlists();
 	void tracklist();
+	void markedControls();
+	void allocations();
+	void stream();
+	void history();
+
+	void dispatch(Controller::Response const& response);
+	void add(std::span<std::string const> paths, bool autoplay);
+	void known(std::span<std::string const> paths);
 
-	void playPause();
-	void next();
-	void prev();
-	void seek(capo::Time stamp);
-	void muteUnmute();
+	// force: analyse even if neither normalize nor trim is on (yet)
+	void scan(std::span<std::string const> paths, bool force = false);
+	void updateAdded();
+	void updateHistory();
+	void updateSmart();
+	// Resets the marks if the tracklist has changed since they were made
+	Marks& marks();
+	void mark(Controller::Action action, std::size_t index);
+	std::vector<std::size_t> marked();
+	void updateLoudness();
+	void findDuplicates(DuplicateScanner::Mode mode);
+	void removeDuplicates();
+	void updateDuplicates();
+	void updateWatch();
 
+	void loadPresets(std::string const& path);
 	void loadConfig();
 	void updateConfig();
+	void restoreSession();
+	void updateSession();
+	void endFrame(alloc::Counter const& frame, bool input);
+	void steady(alloc::Counter const& frame, bool input);
 
 	// Ordered members
 	std::unique_ptr<capo::Instance> m_capo;
-	ktl::not_null<GLFWwindow*> m_window;
-	Player m_player;
+	std::unique_ptr<Library> m_library;
+	// null if headless
+	GLFWwindow* m_window{};
+	std::unique_ptr<PlayerThread> m_player;
 	Controller m_controller;
 
 	struct {
 		std::string savePath = "jukebox_playlist.txt";
 		Config config;
+		Settings settings;
+		Presets presets;
+		FrameArena arena;
+		Allocations allocs;
+		Duplicates duplicates;
+		Plays plays;
+		Tabs tabs;
+		Marks marks;
+		Smart smart;
 		FileBrowser browser;
 		LazySliderFloat seek;
+		std::unique_ptr<Waveform> waveform;
+		// only while shown: the analyser runs a thread at display rate
+		std::unique_ptr<Spectrum> spectrum;
+		std::unique_ptr<LoudnessScanner> scanner;
+		// created on first use: spawns a thread per core
+		std::unique_ptr<DuplicateScanner> hasher;
+		std::unique_ptr<FolderWatch> watch;
+		std::unique_ptr<Session> session;
+		std::unique_ptr<History> history;
+		std::unique_ptr<PlaylistWriter> writer;
+		std::unique_ptr<InputRecorder> recorder;
+		std::uint64_t sessionRevision{};
+		std::shared_ptr<SampleStore const> samples;
 		Flags flags;
 	} m_data;
 };
@@ -0,0 +1,459 @@
+#include <app/library.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+namespace {
+constexpr char magic_v[8] = {'j', 'k', 'l', 'i', 'b', 'r', 'a', 'r'};
+constexpr char log_magic_v[8] = {'j', 'k', 'l', 'i', 'b', 'l', 'o', 'g'};
+constexpr std::uint32_t format_version_v = 3;
+constexpr std::uint32_t byte_order_v = 0x01020304;
+constexpr std::string_view temp_v = ".tmp";
+
+struct Header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+	std::uint32_t count;
+	std::uint32_t slots;
+	std::uint64_t blobSize;
+};
+
+static_assert(std::is_trivially_copyable_v<Loudness> && sizeof(Loudness) % sizeof(float) == 0);
+static_assert(std::is_trivially_copyable_v<Library::Fingerprint> && sizeof(Library::Fingerprint) % 8 == 0);
+
+// Byte offsets of each column, every column starts 8-byte aligned
+struct Layout {
+	std::size_t offsets{};
+	std::size_t lengths{};
+	std::size_t mtimes{};
+	std::size_t sizes{};
+	std::size_t loudness{};
+	std::size_t fingerprints{};
+	std::size_t index{};
+	std::size_t blob{};
+	std::size_t total{};
+
+	static constexpr std::size_t align(std::size_t size) noexcept { return (size + 7) & ~std::size_t(7); }
+
+	static constexpr Layout make(std::uint32_t count, std::uint32_t slots, std::uint64_t blobSize) noexcept {
+		Layout ret;
+		ret.offsets = sizeof(Header);
+		ret.lengths = ret.offsets + align((count + 1) * sizeof(std::uint64_t));
+		ret.mtimes = ret.lengths + align(count * sizeof(float));
+		ret.sizes = ret.mtimes + align(count * sizeof(std::int64_t));
+		ret.loudness = ret.sizes + align(count * sizeof(std::uint64_t));
+		ret.fingerprints = ret.loudness + align(count * sizeof(Loudness));
+		ret.index = ret.fingerprints + count * sizeof(Library::Fingerprint);
+		ret.blob = ret.index + align(slots * sizeof(std::uint32_t));
+		ret.total = ret.blob + std::size_t(blobSize);
+		return ret;
+	}
+};
+
+constexpr std::uint64_t hash(std::string_view str) noexcept {
+	std::uint64_t ret = 14695981039346656037ULL;
+	for (char const ch : str) { ret = (ret ^ std::uint8_t(ch)) * 1099511628211ULL; }
+	return ret;
+}
+
+constexpr std::uint32_t slotCount(std::uint32_t count) noexcept { return count == 0 ? 0 : std::bit_ceil(count * 2); }
+
+template <typename T>
+std::span<T const> column(std::span<std::byte const> bytes, std::size_t offset, std::size_t count) noexcept {
+	return {reinterpret_cast<T const*>(bytes.data() + offset), count};
+}
+
+template <typename T>
+void writePod(std::ostream& out, T const& t) {
+	out.write(reinterpret_cast<char const*>(&t), sizeof(T));
+}
+
+template <typename T>
+bool readPod(std::istream& in, T& out) {
+	return bool(in.read(reinterpret_cast<char*>(&out), sizeof(T)));
+}
+
+void pad(std::ostream& out) {
+	static constexpr char zeros[8]{};
+	auto const pos = std::size_t(out.tellp());
+	out.write(zeros, std::streamsize(Layout::align(pos) - pos));
+}
+} // namespace
+
+struct Library::Base {
+	MappedFile file;
+	std::span<std::uint64_t const> offsets;
+	std::span<float const> lengths;
+	std::span<std::int64_t const> mtimes;
+	std::span<std::uint64_t const> sizes;
+	std::span<Loudness const> loudness;
+	std::span<Fingerprint const> fingerprints;
+	std::span<std::uint32_t const> index;
+	std::string_view blob;
+	std::uint32_t count{};
+
+	static std::shared_ptr<Base const> map(char const* path) {
+		auto file = MappedFile::open(path);
+		if (!file || file->empty()) { return {}; }
+		auto const bytes = file->bytes();
+		Header header;
+		if (bytes.size() < sizeof(header)) { return {}; }
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if (std::memcmp(header.magic, magic_v, sizeof(magic_v)) != 0 || header.byteOrder != byte_order_v) {
+			Log::warn("[Library] Invalid library [{}]", path);
+			return {};
+		}
+		if (header.version != format_version_v) {
+			Log::warn("[Library] Unsupported library version [{}]", header.version);
+			return {};
+		}
+		auto const layout = Layout::make(header.count, header.slots, header.blobSize);
+		if (bytes.size() < layout.total) {
+			Log::warn("[Library] Truncated library [{}]", path);
+			return {};
+		}
+		if (header.slots != slotCount(header.count)) {
+			Log::warn("[Library] Corrupt index in library [{}]", path);
+			return {};
+		}
+		auto ret = std::make_shared<Base>();
+		ret->offsets = column<std::uint64_t>(bytes, layout.offsets, header.count + 1);
+		ret->lengths = column<float>(bytes, layout.lengths, header.count);
+		ret->mtimes = column<std::int64_t>(bytes, layout.mtimes, header.count);
+		ret->sizes = column<std::uint64_t>(bytes, layout.sizes, header.count);
+		ret->loudness = column<Loudness>(bytes, layout.loudness, header.count);
+		ret->fingerprints = column<Fingerprint>(bytes, layout.fingerprints, header.count);
+		ret->index = column<std::uint32_t>(bytes, layout.index, header.slots);
+		ret->blob = {reinterpret_cast<char const*>(bytes.data() + layout.blob), std::size_t(header.blobSize)};
+		ret->count = header.count;
+		if (!ret->valid()) {
+			Log::warn("[Library] Corrupt library [{}]", path);
+			return {};
+		}
+		ret->file = std::move(*file);
+		return ret;
+	}
+
+	// Ids (and path offsets) are used unchecked after this
+	bool valid() const noexcept {
+		for (auto const value : index) {
+			if (value > count) { return false; }
+		}
+		for (std::size_t i = 0; i < count; ++i) {
+			if (offsets[i] > offsets[i + 1]) { return false; }
+		}
+		return offsets[count] <= blob.size();
+	}
+
+	std::string_view path(Id id) const noexcept { return blob.substr(offsets[id], offsets[id + 1] - offsets[id]); }
+	Meta meta(Id id) const noexcept { return {lengths[id], mtimes[id], sizes[id], loudness[id], fingerprints[id]}; }
+
+	Id find(std::string_view str) const noexcept {
+		if (index.empty()) { return null_id; }
+		auto const mask = index.size() - 1;
+		auto slot = std::size_t(hash(str)) & mask;
+		// bounded: a table with no empty slot left must still terminate
+		for (std::size_t probe = 0; probe < index.size(); ++probe, slot = (slot + 1) & mask) {
+			auto const value = index[slot];
+			if (value == 0) { return null_id; }
+			if (path(value - 1) == str) { return value - 1; }
+		}
+		return null_id;
+	}
+};
+
+struct Library::Compaction {
+	std::shared_ptr<Base const> base;
+	std::vector<Row> rows;
+	std::unordered_map<Id, Row> updates;
+	std::uint64_t seq{};
+	std::atomic<bool> done{};
+	bool success{};
+	ktl::kthread thread;
+
+	// Written next to path (temp_v): finish() swaps it in on the main thread
+	bool write(std::string const& path) const {
+		auto const baseCount = base ? base->count : 0U;
+		auto const count = std::uint32_t(baseCount + rows.size());
+		auto const pathAt = [&](Id id) { return id < baseCount ? base->path(id) : std::string_view(rows[id - baseCount].path); };
+		auto const metaAt = [&](Id id) {
+			if (id >= baseCount) { return rows[id - baseCount].meta; }
+			if (auto it = updates.find(id); it != updates.end()) { return it->second.meta; }
+			return base->meta(id);
+		};
+		std::vector<std::uint64_t> offsets;
+		offsets.reserve(count + 1);
+		std::uint64_t blobSize{};
+		for (Id id = 0; id < count; ++id) {
+			offsets.push_back(blobSize);
+			blobSize += pathAt(id).size();
+		}
+		offsets.push_back(blobSize);
+		auto const slots = slotCount(count);
+		std::vector<std::uint32_t> index(slots);
+		for (Id id = 0; id < count; ++id) {
+			auto slot = std::size_t(hash(pathAt(id))) & (slots - 1);
+			while (index[slot] != 0) { slot = (slot + 1) & (slots - 1); }
+			index[slot] = id + 1;
+		}
+		auto const temp = path + std::string(temp_v);
+		{
+			auto file = std::ofstream(temp, std::ios::binary | std::ios::trunc);
+			if (!file) { return false; }
+			Header header{};
+			std::memcpy(header.magic, magic_v, sizeof(magic_v));
+			header.version = format_version_v;
+			header.byteOrder = byte_order_v;
+			header.count = count;
+			header.slots = slots;
+			header.blobSize = blobSize;
+			writePod(file, header);
+			file.write(reinterpret_cast<char const*>(offsets.data()), std::streamsize(offsets.size() * sizeof(std::uint64_t)));
+			pad(file);
+			for (Id id = 0; id < count; ++id) { writePod(file, metaAt(id).length); }
+			pad(file);
+			for (Id id = 0; id < count; ++id) { writePod(file, metaAt(id).mtime); }
+			for (Id id = 0; id < count; ++id) { writePod(file, metaAt(id).size); }
+			for (Id id = 0; id < count; ++id) { writePod(file, metaAt(id).loudness); }
+			pad(file);
+			for (Id id = 0; id < count; ++id) { writePod(file, metaAt(id).fingerprint); }
+			file.write(reinterpret_cast<char const*>(index.data()), std::streamsize(index.size() * sizeof(std::uint32_t)));
+			pad(file);
+			for (Id id = 0; id < count; ++id) {
+				auto const str = pathAt(id);
+				file.write(str.data(), std::streamsize(str.size()));
+			}
+			if (!file.flush()) { return false; }
+		}
+		return true;
+	}
+};
+
+std::optional<Library::Meta> Library::Meta::stat(std::string_view path) {
+	std::error_code ec;
+	auto const p = stdfs::path(path);
+	auto const time = stdfs::last_write_time(p, ec);
+	if (ec) { return std::nullopt; }
+	auto const size = stdfs::file_size(p, ec);
+	if (ec) { return std::nullopt; }
+	return Meta{{}, std::int64_t(time.time_since_epoch().count()), std::uint64_t(size)};
+}
+
+std::unique_ptr<Library> Library::open(std::string path) {
+	auto ret = std::unique_ptr<Library>(new Library(std::move(path)));
+	ret->m_base = Base::map(ret->m_path.data());
+	if (ret->replay()) {
+		ret->m_log.open(ret->m_logPath, std::ios::binary | std::ios::app);
+	} else {
+		ret->rewriteLog();
+	}
+	if (!ret->m_log) { Log::warn("[Library] Failed to open log [{}], changes will not persist", ret->m_logPath); }
+	Log::info("[Library] Opened [{}]: {} tracks ({} pending)", ret->m_path, ret->size(), ret->pending());
+	return ret;
+}
+
+Library::Library(std::string path) : m_path(std::move(path)) { m_logPath = m_path + ".log"; }
+
+Library::~Library() noexcept {
+	if (m_compaction) { m_compaction->thread.join(); }
+}
+
+Library::Id Library::find(std::string_view path) const noexcept {
+	if (m_base) {
+		if (auto const ret = m_base->find(path); ret != null_id) { return ret; }
+	}
+	if (auto it = m_lookup.find(path); it != m_lookup.end()) { return it->second; }
+	return null_id;
+}
+
+std::optional<Library::Entry> Library::entry(Id id) const noexcept {
+	auto const baseCount = m_base ? m_base->count : 0U;
+	if (id < baseCount) {
+		if (auto it = m_updates.find(id); it != m_updates.end()) { return Entry{m_base->path(id), it->second.meta}; }
+		return Entry{m_base->path(id), m_base->meta(id)};
+	}
+	if (id - baseCount < m_rows.size()) {
+		auto const& row = m_rows[id - baseCount];
+		return Entry{row.path, row.meta};
+	}
+	return std::nullopt;
+}
+
+std::string_view Library::path(Id id) const noexcept {
+	if (auto const ret = entry(id)) { return ret->path; }
+	return {};
+}
+
+Library::Id Library::upsert(std::string_view path, Meta const& meta) {
+	auto const baseCount = m_base ? m_base->count : 0U;
+	auto id = find(path);
+	if (id != null_id) {
+		if (entry(id)->meta == meta) { return id; }
+		if (id < baseCount) {
+			auto& row = m_updates[id];
+			row = {{}, meta, ++m_seq};
+			record(id, {std::string(path), meta, m_seq});
+		} else {
+			auto& row = m_rows[id - baseCount];
+			row.meta = meta;
+			row.seq = ++m_seq;
+			record(id, row);
+		}
+		changed(id);
+		return id;
+	}
+	id = Id(baseCount + m_rows.size());
+	m_rows.push_back({std::string(path), meta, ++m_seq});
+	m_lookup.insert_or_assign(m_rows.back().path, id);
+	record(id, m_rows.back());
+	changed(id);
+	return id;
+}
+
+void Library::changed(Id id) {
+	if (m_changes.overflow) { return; }
+	if (m_changes.ids.size() >= changes_limit_v) {
+		m_changes = {{}, true};
+		return;
+	}
+	m_changes.ids.push_back(id);
+}
+
+std::size_t Library::size() const noexcept { return (m_base ? m_base->count : 0U) + m_rows.size(); }
+
+bool Library::compact() {
+	if (m_compaction || pending() == 0) { return false; }
+	m_compaction = std::make_unique<Compaction>();
+	m_compaction->base = m_base;
+	m_compaction->rows = m_rows;
+	m_compaction->updates = m_updates;
+	m_compaction->seq = m_seq;
+	m_compaction->thread = ktl::kthread([c = m_compaction.get(), path = m_path]() {
+		alloc::Scope const scope(alloc::Tag::eIo);
+		c->success = c->write(path);
+		c->done.store(true);
+	});
+	Log::debug("[Library] Compacting {} pending changes", pending());
+	return true;
+}
+
+void Library::update() {
+	if (m_compaction) {
+		if (m_compaction->done.load()) { finish(); }
+	} else if (pending() >= m_compactAt) {
+		compact();
+	}
+}
+
+bool Library::replay() {
+	auto file = std::ifstream(m_logPath, std::ios::binary);
+	if (!file) { return false; }
+	char magic[sizeof(log_magic_v)]{};
+	std::uint32_t version{};
+	if (!readPod(file, magic) || !readPod(file, version) || std::memcmp(magic, log_magic_v, sizeof(magic)) != 0 || version != format_version_v) {
+		Log::warn("[Library] Discarding log [{}] from another version", m_logPath);
+		return false;
+	}
+	auto const baseCount = m_base ? m_base->count : 0U;
+	std::uint32_t id{}, pathSize{};
+	Meta meta;
+	while (readPod(file, id) && readPod(file, pathSize) && readPod(file, meta.length) && readPod(file, meta.mtime) && readPod(file, meta.size) &&
+		   readPod(file, meta.loudness) && readPod(file, meta.fingerprint)) {
+		std::string path(pathSize, '\0');
+		if (!file.read(path.data(), std::streamsize(pathSize))) { break; }
+		if (id < baseCount) {
+			m_updates[id] = {{}, meta, ++m_seq};
+		} else if (id - baseCount < m_rows.size()) {
+			m_rows[id - baseCount].meta = meta;
+			m_rows[id - baseCount].seq = ++m_seq;
+		} else if (id - baseCount == m_rows.size()) {
+			m_rows.push_back({std::move(path), meta, ++m_seq});
+			m_lookup.insert_or_assign(m_rows.back().path, id);
+		} else {
+			Log::warn("[Library] Corrupt log [{}], discarding remainder", m_logPath);
+			break;
+		}
+	}
+	return true;
+}
+
+bool Library::record(Id id, Row const& row) {
+	if (!m_log) { return false; }
+	writePod(m_log, id);
+	writePod(m_log, std::uint32_t(row.path.size()));
+	writePod(m_log, row.meta.length);
+	writePod(m_log, row.meta.mtime);
+	writePod(m_log, row.meta.size);
+	writePod(m_log, row.meta.loudness);
+	writePod(m_log, row.meta.fingerprint);
+	m_log.write(row.path.data(), std::streamsize(row.path.size()));
+	return bool(m_log.flush());
+}
+
+void Library::rewriteLog() {
+	m_log.close();
+	m_log.open(m_logPath, std::ios::binary | std::ios::trunc);
+	if (!m_log) { return; }
+	m_log.write(log_magic_v, sizeof(log_magic_v));
+	writePod(m_log, format_version_v);
+	auto const baseCount = m_base ? m_base->count : 0U;
+	for (auto const& [id, row] : m_updates) { record(id, {std::string(m_base->path(id)), row.meta, row.seq}); }
+	for (std::size_t i = 0; i < m_rows.size(); ++i) { record(Id(baseCount + i), m_rows[i]); }
+}
+
+bool Library::replace(std::uint32_t count) {
+	auto const temp = m_path + std::string(temp_v);
+	std::error_code ec;
+	if (auto const written = Base::map(temp.data()); !written || written->count != count) {
+		Log::error("[Library] Invalid compacted library [{}]", temp);
+		stdfs::remove(temp, ec);
+		return false;
+	}
+	// Windows can't replace a mapped file: unmap first
+	m_base.reset();
+	stdfs::rename(temp, m_path, ec);
+	if (ec) {
+		Log::warn("[Library] Failed to replace [{}]: {}", m_path, ec.message());
+		stdfs::remove(temp, ec);
+		m_base = Base::map(m_path.data());
+		return false;
+	}
+	m_base = Base::map(m_path.data());
+	if (!m_base) {
+		Log::error("[Library] Failed to map compacted library [{}]", m_path);
+		return false;
+	}
+	return true;
+}
+
+void Library::finish() {
+	auto compaction = std::move(m_compaction);
+	compaction->thread.join();
+	// the only other reference to the mapped base
+	compaction->base.reset();
+	auto const oldCount = m_base ? m_base->count : 0U;
+	auto const folded = compaction->rows.size();
+	if (!compaction->success || !replace(std::uint32_t(oldCount + folded))) {
+		Log::warn("[Library] Compaction failed, keeping log");
+		m_compactAt = pending() + compact_threshold_v;
+		return;
+	}
+	// changes made while compaction was in flight remain pending
+	std::erase_if(m_updates, [seq = compaction->seq](auto const& kvp) { return kvp.second.seq <= seq; });
+	for (std::size_t i = 0; i < folded; ++i) {
+		auto& row = m_rows[i];
+		m_lookup.erase(row.path);
+		if (row.seq > compaction->seq) { m_updates[Id(oldCount + i)] = {{}, row.meta, row.seq}; }
+	}
+	m_rows.erase(m_rows.begin(), m_rows.begin() + std::ptrdiff_t(folded));
+	m_compactAt = compact_threshold_v;
+	rewriteLog();
+	Log::info("[Library] Compacted [{}]: {} tracks", m_path, size());
+}
+} // namespace jk
@@ -0,0 +1,120 @@
+#pragma once
+#include <app/loudness.hpp>
+#include <ktl/async/kthread.hpp>
+#include <misc/mapped_file.hpp>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Persistent index of every known track
+///
+/// The base file is a columnar layout that is memory mapped and used in place.
+/// Appends and updates are written to a log next to it, and folded into a new base by background compaction.
+/// Ids are row indices and remain stable across compactions.
+///
+class Library {
+  public:
+	using Id = std::uint32_t;
+	static constexpr Id null_id = ~Id{};
+	static constexpr std::size_t compact_threshold_v = 1024;
+
+	///
+	/// \brief Content hashes used to find duplicates, zero until scanned
+	///
+	struct Fingerprint {
+		std::uint64_t file{};  // raw bytes
+		std::uint64_t audio{}; // decoded samples
+
+		constexpr bool operator==(Fingerprint const&) const = default;
+	};
+
+	struct Meta {
+		float length{};
+		std::int64_t mtime{};
+		std::uint64_t size{};
+		Loudness loudness{};
+		Fingerprint fingerprint{};
+
+		static std::optional<Meta> stat(std::string_view path);
+
+		constexpr bool sameFile(Meta const& rhs) const noexcept { return mtime == rhs.mtime && size == rhs.size; }
+		constexpr bool operator==(Meta const&) const = default;
+	};
+
+	struct Entry {
+		std::string_view path;
+		Meta meta;
+	};
+
+	// Rows upserted (added or changed) since the last takeChanges()
+	struct Changes {
+		std::vector<Id> ids{};
+		bool overflow{}; // more than changes_limit_v: ids is empty, re-read everything
+	};
+	static constexpr std::size_t changes_limit_v = 64 * 1024;
+
+	static std::unique_ptr<Library> open(std::string path);
+
+	Library& operator=(Library&&) = delete;
+	~Library() noexcept;
+
+	Id find(std::string_view path) const noexcept;
+	std::optional<Entry> entry(Id id) const noexcept;
+	std::string_view path(Id id) const noexcept;
+	Id upsert(std::string_view path, Meta const& meta);
+	Changes takeChanges() { return std::exchange(m_changes, {}); }
+
+	std::size_t size() const noexcept;
+	std::size_t pending() const noexcept { return m_rows.size() + m_updates.size(); }
+	bool compacting() const noexcept { return m_compaction != nullptr; }
+
+	bool compact();
+	void update();
+
+  private:
+	struct Base;
+	struct Row {
+		std::string path;
+		Meta meta;
+		std::uint64_t seq{};
+	};
+	struct Compaction;
+	// Lets m_lookup find string_views without building a std::string
+	struct PathHash {
+		using is_transparent = void;
+
+		std::size_t operator()(std::string_view path) const noexcept { return std::hash<std::string_view>{}(path); }
+	};
+
+	Library(std::string path);
+
+	bool replay();
+	bool record(Id id, Row const& row);
+	void rewriteLog();
+	// Swaps in the compacted base of count rows
+	bool replace(std::uint32_t count);
+	void finish();
+	void changed(Id id);
+
+	std::string m_path;
+	std::string m_logPath;
+	std::shared_ptr<Base const> m_base;
+	std::vector<Row> m_rows;
+	std::unordered_map<Id, Row> m_updates;
+	std::unordered_map<std::string, Id, PathHash, std::equal_to<>> m_lookup;
+	std::ofstream m_log;
+	std::unique_ptr<Compaction> m_compaction;
+	Changes m_changes;
+	std::uint64_t m_seq{};
+	std::size_t m_compactAt = compact_threshold_v;
+};
+} // namespace jk
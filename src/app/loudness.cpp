@@ -0,0 +1,183 @@
+#include <app/loudness.hpp>
+#include <app/track_source.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/biquad.hpp>
+#include <misc/log.hpp>
+#include <misc/simd.hpp>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+namespace jk {
+namespace {
+using simd::f32x4;
+
+constexpr float abs_gate_v = -70.0f;
+constexpr float rel_gate_v = -10.0f;
+
+float lufs(double meanSquare) noexcept { return meanSquare > 0.0 ? float(-0.691 + 10.0 * std::log10(meanSquare)) : abs_gate_v; }
+double meanSquare(float lufs) noexcept { return std::pow(10.0, (double(lufs) + 0.691) / 10.0); }
+
+///
+/// \brief 4x oversampling peak meter (polyphase windowed sinc)
+///
+class TruePeak {
+  public:
+	static constexpr std::size_t factor_v = 4;
+	static constexpr std::size_t taps_v = 12; // per phase
+
+	TruePeak() {
+		constexpr auto length = factor_v * taps_v;
+		for (std::size_t n = 0; n < length; ++n) {
+			double const x = (double(n) - double(length - 1) * 0.5) / double(factor_v);
+			double const sinc = x == 0.0 ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+			double const window = 0.5 - 0.5 * std::cos(2.0 * std::numbers::pi * (double(n) + 0.5) / double(length));
+			m_phases[n % factor_v][n / factor_v] = float(sinc * window);
+		}
+	}
+
+	// frames: taps_v - 1 frames of history followed by new frames, all 4-lane
+	void process(std::span<float const> frames) noexcept {
+		auto peak = f32x4::load(m_peak.data());
+		for (std::size_t i = (taps_v - 1) * 4; i < frames.size(); i += 4) {
+			for (auto const& phase : m_phases) {
+				auto acc = f32x4::splat(0.0f);
+				for (std::size_t k = 0; k < taps_v; ++k) { acc += f32x4::splat(phase[k]) * f32x4::load(frames.data() + i - k * 4); }
+				peak = max(peak, abs(acc));
+			}
+		}
+		peak.store(m_peak.data());
+	}
+
+	float peak() const noexcept { return std::max(std::max(m_peak[0], m_peak[1]), std::max(m_peak[2], m_peak[3])); }
+
+  private:
+	std::array<std::array<float, taps_v>, factor_v> m_phases{};
+	alignas(16) std::array<float, 4> m_peak{};
+};
+
+void track(std::span<std::int16_t const> samples, std::size_t channels, std::size_t offset, std::size_t& out_first, std::size_t& out_last) {
+	auto const threshold = std::int16_t(32768.0f * std::pow(10.0f, Loudness::silence_v / 20.0f));
+	auto const block = simd::peak(samples);
+	if (block.max <= threshold && block.min >= -threshold) { return; }
+	for (std::size_t i = 0; i < samples.size(); ++i) {
+		if (samples[i] > threshold || samples[i] < -threshold) {
+			auto const frame = offset + i / channels;
+			out_first = std::min(out_first, frame);
+			out_last = std::max(out_last, frame);
+		}
+	}
+}
+} // namespace
+
+Loudness Loudness::measure(capo::PCM const& pcm) {
+	auto const channels = std::max(pcm.meta.channels, std::size_t(1));
+	auto const rate = pcm.meta.sampleRate;
+	auto const frames = pcm.samples.size() / channels;
+	if (rate == 0 || frames == 0) { return {}; }
+	Biquad4 shelf, highPass;
+	shelf.set(Biquad::kShelf(float(rate)));
+	highPass.set(Biquad::kHighPass(float(rate)));
+	TruePeak truePeak;
+	// 100ms sub-blocks: four make one 400ms gating block
+	auto const step = std::max(rate / 10, std::size_t(1));
+	constexpr auto history = (TruePeak::taps_v - 1) * 4;
+	std::vector<float> lanes(history + step * 4);
+	std::vector<double> energy;
+	energy.reserve(frames / step + 1);
+	std::size_t first = frames, last = 0;
+	for (std::size_t offset = 0; offset < frames; offset += step) {
+		auto const count = std::min(step, frames - offset);
+		auto const samples = std::span(pcm.samples).subspan(offset * channels, count * channels);
+		track(samples, channels, offset, first, last);
+		auto const block = std::span(lanes).subspan(history, count * 4);
+		simd::toLanes(samples, channels, block);
+		truePeak.process(std::span(lanes).first(history + count * 4));
+		std::copy(lanes.begin() + std::ptrdiff_t(count * 4), lanes.begin() + std::ptrdiff_t(count * 4 + history), lanes.begin());
+		shelf.process(block);
+		highPass.process(block);
+		auto sum = f32x4::splat(0.0f);
+		for (std::size_t i = 0; i < block.size(); i += 4) {
+			auto const x = f32x4::load(block.data() + i);
+			sum += x * x;
+		}
+		alignas(16) std::array<float, 4> sums;
+		sum.store(sums.data());
+		if (count == step) { energy.push_back((double(sums[0]) + sums[1] + sums[2] + sums[3]) / double(count)); }
+	}
+	std::vector<double> blocks;
+	blocks.reserve(energy.size());
+	double absSum{};
+	for (std::size_t i = 0; i + 4 <= energy.size(); ++i) {
+		auto const z = (energy[i] + energy[i + 1] + energy[i + 2] + energy[i + 3]) * 0.25;
+		if (lufs(z) > abs_gate_v) {
+			blocks.push_back(z);
+			absSum += z;
+		}
+	}
+	Loudness ret;
+	ret.integrated = abs_gate_v;
+	if (!blocks.empty()) {
+		auto const relGate = meanSquare(lufs(absSum / double(blocks.size())) + rel_gate_v);
+		double sum{};
+		std::size_t count{};
+		for (double const z : blocks) {
+			if (z > relGate) {
+				sum += z;
+				++count;
+			}
+		}
+		if (count > 0) { ret.integrated = lufs(sum / double(count)); }
+	}
+	auto const peak = truePeak.peak();
+	ret.truePeak = peak > 0.0f ? 20.0f * std::log10(peak) : -96.0f;
+	if (first <= last) {
+		ret.head = float(first) / float(rate);
+		ret.tail = float(last + 1) / float(rate);
+	}
+	return ret;
+}
+
+float Loudness::gain() const noexcept {
+	if (!measured()) { return 1.0f; }
+	auto const db = std::min(target_v - integrated, ceiling_v - truePeak);
+	return std::clamp(std::pow(10.0f, db / 20.0f), 0.0f, 2.0f);
+}
+
+LoudnessScanner::LoudnessScanner() {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		while (auto path = m_queue.pop()) {
+			auto pcm = TrackSource::decode(*path, MappedFile::Hint::eSequential);
+			Result result{std::move(*path), {}};
+			if (pcm) {
+				result.loudness = Loudness::measure(*pcm);
+				Log::debug("[Loudness] [{}]: {} LUFS, {} dBTP", result.path, result.loudness.integrated, result.loudness.truePeak);
+			} else {
+				Log::warn("[Loudness] Failed to decode [{}]", result.path);
+			}
+			auto lock = std::scoped_lock(m_done.mutex);
+			m_done.results.push_back(std::move(result));
+		}
+	});
+}
+
+LoudnessScanner::~LoudnessScanner() noexcept { m_queue.active(false); }
+
+bool LoudnessScanner::push(std::string path) {
+	if (!m_queued.insert(path).second) { return false; }
+	m_queue.push(std::move(path));
+	return true;
+}
+
+std::vector<LoudnessScanner::Result> LoudnessScanner::results() {
+	std::vector<Result> ret;
+	{
+		auto lock = std::scoped_lock(m_done.mutex);
+		std::swap(ret, m_done.results);
+	}
+	for (auto const& result : ret) { m_queued.erase(result.path); }
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,61 @@
+#pragma once
+#include <capo/capo.hpp>
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Integrated loudness (ITU-R BS.1770 / EBU R128), true peak and silence bounds of a track
+///
+struct Loudness {
+	static constexpr float target_v = -18.0f;	// LUFS
+	static constexpr float ceiling_v = -1.0f;	// dBTP
+	static constexpr float silence_v = -60.0f; // dBFS
+
+	// zero: not measured
+	float integrated{}; // LUFS
+	float truePeak{};	// dBTP
+	float head{};		// end of leading silence (s)
+	float tail{};		// start of trailing silence (s)
+
+	static Loudness measure(capo::PCM const& pcm);
+
+	constexpr bool measured() const noexcept { return integrated != 0.0f; }
+	// Linear gain to reach target_v without true peak exceeding ceiling_v
+	float gain() const noexcept;
+
+	constexpr bool operator==(Loudness const&) const = default;
+};
+
+///
+/// \brief Measures queued tracks on a worker thread
+///
+class LoudnessScanner {
+  public:
+	struct Result {
+		std::string path;
+		Loudness loudness;
+	};
+
+	LoudnessScanner();
+	~LoudnessScanner() noexcept;
+
+	bool push(std::string path);
+	std::vector<Result> results();
+	std::size_t pending() const noexcept { return m_queued.size(); }
+
+  private:
+	struct {
+		std::vector<Result> results;
+		std::mutex mutex;
+	} m_done;
+	std::unordered_set<std::string> m_queued;
+	ktl::async_queue<std::string> m_queue;
+	ktl::kthread m_thread;
+};
+} // namespace jk
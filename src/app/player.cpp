@@ -1,83 +1,162 @@
+#include <app/library.hpp>
 #include <app/player.hpp>
 #include <app/playlist.hpp>
+#include <app/track_source.hpp>
 #include <misc/log.hpp>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 namespace jk {
-namespace {
-template <typename Container>
-void extractPaths(Container const& paths, std::vector<std::string>& out, capo::Music& music, std::size_t& out_total) {
-	out.reserve(out.size() + paths.size());
-	for (std::string_view path : paths) {
-		if (path.empty()) { continue; }
-		auto const extIdx = path.find_last_of('.');
-		if (extIdx == std::string_view::npos) { continue; }
-		auto const ext = path.substr(extIdx);
-		if (ext == ".txt") {
-			Playlist list;
-			if (auto loaded = list.load(path.data()); loaded > 0) {
-				Log::debug("[Player] loaded {} tracks from playlist [{}]", loaded, path);
-				extractPaths(list.tracks, out, music, out_total);
-			}
-		} else if (music.open(path)) {
-			out.push_back(std::string(path));
-			Log::info("[Player] Added [{}]", path);
-			++out_total;
-		} else {
-			Log::info("[Player] Skipped [{}]", path);
-		}
-	}
+
+std::vector<std::string> Player::Tracklist::paths(std::size_t first) const {
+	std::vector<std::string> ret;
+	if (first >= size()) { return ret; }
+	ret.reserve(size() - first);
+	tracks().slice(first, size() - first).each([&](std::span<PathStore::Id const> ids) {
+		for (auto const id : ids) { ret.push_back(store->path(id)); }
+		return true;
+	});
+	return ret;
 }
 
-template <typename T, typename U>
-constexpr std::size_t getIndex(T const& elems, U const& u) noexcept {
-	for (std::size_t i = 0; i < elems.size(); ++i) {
-		if (elems[i] == u) { return i; }
+Playlist Player::Tracklist::playlists() const {
+	Playlist ret;
+	std::size_t total{};
+	for (auto const& list : lists) { total += list.tracks.size(); }
+	ret.tracks.reserve(total);
+	ret.sections.reserve(lists.size());
+	for (auto const& list : lists) {
+		ret.sections.push_back({list.name, ret.tracks.size(), list.rule});
+		list.tracks.each([&](std::span<PathStore::Id const> ids) {
+			for (auto const id : ids) { ret.tracks.push_back(store->path(id)); }
+			return true;
+		});
 	}
-	return std::string_view::npos;
+	return ret;
 }
-} // namespace
 
-Player::Player(ktl::not_null<capo::Instance*> capo) : m_music(capo), m_capo(capo) {}
+Player::Player(ktl::not_null<capo::Instance*> capo, Library* library)
+	: m_music(capo), m_decoder(std::make_unique<Decoder>()), m_readAhead(std::make_unique<ReadAhead>()), m_store(std::make_shared<PathStore>()),
+	  m_lists{{std::string(default_list_v)}}, m_versions(1), m_capo(capo), m_library(library) {}
 
 bool Player::add(std::span<const std::string> paths) {
-	std::size_t added{};
+	std::vector<PathStore::Id> added;
 	capo::Music music(m_capo);
-	extractPaths(paths, m_paths, music, added);
-	return added > 0;
+	extract(paths, music, added);
+	if (added.empty()) { return false; }
+	commit(tracks().insert(size(), added));
+	changed();
+	return true;
 }
 
 bool Player::push(std::string path, bool autoplay) {
-	std::size_t added{};
+	std::vector<PathStore::Id> added;
 	capo::Music music(m_capo);
 	std::string const paths[] = {std::move(path)};
-	extractPaths(std::span(paths), m_paths, music, added);
-	if (added > 0 && autoplay) { navLast(); }
-	return added > 0;
+	extract(paths, music, added);
+	if (added.empty()) { return false; }
+	commit(tracks().insert(size(), added));
+	changed();
+	if (autoplay) { navLast(); }
+	return true;
 }
 
-bool Player::pop() noexcept { return pop(path()); }
+bool Player::pop() { return pop(m_head); }
 
-bool Player::pop(std::string_view path) noexcept {
-	if (m_paths.empty()) { return false; }
+bool Player::pop(std::size_t index) {
+	if (index >= size()) { return false; }
 	bool const replay = playing();
-	auto const index = getIndex(m_paths, path);
-	bool const backstep = index <= m_head;
-	if (index != std::string_view::npos) { Log::info("[Player] Removed [{}]", path); }
-	if (path == this->path()) {
-		stop();
-		std::erase(m_paths, path);
-		if (backstep) { m_head = m_head > 0 ? m_head - 1 : 0; }
-		open(replay);
-		return true;
+	bool const current = index == m_head;
+	Log::info("[Player] Removed [{}]", m_store->path(tracks()[index]));
+	if (current) { stop(); }
+	commit(tracks().erase(index));
+	if (index <= m_head) { m_head = m_head > 0 ? m_head - 1 : 0; }
+	changed();
+	if (current) { open(replay); }
+	return true;
+}
+
+std::size_t Player::pop(std::span<std::size_t const> indices) {
+	auto const removed = sorted(indices);
+	if (removed.empty()) { return 0; }
+	bool const replay = playing();
+	auto const ahead = std::size_t(std::lower_bound(removed.begin(), removed.end(), m_head) - removed.begin());
+	bool const current = ahead < removed.size() && removed[ahead] == m_head;
+	if (current) { stop(); }
+	commit(partition(tracks(), removed).first);
+	// same as pop(index): a removed head falls back to the track before it
+	m_head -= ahead;
+	if (current && m_head > 0) { --m_head; }
+	Log::info("[Player] Removed {} tracks", removed.size());
+	changed();
+	if (current) { open(replay); }
+	return removed.size();
+}
+
+std::size_t Player::move(std::span<std::size_t const> indices, std::size_t position) {
+	auto const moved = sorted(indices);
+	if (moved.empty()) { return 0; }
+	position = std::min(position, size());
+	// tracks moved from ahead of position close up the gap before it
+	auto const at = position - std::size_t(std::lower_bound(moved.begin(), moved.end(), position) - moved.begin());
+	if (moved.back() - moved.front() + 1 == moved.size() && moved.front() == at) { return 0; }
+	auto const ahead = std::size_t(std::lower_bound(moved.begin(), moved.end(), m_head) - moved.begin());
+	bool const current = ahead < moved.size() && moved[ahead] == m_head;
+	auto const [kept, picked] = partition(tracks(), moved);
+	commit(kept.insert(at, picked));
+	if (current) {
+		m_head = at + ahead;
+	} else if (m_head -= ahead; m_head >= at) {
+		m_head += moved.size();
 	}
-	auto const ret = std::erase(m_paths, path) > 0;
-	if (ret && backstep) { m_head = m_head > 0 ? m_head - 1 : 0; }
-	return ret;
+	Log::info("[Player] Moved {} tracks to {}", moved.size(), at);
+	changed();
+	return moved.size();
+}
+
+std::size_t Player::playNext(std::span<std::size_t const> indices) {
+	std::vector<std::size_t> next;
+	next.reserve(indices.size());
+	std::copy_if(indices.begin(), indices.end(), std::back_inserter(next), [this](std::size_t index) { return index != m_head; });
+	return move(next, m_head + 1);
+}
+
+std::size_t Player::dedupe(std::span<std::size_t const> indices) {
+	auto const checked = sorted(indices);
+	if (checked.size() < 2) { return 0; }
+	auto const& store = *m_store;
+	auto const hash = [&store](PathStore::Id id) { return std::size_t(store.hash(id)); };
+	auto const equal = [&store](PathStore::Id lhs, PathStore::Id rhs) { return store.equals(lhs, rhs); };
+	std::unordered_set<PathStore::Id, decltype(hash), decltype(equal)> seen(checked.size(), hash, equal);
+	// the current track is kept over any earlier copies of it
+	if (std::binary_search(checked.begin(), checked.end(), m_head)) { seen.insert(tracks()[m_head]); }
+	std::vector<std::size_t> repeats;
+	auto next = checked.begin();
+	std::size_t index{};
+	// one walk over the chunks, up to the last index checked
+	tracks().each([&](std::span<PathStore::Id const> ids) {
+		for (auto const id : ids) {
+			if (index == *next) {
+				if (index != m_head && !seen.insert(id).second) { repeats.push_back(index); }
+				if (++next == checked.end()) { return false; }
+			}
+			++index;
+		}
+		return true;
+	});
+	Log::info("[Player] Found {} repeats among {} tracks", repeats.size(), checked.size());
+	return pop(repeats);
 }
 
 bool Player::open(bool autoplay) {
 	if (empty()) { return false; }
 	stop();
+	m_resume = {};
 	if (open()) {
 		if (autoplay) { play(); }
 		return true;
@@ -87,25 +166,74 @@ bool Player::open(bool autoplay) {
 
 void Player::clear() {
 	stop();
-	m_paths.clear();
+	// the store keeps its paths: earlier versions still refer to them
+	commit({});
 	m_head = 0;
+	changed();
 	Log::info("[Player] Playlist cleared");
 }
 
+Player& Player::restore(Playlist const& playlists, std::size_t active, std::size_t head, capo::Time position) {
+	stop();
+	auto store = std::make_shared<PathStore>();
+	std::vector<List> lists;
+	std::vector<PathStore::Id> ids;
+	auto const restore = [&](std::string name, std::size_t first, std::size_t last, std::string rule) {
+		ids.clear();
+		for (auto i = first; i < last; ++i) { ids.push_back(store->add(playlists.tracks[i])); }
+		lists.push_back({std::move(name), Tracks(ids), 0, std::move(rule)});
+	};
+	auto const& sections = playlists.sections;
+	if (sections.empty()) { restore(std::string(default_list_v), 0, playlists.tracks.size(), {}); }
+	for (std::size_t i = 0; i < sections.size(); ++i) {
+		auto const last = i + 1 < sections.size() ? sections[i + 1].first : playlists.tracks.size();
+		restore(sections[i].name, std::min(sections[i].first, last), last, sections[i].rule);
+	}
+	m_store = std::move(store);
+	m_lists = std::move(lists);
+	m_versions.assign(m_lists.size(), {});
+	m_closed.clear();
+	m_active = std::min(active, m_lists.size() - 1);
+	m_head = std::min(head, empty() ? 0 : size() - 1);
+	changed();
+	if (!empty() && open()) { m_resume = position; }
+	Log::info("[Player] Restored {} tracks in {} playlists", playlists.tracks.size(), m_lists.size());
+	return *this;
+}
+
 Player& Player::play() {
 	if (empty()) { return *this; }
 	if (m_status != Status::ePaused) {
 		if (m_mode == Mode::ePreload) {
-			if (auto pcm = capo::PCM::fromFile(path().data()); !pcm) {
+			std::optional<capo::PCM> pcm;
+			if (auto cued = m_decoder->requested() == m_path ? m_decoder->take() : Decoder::Decoded{}) {
+				// decoded (and equalized) ahead of time by cue()
+				pcm = std::move(*cued.pcm);
+				if (m_analyse) { m_samples = std::move(cued.samples); }
+			} else if (auto decoded = TrackSource::decode(m_path, MappedFile::Hint::eWillNeed)) {
+				m_decoder->request({});
+				if (!m_eq.flat()) { Equalizer{}.apply(m_eq, float(decoded->meta.sampleRate), decoded->meta.channels, decoded->samples); }
+				if (m_analyse) {
+					auto const channels = std::max(decoded->meta.channels, std::size_t(1));
+					m_samples = std::make_shared<SampleStore const>(SampleStore::make(decoded->samples, channels, decoded->meta.sampleRate));
+				}
+				pcm = std::move(*decoded);
+			}
+			if (!pcm || !m_music.preload(std::move(*pcm))) {
+				m_samples.reset();
 				return preloadFail(true);
-			} else {
-				if (!m_music.preload(std::move(*pcm))) { return preloadFail(true); }
 			}
+			m_preloaded = true;
+			m_readAhead->close();
 		} else {
 			if (!open()) { return *this; }
 		}
 	}
-	if (m_status != Status::ePlaying && m_music.play()) { transition(Status::ePlaying); }
+	if (m_resume > capo::Time{}) { m_music.seek(std::exchange(m_resume, {})); }
+	if (m_status != Status::ePlaying && m_music.play()) {
+		transition(Status::ePlaying);
+		listen();
+	}
 	return *this;
 }
 
@@ -127,17 +255,18 @@ Player& Player::seek(capo::Time stamp) {
 
 Player& Player::gain(float gain) {
 	if (gain >= 0.0f) {
-		m_music.gain(gain);
+		m_gain = gain;
 		m_cachedGain = -1.0f;
+		applyGain();
 	}
 	return *this;
 }
 
-float Player::gain() const { return muted() ? m_cachedGain : m_music.gain(); }
+float Player::gain() const { return muted() ? m_cachedGain : m_gain; }
 
 Player& Player::mute() {
 	if (!muted()) {
-		m_cachedGain = m_music.gain();
+		m_cachedGain = m_gain;
 		m_music.gain(0.0f);
 		Log::info("[Player] Muted");
 	}
@@ -146,52 +275,367 @@ Player& Player::mute() {
 
 Player& Player::unmute() {
 	if (muted()) {
-		m_music.gain(m_cachedGain);
+		m_gain = m_cachedGain;
 		m_cachedGain = -1.0f;
+		applyGain();
 		Log::info("[Player] Unmuted");
 	}
 	return *this;
 }
 
+Player& Player::known(std::string path, Library::Meta const& meta) {
+	auto [it, inserted] = m_known.try_emplace(std::move(path), meta);
+	if (!inserted && it->second == meta) { return *this; }
+	bool const current = it->first == m_path;
+	it->second = meta;
+	// analysed after the track was opened: apply, including skipping leading silence not yet played past
+	if (current && !m_library) { prepare(m_music.position() < capo::Time(meta.loudness.head)); }
+	return *this;
+}
+
+Player& Player::flag(Flag flag, bool set) {
+	if (m_flags[flag] != set) {
+		m_flags.assign(flag, set);
+		prepare(false);
+	}
+	return *this;
+}
+
+Player& Player::refresh() {
+	prepare(false);
+	return *this;
+}
+
 void Player::update() {
-	if (playing() && m_music.state() == capo::State::eStopped) {
+	if ((m_mode == Mode::eHybrid && !m_preloaded) || m_reprocess) { upgrade(); }
+	if (m_ramp.active()) {
+		applyGain();
+		if (m_ramp.done(GainRamp::Clock::now())) { m_ramp.reset(); }
+	}
+	watchStream();
+	if (!m_cued && playing() && remaining() <= m_cueLead) { cue(); }
+	bool const trimmed = m_flags[Flag::eTrimSilence] && m_loudness.tail > 0.0f && m_music.position() >= capo::Time(m_loudness.tail);
+	bool const ended = playing() && (m_music.state() == capo::State::eStopped || trimmed);
+	if (playing() && m_listen.active) { m_listen.position = ended && !trimmed ? m_music.meta().length() : m_music.position(); }
+	if (ended) {
+		if (m_listen.active) {
+			m_events.push_back({Event::Type::eComplete, std::exchange(m_listen.path, {}), m_listen.position.count()});
+			m_listen.active = false;
+		}
 		if (isLastTrack()) {
-			transition(Status::eStopped);
+			stop();
 		} else {
-			Log::info("[Player] Autoplaying next track [{}]", m_paths[m_head + 1]);
+			Log::info("[Player] Autoplaying next track [{}]", m_store->path(tracks()[m_head + 1]));
 			navNext();
 		}
 	}
 }
 
+capo::Time Player::due() const {
+	if (!playing()) { return capo::Time(std::numeric_limits<float>::max()); }
+	if (m_ramp.active()) { return GainRamp::step_v; }
+	auto const remain = remaining();
+	if (!m_cued && remain > m_cueLead) { return remain - m_cueLead; }
+	return std::max(remain, capo::Time{});
+}
+
 Player& Player::navFirst() { return navIndex(0); }
-Player& Player::navLast() { return navIndex(m_head = m_paths.empty() ? 0 : m_paths.size() - 1); }
+Player& Player::navLast() { return navIndex(empty() ? 0 : size() - 1); }
 Player& Player::navNext() { return navIndex(m_head + 1); }
 Player& Player::navPrev() { return navIndex(m_head > 0 ? m_head - 1 : m_head); }
 
 Player& Player::navIndex(std::size_t index) {
-	if (index < m_paths.size()) {
+	if (index < size()) {
 		m_head = index;
+		m_path = m_store->path(tracks()[m_head]);
 		open(playing());
 	}
 	return *this;
 }
 
-Player& Player::swapTracks(std::size_t lhs, std::size_t rhs) noexcept {
-	if (lhs >= m_paths.size() || rhs > m_paths.size()) { return *this; }
+Player& Player::equalizer(Equalizer::Preset const& preset) {
+	if (preset == m_eq) { return *this; }
+	m_eq = preset;
+	if (empty() || m_mode == Mode::eStream) { return *this; }
+	if (m_preloaded) {
+		m_decoder->request(m_path, m_eq, m_analyse);
+		dropPending();
+		m_reprocess = true;
+		m_resample = false;
+	} else if (!m_decoder->requested().empty()) {
+		m_decoder->request(m_path, m_eq, m_analyse);
+	}
+	return *this;
+}
+
+Player& Player::analyse(bool on) {
+	if (on == m_analyse) { return *this; }
+	m_analyse = on;
+	if (!on) {
+		m_samples.reset();
+		if (m_resample) {
+			m_decoder->request({});
+			m_reprocess = m_resample = false;
+		}
+		return *this;
+	}
+	if (empty() || m_mode == Mode::eStream) { return *this; }
+	if (m_reprocess) {
+		// re-rendering for the equalizer: keep a copy this time
+		m_decoder->request(m_path, m_eq, true);
+		dropPending();
+	} else if (m_preloaded) {
+		// already playing from memory: render a copy to read, without swapping what's playing
+		m_decoder->request(m_path, m_eq, true);
+		m_reprocess = m_resample = true;
+	} else if (auto const requested = std::string(m_decoder->requested()); !requested.empty()) {
+		// upgrade or cue in flight
+		m_decoder->request(requested, m_eq, true);
+	}
+	return *this;
+}
+
+Player& Player::swapTracks(std::size_t lhs, std::size_t rhs) {
+	if (lhs >= size() || rhs >= size()) { return *this; }
+	Log::info("[Player] Swapped track {} [{}] with track {} [{}]", lhs, m_store->filename(tracks()[lhs]), rhs, m_store->filename(tracks()[rhs]));
+	auto const& ids = tracks();
+	commit(ids.assign(lhs, ids[rhs]).assign(rhs, ids[lhs]));
 	if (m_head == lhs) {
 		m_head = rhs;
 	} else if (m_head == rhs) {
 		m_head = lhs;
 	}
-	Log::info("[Player] Swapped track {} [{}] with track {} [{}]", lhs, m_paths[lhs], rhs, m_paths[rhs]);
-	std::swap(m_paths[lhs], m_paths[rhs]);
+	changed();
+	return *this;
+}
+
+Player& Player::watched(Changes const& changes) {
+	if (changes.empty()) { return *this; }
+	enum class Kind { eRemoved, eMoved, eListed };
+	struct Target {
+		std::string_view dir{};
+		std::string_view name{};
+		Kind kind{};
+		std::size_t change{};
+	};
+	// changed paths by directory then filename, split as the store splits them: a track is only compared against those in its directory
+	std::vector<Target> targets;
+	targets.reserve(changes.removed.size() + 2 * changes.renamed.size() + changes.added.size());
+	auto const target = [&targets](std::string_view path, Kind kind, std::size_t change) {
+		auto const name = PathStore::split(path);
+		targets.push_back({path.substr(0, name), path.substr(name), kind, change});
+	};
+	for (std::size_t i = 0; i < changes.removed.size(); ++i) { target(changes.removed[i], Kind::eRemoved, i); }
+	for (std::size_t i = 0; i < changes.renamed.size(); ++i) {
+		target(changes.renamed[i].first, Kind::eMoved, i);
+		target(changes.renamed[i].second, Kind::eListed, i);
+	}
+	for (std::size_t i = 0; i < changes.added.size(); ++i) { target(changes.added[i], Kind::eListed, changes.renamed.size() + i); }
+	std::sort(targets.begin(), targets.end(), [](Target const& a, Target const& b) { return std::tie(a.dir, a.name) < std::tie(b.dir, b.name); });
+	auto const gone = [&changes](std::string_view dir) {
+		return std::any_of(changes.removedDirs.begin(), changes.removedDirs.end(), [dir](std::string_view removed) {
+			return dir.size() > removed.size() && dir.starts_with(removed) && dir[removed.size()] == '/';
+		});
+	};
+
+	std::vector<std::size_t> removed;
+	std::vector<std::pair<std::size_t, std::size_t>> moved; // index, change
+	// renamed targets, then added ones
+	std::vector<bool> listed(changes.renamed.size() + changes.added.size());
+	// directories are interned and a directory's tracks are usually together: its targets are looked up when the directory changes
+	auto dir = std::numeric_limits<std::uint32_t>::max();
+	bool dirGone{};
+	std::span<Target const> inDir;
+	std::size_t index{};
+	tracks().each([&](std::span<PathStore::Id const> ids) {
+		for (auto const id : ids) {
+			if (m_store->directoryIndex(id) != dir) {
+				dir = m_store->directoryIndex(id);
+				auto const directory = m_store->directory(id);
+				dirGone = gone(directory);
+				auto const [first, last] = std::equal_range(targets.begin(), targets.end(), Target{.dir = directory},
+															[](Target const& a, Target const& b) { return a.dir < b.dir; });
+				inDir = std::span(first, last);
+			}
+			if (dirGone) {
+				removed.push_back(index);
+			} else if (!inDir.empty()) {
+				auto [it, last] = std::equal_range(inDir.begin(), inDir.end(), Target{.name = m_store->filename(id)},
+												   [](Target const& a, Target const& b) { return a.name < b.name; });
+				for (; it != last; ++it) {
+					switch (it->kind) {
+					case Kind::eRemoved: removed.push_back(index); break;
+					case Kind::eMoved: moved.emplace_back(index, it->change); break;
+					case Kind::eListed: listed[it->change] = true; break;
+					}
+				}
+			}
+			++index;
+		}
+		return true;
+	});
+
+	std::vector<std::optional<PathStore::Id>> movedIds(changes.renamed.size());
+	auto edited = tracks();
+	std::size_t renamed{};
+	for (auto const& [at, change] : moved) {
+		// moved onto a path that's listed already: the track would only be a duplicate of it
+		if (listed[change]) {
+			removed.push_back(at);
+			continue;
+		}
+		if (!movedIds[change]) { movedIds[change] = editStore().add(changes.renamed[change].second); }
+		edited = edited.assign(at, *movedIds[change]);
+		++renamed;
+	}
+	if (renamed > 0) {
+		// the same tracks where they were: not an edit to undo
+		m_lists[m_active].tracks = std::move(edited);
+		changed();
+	}
+	std::vector<std::string> added;
+	for (std::size_t i = 0; i < changes.renamed.size(); ++i) {
+		if (!movedIds[i] && !listed[i]) { added.push_back(changes.renamed[i].second); }
+	}
+	for (std::size_t i = 0; i < changes.added.size(); ++i) {
+		if (!listed[changes.renamed.size() + i]) { added.push_back(changes.added[i]); }
+	}
+	std::sort(added.begin(), added.end());
+	added.erase(std::unique(added.begin(), added.end()), added.end());
+	Log::info("[Player] Watched folders: {} tracks renamed, {} removed, {} files to add", renamed, removed.size(), added.size());
+	if (!removed.empty()) { pop(removed); }
+	if (!added.empty()) { add(added); }
+	return *this;
+}
+
+Player& Player::newList(std::string name) {
+	Log::info("[Player] New playlist [{}]", name);
+	m_lists.push_back({std::move(name)});
+	m_versions.emplace_back();
+	changed();
+	return *this;
+}
+
+Player& Player::copyList(std::size_t index, std::string name) {
+	if (index >= m_lists.size()) { return *this; }
+	auto const& source = m_lists[index];
+	Log::info("[Player] Copied playlist [{}] ({} tracks) to [{}]", source.name, source.tracks.size(), name);
+	m_lists.push_back({std::move(name), source.tracks, index == m_active ? m_head : source.head});
+	m_versions.emplace_back();
+	changed();
+	return *this;
+}
+
+Player& Player::closeList(std::size_t index) {
+	if (index >= m_lists.size()) { return *this; }
+	if (m_lists.size() == 1) {
+		clear();
+		return *this;
+	}
+	if (index == m_active) { selectList(index + 1 < m_lists.size() ? index + 1 : index - 1); }
+	Log::info("[Player] Closed playlist [{}]", m_lists[index].name);
+	m_closed.push_back({std::move(m_lists[index]), std::move(m_versions[index]), index});
+	m_lists.erase(m_lists.begin() + std::ptrdiff_t(index));
+	m_versions.erase(m_versions.begin() + std::ptrdiff_t(index));
+	if (index < m_active) { --m_active; }
+	changed();
+	return *this;
+}
+
+bool Player::reopenList() {
+	if (m_closed.empty()) { return false; }
+	auto closed = std::move(m_closed.back());
+	m_closed.pop_back();
+	auto const index = std::min(closed.index, m_lists.size());
+	Log::info("[Player] Reopened playlist [{}]", closed.list.name);
+	m_lists.insert(m_lists.begin() + std::ptrdiff_t(index), std::move(closed.list));
+	m_versions.insert(m_versions.begin() + std::ptrdiff_t(index), std::move(closed.versions));
+	if (index <= m_active) { ++m_active; }
+	selectList(index);
+	changed();
+	return true;
+}
+
+Player& Player::renameList(std::size_t index, std::string name) {
+	if (index >= m_lists.size() || m_lists[index].name == name) { return *this; }
+	m_lists[index].name = std::move(name);
+	changed();
+	return *this;
+}
+
+Player& Player::ruleList(std::size_t index, std::string rule) {
+	if (index >= m_lists.size() || m_lists[index].rule == rule) { return *this; }
+	Log::info("[Player] Playlist [{}] rule: [{}]", m_lists[index].name, rule);
+	m_lists[index].rule = std::move(rule);
+	changed();
+	return *this;
+}
+
+Player& Player::fill(std::size_t index, std::string_view rule, std::span<std::string const> paths) {
+	if (index >= m_lists.size() || m_lists[index].rule != rule) { return *this; }
+	auto& store = editStore();
+	auto& list = m_lists[index];
+	// reuse the ids of tracks already listed: refills would otherwise grow the store by the whole list every time
+	std::unordered_multimap<std::uint64_t, PathStore::Id> listed;
+	listed.reserve(list.tracks.size());
+	list.tracks.each([&](std::span<PathStore::Id const> ids) {
+		for (auto const id : ids) { listed.emplace(store.hash(id), id); }
+		return true;
+	});
+	auto const id = [&](std::string_view path) {
+		auto [it, end] = listed.equal_range(store.hash(path));
+		while (it != end && !store.equals(it->second, path)) { ++it; }
+		return it != end ? it->second : store.add(path);
+	};
+	std::vector<PathStore::Id> ids;
+	ids.reserve(paths.size());
+	for (auto const& path : paths) { ids.push_back(id(path)); }
+	list.tracks = Tracks(ids);
+	m_versions[index] = {};
+	if (index != m_active) {
+		list.head = std::min(list.head, ids.empty() ? 0 : ids.size() - 1);
+	} else if (auto const found = find(m_path)) {
+		m_head = *found;
+	} else if (!m_path.empty()) {
+		m_head = std::min(m_head, size());
+		auto const current = id(m_path);
+		list.tracks = list.tracks.insert(m_head, std::span(&current, 1));
+	} else {
+		m_head = std::min(m_head, empty() ? 0 : size() - 1);
+	}
+	Log::info("[Player] Filled playlist [{}] with {} tracks", list.name, ids.size());
+	changed();
+	return *this;
+}
+
+Player& Player::selectList(std::size_t index) {
+	if (index >= m_lists.size() || index == m_active) { return *this; }
+	m_lists[m_active].head = m_head;
+	m_active = index;
+	Log::info("[Player] Switched to playlist [{}]", m_lists[m_active].name);
+	if (auto const found = find(m_path)) {
+		m_head = *found;
+		changed();
+		return *this;
+	}
+	bool const replay = playing();
+	stop();
+	m_head = std::min(m_lists[m_active].head, empty() ? 0 : size() - 1);
+	changed();
+	if (!empty()) { open(replay); }
 	return *this;
 }
 
 Player& Player::mode(Mode mode) {
 	if (m_mode != mode) {
 		m_mode = mode;
+		m_preloaded = false;
+		m_reprocess = m_resample = false;
+		m_decoder->request({});
+		m_pending = {};
+		m_samples.reset();
+		m_ramp.reset();
+		applyGain();
 		if (empty()) { return *this; }
 		auto const pos = m_music.position();
 		auto const replay = playing();
@@ -204,6 +648,194 @@ Player& Player::mode(Mode mode) {
 	return *this;
 }
 
+std::string Player::path(std::size_t index) const { return index < size() ? m_store->path(tracks()[index]) : std::string(); }
+
+std::string_view Player::directory(std::size_t index) const noexcept { return index < size() ? m_store->directory(tracks()[index]) : std::string_view(); }
+
+std::string_view Player::filename(std::size_t index) const noexcept { return index < size() ? m_store->filename(tracks()[index]) : std::string_view(); }
+
+std::vector<std::string> Player::paths(std::size_t first) const { return tracklist().paths(first); }
+
+Player::Tracklist Player::tracklist() const {
+	Tracklist ret{m_store, m_lists, m_active};
+	ret.lists[m_active].head = m_head;
+	return ret;
+}
+
+bool Player::undo() {
+	auto& versions = m_versions[m_active];
+	if (versions.undo.empty()) { return false; }
+	auto version = std::move(versions.undo.back());
+	versions.undo.pop_back();
+	versions.redo.push_back({tracks(), m_head});
+	Log::info("[Player] Undo: {} -> {} tracks", size(), version.tracks.size());
+	revert(std::move(version));
+	return true;
+}
+
+bool Player::redo() {
+	auto& versions = m_versions[m_active];
+	if (versions.redo.empty()) { return false; }
+	auto version = std::move(versions.redo.back());
+	versions.redo.pop_back();
+	versions.undo.push_back({tracks(), m_head});
+	Log::info("[Player] Redo: {} -> {} tracks", size(), version.tracks.size());
+	revert(std::move(version));
+	return true;
+}
+
+void Player::commit(Tracks tracks) {
+	auto& versions = m_versions[m_active];
+	versions.undo.push_back({std::move(m_lists[m_active].tracks), m_head});
+	versions.redo.clear();
+	m_lists[m_active].tracks = std::move(tracks);
+}
+
+void Player::revert(Version version) {
+	m_lists[m_active].tracks = std::move(version.tracks);
+	auto const current = [this](std::size_t index) { return !m_path.empty() && index < size() && m_store->equals(tracks()[index], m_path); };
+	// O(log n) while the current track is where it was when the version was made; otherwise it's searched for
+	if (current(version.head)) {
+		m_head = version.head;
+	} else if (auto const found = current(m_head) ? m_head : find(m_path)) {
+		m_head = *found;
+	} else {
+		bool const replay = playing();
+		stop();
+		m_head = std::min(version.head, empty() ? 0 : size() - 1);
+		changed();
+		if (!empty()) { open(replay); }
+		return;
+	}
+	changed();
+}
+
+std::vector<std::size_t> Player::sorted(std::span<std::size_t const> indices) const {
+	std::vector<std::size_t> ret;
+	ret.reserve(indices.size());
+	std::copy_if(indices.begin(), indices.end(), std::back_inserter(ret), [size = size()](std::size_t index) { return index < size; });
+	// usually sorted already (collected from the tracklist in order)
+	if (!std::is_sorted(ret.begin(), ret.end())) { std::sort(ret.begin(), ret.end()); }
+	ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+	return ret;
+}
+
+auto Player::partition(Tracks const& tracks, std::span<std::size_t const> indices) -> std::pair<Tracks, Tracks> {
+	std::size_t runs{};
+	for (std::size_t i = 0; i < indices.size(); ++i) {
+		if (i == 0 || indices[i] != indices[i - 1] + 1) { ++runs; }
+	}
+	// scattered across more runs than there are chunks: one walk rebuilding both sides beats slicing every run
+	if (runs > tracks.size() / Tracks::chunk_v) {
+		std::vector<PathStore::Id> kept;
+		std::vector<PathStore::Id> picked;
+		kept.reserve(tracks.size() - indices.size());
+		picked.reserve(indices.size());
+		auto next = indices.begin();
+		std::size_t index{};
+		tracks.each([&](std::span<PathStore::Id const> ids) {
+			for (auto const id : ids) {
+				if (next != indices.end() && *next == index) {
+					picked.push_back(id);
+					++next;
+				} else {
+					kept.push_back(id);
+				}
+				++index;
+			}
+			return true;
+		});
+		return {Tracks(kept), Tracks(picked)};
+	}
+	Tracks kept;
+	Tracks picked;
+	std::size_t from{};
+	for (std::size_t i = 0; i < indices.size();) {
+		auto const first = indices[i];
+		auto last = first + 1;
+		while (++i < indices.size() && indices[i] == last) { ++last; }
+		kept = Tracks::concat(kept, tracks.slice(from, first - from));
+		picked = Tracks::concat(picked, tracks.slice(first, last - first));
+		from = last;
+	}
+	return {Tracks::concat(kept, tracks.slice(from, tracks.size() - from)), std::move(picked)};
+}
+
+std::optional<std::size_t> Player::find(std::string_view path) const {
+	if (path.empty()) { return std::nullopt; }
+	std::size_t index{};
+	std::optional<std::size_t> ret;
+	tracks().each([&](std::span<PathStore::Id const> ids) {
+		for (auto const id : ids) {
+			if (m_store->equals(id, path)) {
+				ret = index;
+				return false;
+			}
+			++index;
+		}
+		return true;
+	});
+	return ret;
+}
+
+PathStore& Player::editStore() {
+	// created non-const by make_shared (here, in the constructor or in restore)
+	auto& store = const_cast<PathStore&>(*m_store);
+	// only this thread copies the pointer, so a count of one can't be raced up.
+	// Snapshots only read, and below their size: the fork shares the chunks and adds past them
+	if (m_store.use_count() > 1) { m_store = std::make_shared<PathStore>(store.fork()); }
+	return const_cast<PathStore&>(*m_store);
+}
+
+void Player::extract(std::span<std::string const> paths, capo::Music& music, std::vector<PathStore::Id>& out_ids) {
+	out_ids.reserve(out_ids.size() + paths.size());
+	for (std::string_view path : paths) {
+		if (path.empty()) { continue; }
+		auto const extIdx = path.find_last_of('.');
+		if (extIdx == std::string_view::npos) { continue; }
+		auto const ext = path.substr(extIdx);
+		if (ext == ".txt") {
+			Playlist list;
+			list.library = m_library;
+			if (auto loaded = list.load(path.data()); loaded > 0) {
+				Log::debug("[Player] loaded {} tracks from playlist [{}]", loaded, path);
+				extract(list.tracks, music, out_ids);
+			}
+		} else if (probe(path, music)) {
+			out_ids.push_back(editStore().add(path));
+			Log::info("[Player] Added [{}]", path);
+		} else {
+			Log::info("[Player] Skipped [{}]", path);
+		}
+	}
+}
+
+bool Player::probe(std::string_view path, capo::Music& music) {
+	auto meta = Library::Meta::stat(path);
+	if (!meta) { return false; }
+	// known and unchanged since last probe: skip the decoder
+	if (m_library) {
+		if (auto const entry = m_library->entry(m_library->find(path)); entry && entry->meta.sameFile(*meta)) { return true; }
+	} else if (auto it = m_known.find(std::string(path)); it != m_known.end() && it->second.sameFile(*meta)) {
+		m_added.push_back({std::string(path), {}});
+		return true;
+	}
+	if (!music.open(path)) { return false; }
+	meta->length = music.meta().length().count();
+	if (m_library) {
+		m_library->upsert(path, *meta);
+	} else {
+		m_known.insert_or_assign(std::string(path), *meta);
+		m_added.push_back({std::string(path), *meta});
+	}
+	return true;
+}
+
+void Player::changed() {
+	m_path = m_head < size() ? m_store->path(tracks()[m_head]) : std::string();
+	++m_revision;
+}
+
 void Player::transition(Status next) noexcept {
 	switch (m_status) {
 	case Status::eIdle: assert(next != Status::ePaused); break;
@@ -222,8 +854,149 @@ Player& Player::preloadFail(bool autoplay) {
 }
 
 bool Player::open() {
-	if (m_music.open(path())) { return true; }
+	m_preloaded = false;
+	m_reprocess = m_resample = false;
+	m_cued = false;
+	m_pending = {};
+	m_samples.reset();
+	m_ramp.reset();
+	if (m_music.open(path())) {
+		prepare(true);
+		if (m_mode == Mode::ePreload) {
+			m_readAhead->close();
+		} else {
+			m_readAhead->open(std::string(path()), m_music.meta().length().count());
+		}
+		if (m_mode == Mode::eHybrid) {
+			auto const& meta = m_music.meta();
+			auto const bytes = std::size_t(meta.length().count() * float(meta.sampleRate * meta.channels * sizeof(capo::PCM::Sample)));
+			m_decoder->request(bytes <= m_preloadLimit ? path() : std::string_view(), m_eq, m_analyse);
+		}
+		return true;
+	}
 	Log::error("[Player] Failed to open [{}]!", path());
 	return false;
 }
+
+std::optional<Library::Meta> Player::meta(std::string const& path) const {
+	if (m_library) {
+		if (auto const entry = m_library->entry(m_library->find(path))) { return entry->meta; }
+	} else if (auto it = m_known.find(path); it != m_known.end()) {
+		return it->second;
+	}
+	return std::nullopt;
+}
+
+void Player::prepare(bool seekHead) {
+	auto const known = meta(m_path);
+	m_loudness = known ? known->loudness : Loudness{};
+	m_trackGain = m_flags[Flag::eNormalize] ? m_loudness.gain() : 1.0f;
+	applyGain();
+	if (seekHead && m_flags[Flag::eTrimSilence] && m_loudness.head > 0.0f) { m_music.seek(capo::Time(m_loudness.head)); }
+}
+
+void Player::upgrade() {
+	if (!m_pending) {
+		// the next track may be cued instead
+		if (m_decoder->requested() != m_path) { return; }
+		m_pending = m_decoder->take();
+		if (!m_pending) { return; }
+	}
+	if (m_resample) {
+		m_samples = std::move(m_pending.samples);
+		m_pending = {};
+		m_reprocess = m_resample = false;
+		return;
+	}
+	// swapping what's playing cuts the waveform wherever it is: fade out first, and back in after
+	auto const now = GainRamp::Clock::now();
+	if (playing() && !m_ramp.silent(now)) {
+		m_ramp.down(now);
+		return;
+	}
+	auto decoded = std::exchange(m_pending, {});
+	m_reprocess = false;
+	// resume from wherever playback has got to by now
+	auto const position = m_music.position();
+	if (playing()) {
+		m_ramp.up(now);
+	} else {
+		m_ramp.reset();
+	}
+	if (!m_music.preload(std::move(*decoded.pcm))) {
+		Log::warn("[Player] Failed to upgrade [{}], continuing to stream", path());
+		m_preloaded = false;
+		m_samples.reset();
+		if (!m_music.open(path())) { return; }
+		applyGain();
+		m_music.seek(position);
+		if (playing()) { m_music.play(); }
+		return;
+	}
+	m_preloaded = true;
+	m_samples = std::move(decoded.samples);
+	m_readAhead->close();
+	applyGain();
+	m_music.seek(position);
+	if (playing()) { m_music.play(); }
+	Log::info("[Player] Upgraded [{}] to in-memory playback", path());
+}
+
+void Player::dropPending() {
+	// fading out (or faded out) for a swap that won't happen now: fade back in while the new render decodes
+	if (std::exchange(m_pending, {})) { m_ramp.up(GainRamp::Clock::now()); }
+}
+
+void Player::watchStream() {
+	static constexpr auto stall_v = std::chrono::milliseconds(150);
+	auto const now = std::chrono::steady_clock::now();
+	auto const position = m_music.position();
+	bool const streaming = m_mode != Mode::ePreload && !m_preloaded && playing() && m_music.state() == capo::State::ePlaying;
+	if (!streaming || position != m_stall.position) {
+		m_stall = {position, now, false};
+		if (streaming) { m_readAhead->advance(position.count()); }
+		return;
+	}
+	// playing but the cursor hasn't moved: the stream is starved
+	if (!m_stall.reported && now - m_stall.since > stall_v) {
+		Log::warn("[Player] Stream stalled at {:.2f}s [{}]", position.count(), path());
+		m_readAhead->underrun();
+		m_stall.reported = true;
+	}
+}
+
+capo::Time Player::remaining() const {
+	auto end = m_music.meta().length();
+	if (m_flags[Flag::eTrimSilence] && m_loudness.tail > 0.0f) { end = std::min(end, capo::Time(m_loudness.tail)); }
+	return end - m_music.position();
+}
+
+void Player::cue() {
+	m_cued = true;
+	// streaming reads the next track from disk either way; an in-memory track being (re)rendered still needs the decoder
+	if (isLastTrack() || m_mode == Mode::eStream || m_reprocess || (m_mode == Mode::eHybrid && !m_preloaded)) { return; }
+	auto next = m_store->path(tracks()[m_head + 1]);
+	if (m_mode == Mode::eHybrid) {
+		// estimated at this track's format: only worth decoding if open() would keep it
+		auto const known = meta(next);
+		auto const& current = m_music.meta();
+		if (!known || known->length * float(current.sampleRate * current.channels * sizeof(capo::PCM::Sample)) > float(m_preloadLimit)) { return; }
+	}
+	Log::debug("[Player] Cued [{}] {:.1f}s before the end", next, remaining().count());
+	m_decoder->request(next, m_eq, m_analyse);
+}
+
+void Player::listen() {
+	// resuming (or replaying after a stop) the same track is still the same listen
+	if (m_listen.active && m_listen.path == m_path) { return; }
+	if (m_listen.active) { m_events.push_back({Event::Type::eSkip, std::move(m_listen.path), m_listen.position.count()}); }
+	m_events.push_back({Event::Type::ePlay, m_path, 0.0f});
+	m_listen.path = m_path;
+	m_listen.position = {};
+	m_listen.active = true;
+}
+
+void Player::applyGain() {
+	if (!muted()) { m_music.gain(m_gain * m_trackGain * m_ramp.gain(GainRamp::Clock::now())); }
+}
 } // namespace jk
@@ -1,22 +1,109 @@
 #pragma once
+#include <app/decoder.hpp>
+#include <app/library.hpp>
+#include <app/loudness.hpp>
+#include <app/playlist.hpp>
+#include <app/read_ahead.hpp>
 #include <capo/capo.hpp>
+#include <ktl/enum_flags/enum_flags.hpp>
 #include <ktl/not_null.hpp>
+#include <misc/gain_ramp.hpp>
+#include <misc/path_store.hpp>
+#include <misc/rope.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace jk {
 class Player {
   public:
 	enum class Status { eIdle, ePlaying, ePaused, eStopped };
-	enum class Mode { eStream, ePreload };
+	enum class Mode { eStream, ePreload, eHybrid };
+	static constexpr std::size_t preload_limit_v = 512U * 1024U * 1024U;
+	static constexpr capo::Time cue_lead_v = capo::Time(10.0f);
+	static constexpr std::string_view default_list_v = "Playlist";
+	enum class Flag { eNormalize, eTrimSilence };
+	using Flags = ktl::enum_flags<Flag>;
 
-	Player(ktl::not_null<capo::Instance*> capo);
+	struct Added {
+		std::string path;
+		// set if probed (new or changed since known), for the owner to index
+		std::optional<Library::Meta> meta;
+	};
+
+	// Listening history: a play when a track starts, then a skip or completion when it's left
+	struct Event {
+		enum class Type { ePlay, eSkip, eComplete };
+		Type type{};
+		std::string path;
+		float seconds{}; // position reached
+	};
+
+	// Files changed on disk, by path
+	struct Changes {
+		std::vector<std::string> added;
+		std::vector<std::string> removed;
+		// every file under these is gone
+		std::vector<std::string> removedDirs;
+		// from, to
+		std::vector<std::pair<std::string, std::string>> renamed;
+
+		bool empty() const noexcept { return added.empty() && removed.empty() && removedDirs.empty() && renamed.empty(); }
+	};
+
+	// Persistent: copies and earlier versions (kept for undo) share all but what was edited since
+	using Tracks = Rope<PathStore::Id>;
+
+	// Playlists hold ids into one store of paths
+	struct List {
+		std::string name;
+		Tracks tracks{};
+		std::size_t head{}; // resumed from when made active again
+		std::string rule{}; // smart playlists: the owner evaluates it and fill()s in the matches
+	};
+
+	// Snapshot of the playlists, shareable with other threads; accessors are of the active playlist
+	struct Tracklist {
+		std::shared_ptr<PathStore const> store;
+		std::vector<List> lists;
+		std::size_t active{};
+
+		Tracks const& tracks() const noexcept { return lists[active].tracks; }
+		std::size_t size() const noexcept { return tracks().size(); }
+		bool empty() const noexcept { return tracks().empty(); }
+		std::string path(std::size_t index) const { return index < size() ? store->path(tracks()[index]) : std::string(); }
+		std::string_view directory(std::size_t index) const noexcept { return index < size() ? store->directory(tracks()[index]) : std::string_view(); }
+		std::string_view filename(std::size_t index) const noexcept { return index < size() ? store->filename(tracks()[index]) : std::string_view(); }
+		std::vector<std::string> paths(std::size_t first = 0) const;
+		// Every playlist, as named sections
+		Playlist playlists() const;
+	};
+
+	// Without a library the player doesn't index tracks itself: the owner passes in what it knows with known(),
+	// and picks up added tracks with takeAdded()
+	Player(ktl::not_null<capo::Instance*> capo, Library* library = {});
 
 	bool add(std::span<std::string const> paths);
 	bool push(std::string path, bool autoplay);
-	bool pop(std::string_view path) noexcept;
-	bool pop() noexcept;
+	bool pop(std::size_t index);
+	bool pop();
+	// Bulk edits take indices in any order (duplicates and out of range ones are ignored) and apply them in one pass;
+	// the current track keeps playing wherever it ends up. Each returns the number of tracks moved / removed
+	std::size_t pop(std::span<std::size_t const> indices);
+	// Moves the tracks, in playlist order, to before position (an index of the playlist as it was)
+	std::size_t move(std::span<std::size_t const> indices, std::size_t position);
+	// Moves the tracks (other than the current one) to right after the current one
+	std::size_t playNext(std::span<std::size_t const> indices);
+	// Removes repeats of the same path among the tracks, keeping the current track or else the first
+	std::size_t dedupe(std::span<std::size_t const> indices);
 	bool open(bool autoplay);
 	void clear();
+	// Replace every playlist without probing (one per section, if any); the next play() resumes from position
+	Player& restore(Playlist const& playlists, std::size_t active, std::size_t head, capo::Time position);
 
 	Player& play();
 	Player& pause();
@@ -27,7 +114,19 @@ class Player {
 	Player& mute();
 	Player& unmute();
 	bool muted() const noexcept { return m_cachedGain > 0.0f; }
+	float trackGain() const noexcept { return m_trackGain; }
 	void update();
+	// Time until update() next needs to run: the cue point, then the end of the track (or its trimmed tail)
+	capo::Time due() const;
+
+	Player& flag(Flag flag, bool set);
+	bool flag(Flag flag) const noexcept { return m_flags[flag]; }
+	// Re-read the current track's loudness from the library
+	Player& refresh();
+	// Without a library: metadata to skip re-probing unchanged files, and loudness to normalize / trim by
+	Player& known(std::string path, Library::Meta const& meta);
+	std::vector<Added> takeAdded() { return std::exchange(m_added, {}); }
+	std::vector<Event> takeEvents() { return std::exchange(m_events, {}); }
 
 	Player& navFirst();
 	Player& navLast();
@@ -35,36 +134,172 @@ class Player {
 	Player& navPrev();
 	Player& navIndex(std::size_t index);
 
-	Player& swapTracks(std::size_t lhs, std::size_t rhs) noexcept;
-	Player& swapHead(std::size_t target) noexcept { return swapTracks(m_head, target); }
-	Player& swapAhead() noexcept { return swapHead(m_head + 1); }
-	Player& swapBehind() noexcept { return m_head > 0 ? swapHead(m_head - 1) : *this; }
+	Player& swapTracks(std::size_t lhs, std::size_t rhs);
+	Player& swapHead(std::size_t target) { return swapTracks(m_head, target); }
+	Player& swapAhead() { return swapHead(m_head + 1); }
+	Player& swapBehind() { return m_head > 0 ? swapHead(m_head - 1) : *this; }
+	// Applies files changed on disk to every track of the active playlist with a changed path, in one pass: moved files keep
+	// their place (not an edit to undo), removed ones are dropped, and new ones (or moved in from elsewhere) not listed yet are added
+	Player& watched(Changes const& changes);
+
+	// Appends an empty playlist
+	Player& newList(std::string name);
+	// O(1): the copy shares the tracks until either is edited; a copy of a smart playlist is a plain one
+	Player& copyList(std::size_t index, std::string name);
+	// The last playlist is cleared rather than closed; closed ones are kept (with their undo history) to reopen
+	Player& closeList(std::size_t index);
+	// Reopens the most recently closed playlist where it was, and makes it active
+	bool reopenList();
+	bool canReopen() const noexcept { return !m_closed.empty(); }
+	Player& renameList(std::size_t index, std::string name);
+	// An empty rule turns a smart playlist back into a plain one, keeping its tracks
+	Player& ruleList(std::size_t index, std::string rule);
+	// Replaces a smart playlist's tracks (if its rule is still rule) without probing; can't be undone.
+	// The current track is kept where it was even if it no longer matches, rather than cut off
+	Player& fill(std::size_t index, std::string_view rule, std::span<std::string const> paths);
+	// Plays from (and edits) index from now on, without probing anything:
+	// carries on with the current track if the playlist has it, else resumes the playlist where it was left
+	Player& selectList(std::size_t index);
+	std::size_t activeList() const noexcept { return m_active; }
+	std::size_t lists() const noexcept { return m_lists.size(); }
+
+	// Every edit of a playlist's tracks (other than renames of moved files) can be undone, per playlist and without limit
+	bool undo();
+	bool redo();
+	bool canUndo() const noexcept { return !m_versions[m_active].undo.empty(); }
+	bool canRedo() const noexcept { return !m_versions[m_active].redo.empty(); }
 
 	Player& mode(Mode mode);
 	Mode mode() const noexcept { return m_mode; }
+	// Tracks estimated to decode larger than this keep streaming in hybrid mode
+	Player& preloadLimit(std::size_t bytes) noexcept { return (m_preloadLimit = bytes, *this); }
+	std::size_t preloadLimit() const noexcept { return m_preloadLimit; }
+	bool preloaded() const noexcept { return m_preloaded; }
+	// In-memory modes start decoding the next track this long before the current one ends
+	Player& cueLead(capo::Time lead) noexcept { return (m_cueLead = lead, *this); }
+	capo::Time cueLead() const noexcept { return m_cueLead; }
+	// Applied to in-memory tracks (preload / hybrid) only: streamed tracks play without it. A playing track is re-rendered
+	// in the background and swapped in at the current position, faded out and back in around the swap (see GainRamp)
+	Player& equalizer(Equalizer::Preset const& preset);
+	Equalizer::Preset const& equalizer() const noexcept { return m_eq; }
+	// Keep a copy of the in-memory (rendered) track for analysers; streamed tracks have none
+	Player& analyse(bool on);
+	bool analysing() const noexcept { return m_analyse; }
+	std::shared_ptr<SampleStore const> const& samples() const noexcept { return m_samples; }
+	// Active while streaming (stream mode, or hybrid until upgraded)
+	ReadAhead& readAhead() noexcept { return *m_readAhead; }
+	ReadAhead const& readAhead() const noexcept { return *m_readAhead; }
 
 	capo::Music const& music() const noexcept { return m_music; }
-	std::span<std::string const> paths() const noexcept { return m_paths; }
 	std::size_t head() const noexcept { return m_head; }
-	std::string_view path() const noexcept { return m_head < m_paths.size() ? m_paths[m_head] : std::string_view(); }
-	bool empty() const noexcept { return m_paths.empty(); }
-	std::size_t size() const noexcept { return m_paths.size(); }
-	bool isFirstTrack() const noexcept { return !m_paths.empty() && m_head == 0; }
-	bool isLastTrack() const noexcept { return m_head + 1 == m_paths.size(); }
+	// Current track
+	std::string_view path() const noexcept { return m_path; }
+	std::string path(std::size_t index) const;
+	// Valid until the next restore(): the store's chunks never move
+	std::string_view directory(std::size_t index) const noexcept;
+	std::string_view filename(std::size_t index) const noexcept;
+	std::vector<std::string> paths(std::size_t first = 0) const;
+	Tracklist tracklist() const;
+	bool empty() const noexcept { return tracks().empty(); }
+	std::size_t size() const noexcept { return tracks().size(); }
+	bool isFirstTrack() const noexcept { return !empty() && m_head == 0; }
+	bool isLastTrack() const noexcept { return m_head + 1 == size(); }
 	Status status() const noexcept { return m_status; }
 	bool playing() const noexcept { return status() == Status::ePlaying; }
+	// Bumped whenever a playlist changes
+	std::uint64_t revision() const noexcept { return m_revision; }
 
   private:
+	struct Version {
+		Tracks tracks{};
+		std::size_t head{};
+	};
+	struct Versions {
+		std::vector<Version> undo;
+		std::vector<Version> redo;
+	};
+	struct Closed {
+		List list;
+		Versions versions;
+		std::size_t index{};
+	};
+
+	Tracks const& tracks() const noexcept { return m_lists[m_active].tracks; }
+	// Replaces the active playlist's tracks, keeping the previous version to undo to
+	void commit(Tracks tracks);
+	// Switches to an undo / redo version, keeping the current track if it has it
+	void revert(Version version);
+	// Sorted, unique and in range
+	std::vector<std::size_t> sorted(std::span<std::size_t const> indices) const;
+	// Splits into the tracks not at indices (sorted) and those at them, both in order: slices runs in O(runs * log n), or walks once if scattered
+	static std::pair<Tracks, Tracks> partition(Tracks const& tracks, std::span<std::size_t const> indices);
+	std::optional<std::size_t> find(std::string_view path) const;
+	// Copy on write: forks the store (a pointer per chunk) if snapshots still share it, then adds in place
+	PathStore& editStore();
+	void extract(std::span<std::string const> paths, capo::Music& music, std::vector<PathStore::Id>& out_ids);
+	bool probe(std::string_view path, capo::Music& music);
+	std::optional<Library::Meta> meta(std::string const& path) const;
+	void changed();
 	void transition(Status next) noexcept;
 	Player& preloadFail(bool autoplay);
 	bool open();
+	void prepare(bool seekHead);
+	void applyGain();
+	void upgrade();
+	void dropPending();
+	void watchStream();
+	capo::Time remaining() const;
+	void cue();
+	void listen();
 
 	capo::Music m_music;
-	std::vector<std::string> m_paths;
+	std::unique_ptr<Decoder> m_decoder;
+	std::unique_ptr<ReadAhead> m_readAhead;
+	std::shared_ptr<PathStore const> m_store;
+	// m_head is the active playlist's head: its List::head is only updated when switching away
+	std::vector<List> m_lists;
+	std::vector<Versions> m_versions; // one per playlist
+	std::vector<Closed> m_closed;	  // most recent last
+	std::size_t m_active{};
+	std::string m_path;
 	ktl::not_null<capo::Instance*> m_capo;
+	Library* m_library{};
+	std::unordered_map<std::string, Library::Meta> m_known;
+	std::vector<Added> m_added;
+	std::vector<Event> m_events;
 	std::size_t m_head{};
+	std::uint64_t m_revision{};
+	capo::Time m_resume{};
+	Loudness m_loudness;
+	Equalizer::Preset m_eq;
+	float m_gain = 1.0f;
+	float m_trackGain = 1.0f;
 	float m_cachedGain = -1.0f;
+	std::size_t m_preloadLimit = preload_limit_v;
+	capo::Time m_cueLead = cue_lead_v;
+	// decoded for the current track, held while the ramp fades out to swap it in
+	Decoder::Decoded m_pending;
+	// what's playing from memory, if analysing
+	std::shared_ptr<SampleStore const> m_samples;
+	GainRamp m_ramp;
+	struct {
+		capo::Time position{};
+		std::chrono::steady_clock::time_point since{};
+		bool reported{};
+	} m_stall;
+	struct {
+		std::string path;
+		capo::Time position{};
+		bool active{};
+	} m_listen;
 	Status m_status{};
 	Mode m_mode = Mode::eStream;
+	Flags m_flags;
+	bool m_preloaded{};
+	bool m_reprocess{};
+	// the current track is being re-rendered only for its samples: nothing to swap
+	bool m_resample{};
+	bool m_analyse{};
+	bool m_cued{};
 };
 } // namespace jk
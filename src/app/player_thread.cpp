@@ -0,0 +1,462 @@
+#include <app/player_thread.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <misc/mpsc_queue.hpp>
+#include <misc/triple_buffer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <semaphore>
+#include <variant>
+
+namespace jk {
+using namespace std::chrono_literals;
+
+struct PlayerThread::Command {
+	enum class Op {
+		ePlay,
+		ePause,
+		eStop,
+		ePlayPause,
+		eNext,
+		ePrev,
+		eSeek,
+		eSeekTo,
+		eGain,
+		eVolume,
+		eMute,
+		eSwapAhead,
+		eSwapBehind,
+		eClear,
+		eUndo,
+		eRedo,
+		eMode,
+		eFlag,
+		ePreloadLimit,
+		eCueLead,
+		eEqualizer,
+		eAnalyse,
+		eStream,
+		eSelect,
+		eEdit,
+		eWatched,
+		eMove,
+		ePlayNext,
+		eDedupe,
+		eAdd,
+		eRestore,
+		eKnown,
+		eNewList,
+		eCopyList,
+		eCloseList,
+		eReopenList,
+		eRenameList,
+		eRuleList,
+		eFill,
+		eSelectList,
+	};
+
+	struct Known {
+		std::vector<std::string> paths;
+		std::vector<Library::Meta> metas;
+	};
+	struct Fill {
+		std::string rule;
+		std::vector<std::string> paths;
+	};
+	// what the op carries beyond the scalars, if anything: paths (eAdd), indices (eMove etc), a name or rule (lists)...
+	using Payload = std::variant<std::monostate, std::vector<std::string>, std::vector<std::size_t>, std::string, Known, Fill, Playlist, Edit, Player::Changes,
+								 Equalizer::Preset, ReadAhead::Config>;
+
+	Op op{};
+	float value{};
+	std::size_t index{};
+	std::size_t list{};
+	std::uint64_t revision{};
+	Payload payload{};
+
+	// Deltas the controller coalesces anyway: the only commands dropped when the queue is full
+	bool droppable() const noexcept { return op == Op::eGain || op == Op::eVolume || op == Op::eSeek || op == Op::eSeekTo; }
+
+	template <typename T>
+	T& get() {
+		return std::get<T>(payload);
+	}
+};
+
+struct PlayerThread::Shared {
+	Player player;
+	MpscQueue<Command, capacity_v> queue;
+	TripleBuffer<State> states;
+	struct {
+		std::vector<Player::Added> added;
+		std::vector<Player::Event> events;
+		std::mutex mutex;
+	} outbox;
+	// commands that didn't fit in the queue: while active, every command goes here so order is kept
+	struct {
+		std::vector<Command> commands;
+		std::mutex mutex;
+		std::atomic<bool> active{};
+	} overflow;
+	// drained from overflow, kept for its capacity
+	std::vector<Command> spilled;
+	std::shared_ptr<Player::Tracklist const> tracks;
+	std::uint64_t tracksRevision{};
+	std::counting_semaphore<> wake{0};
+	std::atomic<bool> signalled{};
+	std::atomic<bool> stop{};
+	std::atomic<std::uint64_t> dropped{};
+
+	explicit Shared(ktl::not_null<capo::Instance*> capo) : player(capo) {}
+
+	void run() {
+		while (!stop.load()) {
+			// wakes right as the player is due (end of track, cue point) rather than on the next tick
+			auto const due = std::min(player.due(), capo::Time(tick_v));
+			(void)wake.try_acquire_for(std::max(std::chrono::duration_cast<std::chrono::microseconds>(due), min_wait_v));
+			tick();
+		}
+	}
+
+	void tick() {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		signalled.store(false);
+		while (auto command = queue.pop()) { apply(*command); }
+		// everything in the queue was pushed before the overflow became active
+		if (overflow.active.load()) {
+			{
+				auto lock = std::scoped_lock(overflow.mutex);
+				std::swap(spilled, overflow.commands);
+				overflow.active.store(false);
+			}
+			for (auto& command : spilled) { apply(command); }
+			spilled.clear();
+		}
+		player.update();
+		auto added = player.takeAdded();
+		auto events = player.takeEvents();
+		if (!added.empty() || !events.empty()) {
+			auto lock = std::scoped_lock(outbox.mutex);
+			std::move(added.begin(), added.end(), std::back_inserter(outbox.added));
+			std::move(events.begin(), events.end(), std::back_inserter(outbox.events));
+		}
+		publish();
+	}
+
+	void publish() {
+		if (!tracks || tracksRevision != player.revision()) {
+			tracks = std::make_shared<Player::Tracklist const>(player.tracklist());
+			tracksRevision = player.revision();
+		}
+		auto& state = states.back();
+		state.tracks = tracks;
+		state.path.assign(player.path());
+		state.revision = tracksRevision;
+		state.head = player.head();
+		state.position = player.music().position();
+		state.length = player.music().meta().length();
+		state.gain = player.gain();
+		state.trackGain = player.trackGain();
+		state.preloadLimit = player.preloadLimit();
+		state.stream = player.readAhead().stats();
+		state.streamConfig = player.readAhead().config();
+		state.status = player.status();
+		state.mode = player.mode();
+		state.flags.assign(Player::Flag::eNormalize, player.flag(Player::Flag::eNormalize));
+		state.flags.assign(Player::Flag::eTrimSilence, player.flag(Player::Flag::eTrimSilence));
+		state.muted = player.muted();
+		state.preloaded = player.preloaded();
+		state.canUndo = player.canUndo();
+		state.canRedo = player.canRedo();
+		state.canReopen = player.canReopen();
+		state.samples = player.samples();
+		states.publish();
+	}
+
+	void next() {
+		if (player.isLastTrack()) {
+			player.navFirst();
+		} else {
+			player.navNext();
+		}
+	}
+
+	bool current(Command const& command) const {
+		if (command.revision == player.revision()) { return true; }
+		Log::warn("[PlayerThread] Dropped command for tracklist revision {} (now {})", command.revision, player.revision());
+		return false;
+	}
+
+	void apply(Command& command) {
+		using Op = Command::Op;
+		switch (command.op) {
+		case Op::ePlay: player.play(); break;
+		case Op::ePause: player.pause(); break;
+		case Op::eStop: player.stop(); break;
+		case Op::ePlayPause:
+			if (player.playing()) {
+				player.pause();
+			} else {
+				player.play();
+			}
+			break;
+		case Op::eNext: next(); break;
+		case Op::ePrev:
+			if (player.isFirstTrack() || player.music().position() > 2s) {
+				player.seek({});
+			} else {
+				player.navPrev();
+			}
+			break;
+		case Op::eSeek: {
+			auto const delta = capo::Time(command.value);
+			auto const remain = player.music().meta().length() - player.music().position();
+			if (delta >= remain) {
+				if (player.isLastTrack()) {
+					player.stop();
+				} else {
+					next();
+				}
+			}
+			player.seek(player.music().position() + delta);
+			break;
+		}
+		case Op::eSeekTo: player.seek(capo::Time(command.value)); break;
+		case Op::eGain: player.gain(std::clamp(command.value, 0.0f, 1.0f)); break;
+		case Op::eVolume: player.gain(std::clamp(player.gain() + command.value, 0.0f, 1.0f)); break;
+		case Op::eMute:
+			if (player.muted()) {
+				player.unmute();
+			} else {
+				player.mute();
+			}
+			break;
+		case Op::eSwapAhead: player.swapAhead(); break;
+		case Op::eSwapBehind: player.swapBehind(); break;
+		case Op::eClear: player.clear(); break;
+		case Op::eUndo: player.undo(); break;
+		case Op::eRedo: player.redo(); break;
+		case Op::eMode: player.mode(Player::Mode(command.index)); break;
+		case Op::eFlag: player.flag(Player::Flag(command.index), command.value != 0.0f); break;
+		case Op::ePreloadLimit: player.preloadLimit(command.index); break;
+		case Op::eCueLead: player.cueLead(capo::Time(command.value)); break;
+		case Op::eEqualizer: player.equalizer(command.get<Equalizer::Preset>()); break;
+		case Op::eAnalyse: player.analyse(command.value != 0.0f); break;
+		case Op::eStream: player.readAhead().config(command.get<ReadAhead::Config>()); break;
+		case Op::eSelect:
+			if (!current(command)) { break; }
+			player.navIndex(command.index);
+			if (!player.playing()) { player.play(); }
+			break;
+		case Op::eEdit:
+			if (current(command)) { player.pop(command.get<Edit>().removed); }
+			break;
+		case Op::eWatched: player.watched(command.get<Player::Changes>()); break;
+		case Op::eMove:
+			if (current(command)) { player.move(command.get<std::vector<std::size_t>>(), command.index); }
+			break;
+		case Op::ePlayNext:
+			if (current(command)) { player.playNext(command.get<std::vector<std::size_t>>()); }
+			break;
+		case Op::eDedupe:
+			if (current(command)) { player.dedupe(command.get<std::vector<std::size_t>>()); }
+			break;
+		case Op::eAdd: {
+			bool const empty = player.empty();
+			if (player.add(command.get<std::vector<std::string>>()) && empty && command.value != 0.0f) { player.play(); }
+			break;
+		}
+		case Op::eRestore: player.restore(command.get<Playlist>(), command.list, command.index, capo::Time(command.value)); break;
+		case Op::eKnown: {
+			auto& known = command.get<Command::Known>();
+			for (std::size_t i = 0; i < known.paths.size() && i < known.metas.size(); ++i) { player.known(std::move(known.paths[i]), known.metas[i]); }
+			break;
+		}
+		case Op::eNewList:
+			player.newList(std::move(command.get<std::string>()));
+			player.selectList(player.lists() - 1);
+			break;
+		case Op::eCopyList:
+			if (!current(command)) { break; }
+			player.copyList(command.index, std::move(command.get<std::string>()));
+			player.selectList(player.lists() - 1);
+			break;
+		case Op::eCloseList:
+			if (current(command)) { player.closeList(command.index); }
+			break;
+		case Op::eReopenList: player.reopenList(); break;
+		case Op::eRenameList:
+			if (current(command)) { player.renameList(command.index, std::move(command.get<std::string>())); }
+			break;
+		case Op::eRuleList:
+			if (current(command)) { player.ruleList(command.index, std::move(command.get<std::string>())); }
+			break;
+		case Op::eFill: {
+			// matched against the list's rule rather than the revision: the tracklist changes between fills
+			auto const& fill = command.get<Command::Fill>();
+			player.fill(command.index, fill.rule, fill.paths);
+			break;
+		}
+		case Op::eSelectList:
+			if (current(command)) { player.selectList(command.index); }
+			break;
+		}
+	}
+};
+
+PlayerThread::PlayerThread(ktl::not_null<capo::Instance*> capo, Drive drive) : m_shared(std::make_unique<Shared>(capo)), m_drive(drive) {
+	// nothing else is running yet: the first snapshot is published from here
+	m_shared->publish();
+	m_state = &m_shared->states.front();
+	if (m_drive == Drive::eThread) { m_thread = ktl::kthread([shared = m_shared.get()]() { shared->run(); }); }
+}
+
+PlayerThread::~PlayerThread() noexcept {
+	m_shared->stop.store(true);
+	m_shared->wake.release();
+	m_thread.join();
+}
+
+void PlayerThread::sync() {
+	if (m_drive == Drive::eCaller) { m_shared->tick(); }
+	m_state = &m_shared->states.front();
+	if (auto const drops = dropped(); drops != m_reported) {
+		Log::warn("[PlayerThread] Dropped {} volume and seek commands (queue full)", drops - m_reported);
+		m_reported = drops;
+	}
+}
+
+std::vector<Player::Added> PlayerThread::added() {
+	std::vector<Player::Added> ret;
+	auto lock = std::scoped_lock(m_shared->outbox.mutex);
+	std::swap(ret, m_shared->outbox.added);
+	return ret;
+}
+
+std::vector<Player::Event> PlayerThread::events() {
+	std::vector<Player::Event> ret;
+	auto lock = std::scoped_lock(m_shared->outbox.mutex);
+	std::swap(ret, m_shared->outbox.events);
+	return ret;
+}
+
+std::uint64_t PlayerThread::dropped() const noexcept { return m_shared->dropped.load(std::memory_order_relaxed); }
+
+void PlayerThread::play() { push({.op = Command::Op::ePlay}); }
+void PlayerThread::pause() { push({.op = Command::Op::ePause}); }
+void PlayerThread::stop() { push({.op = Command::Op::eStop}); }
+void PlayerThread::playPause() { push({.op = Command::Op::ePlayPause}); }
+void PlayerThread::next() { push({.op = Command::Op::eNext}); }
+void PlayerThread::prev() { push({.op = Command::Op::ePrev}); }
+void PlayerThread::seek(capo::Time delta) { push({.op = Command::Op::eSeek, .value = delta.count()}); }
+void PlayerThread::seekTo(capo::Time stamp) { push({.op = Command::Op::eSeekTo, .value = stamp.count()}); }
+void PlayerThread::gain(float gain) { push({.op = Command::Op::eGain, .value = gain}); }
+void PlayerThread::volume(float delta) { push({.op = Command::Op::eVolume, .value = delta}); }
+void PlayerThread::muteUnmute() { push({.op = Command::Op::eMute}); }
+void PlayerThread::swapAhead() { push({.op = Command::Op::eSwapAhead}); }
+void PlayerThread::swapBehind() { push({.op = Command::Op::eSwapBehind}); }
+void PlayerThread::clear() { push({.op = Command::Op::eClear}); }
+void PlayerThread::undo() { push({.op = Command::Op::eUndo}); }
+void PlayerThread::redo() { push({.op = Command::Op::eRedo}); }
+void PlayerThread::mode(Player::Mode mode) { push({.op = Command::Op::eMode, .index = std::size_t(mode)}); }
+void PlayerThread::flag(Player::Flag flag, bool set) { push({.op = Command::Op::eFlag, .value = set ? 1.0f : 0.0f, .index = std::size_t(flag)}); }
+void PlayerThread::preloadLimit(std::size_t bytes) { push({.op = Command::Op::ePreloadLimit, .index = bytes}); }
+void PlayerThread::cueLead(capo::Time lead) { push({.op = Command::Op::eCueLead, .value = lead.count()}); }
+void PlayerThread::equalizer(Equalizer::Preset const& preset) { push({.op = Command::Op::eEqualizer, .payload = preset}); }
+void PlayerThread::analyse(bool on) { push({.op = Command::Op::eAnalyse, .value = on ? 1.0f : 0.0f}); }
+void PlayerThread::stream(ReadAhead::Config const& config) { push({.op = Command::Op::eStream, .payload = config}); }
+
+void PlayerThread::select(std::size_t index, std::uint64_t revision) { push({.op = Command::Op::eSelect, .index = index, .revision = revision}); }
+
+void PlayerThread::edit(Edit edit, std::uint64_t revision) {
+	if (edit.empty()) { return; }
+	push({.op = Command::Op::eEdit, .revision = revision, .payload = std::move(edit)});
+}
+
+void PlayerThread::watched(Player::Changes changes) {
+	if (changes.empty()) { return; }
+	push({.op = Command::Op::eWatched, .payload = std::move(changes)});
+}
+
+void PlayerThread::move(std::vector<std::size_t> indices, std::size_t position, std::uint64_t revision) {
+	if (indices.empty()) { return; }
+	push({.op = Command::Op::eMove, .index = position, .revision = revision, .payload = std::move(indices)});
+}
+
+void PlayerThread::playNext(std::vector<std::size_t> indices, std::uint64_t revision) {
+	if (indices.empty()) { return; }
+	push({.op = Command::Op::ePlayNext, .revision = revision, .payload = std::move(indices)});
+}
+
+void PlayerThread::dedupe(std::vector<std::size_t> indices, std::uint64_t revision) {
+	if (indices.empty()) { return; }
+	push({.op = Command::Op::eDedupe, .revision = revision, .payload = std::move(indices)});
+}
+
+void PlayerThread::add(std::vector<std::string> paths, bool autoplay) {
+	if (paths.empty()) { return; }
+	push({.op = Command::Op::eAdd, .value = autoplay ? 1.0f : 0.0f, .payload = std::move(paths)});
+}
+
+void PlayerThread::restore(Playlist playlists, std::size_t active, std::size_t head, capo::Time position) {
+	push({.op = Command::Op::eRestore, .value = position.count(), .index = head, .list = active, .payload = std::move(playlists)});
+}
+
+void PlayerThread::newList(std::string name) { push({.op = Command::Op::eNewList, .payload = std::move(name)}); }
+
+void PlayerThread::copyList(std::size_t index, std::string name, std::uint64_t revision) {
+	push({.op = Command::Op::eCopyList, .index = index, .revision = revision, .payload = std::move(name)});
+}
+
+void PlayerThread::closeList(std::size_t index, std::uint64_t revision) { push({.op = Command::Op::eCloseList, .index = index, .revision = revision}); }
+
+void PlayerThread::reopenList() { push({.op = Command::Op::eReopenList}); }
+
+void PlayerThread::renameList(std::size_t index, std::string name, std::uint64_t revision) {
+	push({.op = Command::Op::eRenameList, .index = index, .revision = revision, .payload = std::move(name)});
+}
+
+void PlayerThread::ruleList(std::size_t index, std::string rule, std::uint64_t revision) {
+	push({.op = Command::Op::eRuleList, .index = index, .revision = revision, .payload = std::move(rule)});
+}
+
+void PlayerThread::fill(std::size_t index, std::string rule, std::vector<std::string> paths) {
+	push({.op = Command::Op::eFill, .index = index, .payload = Command::Fill{std::move(rule), std::move(paths)}});
+}
+
+void PlayerThread::selectList(std::size_t index, std::uint64_t revision) { push({.op = Command::Op::eSelectList, .index = index, .revision = revision}); }
+
+void PlayerThread::known(std::vector<std::string> paths, std::vector<Library::Meta> metas) {
+	if (paths.empty()) { return; }
+	push({.op = Command::Op::eKnown, .payload = Command::Known{std::move(paths), std::move(metas)}});
+}
+
+bool PlayerThread::spill(Command& command) {
+	auto& overflow = m_shared->overflow;
+	if (!overflow.active.load()) { return false; }
+	auto lock = std::scoped_lock(overflow.mutex);
+	// the thread may have drained it since
+	if (!overflow.active.load()) { return false; }
+	overflow.commands.push_back(std::move(command));
+	return true;
+}
+
+void PlayerThread::push(Command command) {
+	auto& shared = *m_shared;
+	// driven by the caller: nothing else drains the queue, and dropping would make replays diverge
+	if (m_drive == Drive::eCaller && shared.queue.full()) { shared.tick(); }
+	if (!spill(command) && !shared.queue.push(std::move(command))) {
+		if (command.droppable()) {
+			shared.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		auto lock = std::scoped_lock(shared.overflow.mutex);
+		shared.overflow.commands.push_back(std::move(command));
+		shared.overflow.active.store(true);
+	}
+	// at most one wake pending: the thread clears signalled before draining
+	if (!shared.signalled.exchange(true)) { shared.wake.release(); }
+}
+} // namespace jk
@@ -0,0 +1,153 @@
+#pragma once
+#include <app/player.hpp>
+#include <ktl/async/kthread.hpp>
+#include <ktl/not_null.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Runs a Player (and its capo::Music) on a dedicated control thread
+///
+/// The UI queues commands, applied in order on the next tick, and reads the State published after every tick.
+/// Ticks run at least every tick_v, when a command arrives, and as the player is due (cue point, end of track),
+/// so track changes don't wait on the UI's frame rate or on polling.
+/// Neither side waits on the other for long: a full queue spills commands to an overflow list (applied after it, in order),
+/// except volume, gain and seek deltas which are dropped, and state() is the latest snapshot.
+/// The player here has no library, which stays on the UI thread: pass in what it knows with known(),
+/// and index the tracks it probes from added().
+/// Drive::eCaller runs no thread: sync() applies the queue and publishes, so a replayed frame sees exactly its own commands.
+///
+class PlayerThread {
+  public:
+	enum class Drive : std::uint8_t { eThread, eCaller };
+
+	static constexpr auto tick_v = std::chrono::milliseconds(10);
+	// floor while a track drains past its nominal end
+	static constexpr auto min_wait_v = std::chrono::microseconds(500);
+	static constexpr std::size_t capacity_v = 256;
+
+	struct State {
+		// shared by every snapshot of the same revision
+		std::shared_ptr<Player::Tracklist const> tracks;
+		std::string path;
+		std::uint64_t revision{};
+		std::size_t head{};
+		capo::Time position{};
+		capo::Time length{};
+		float gain{};
+		// normalization
+		float trackGain{};
+		std::size_t preloadLimit{};
+		ReadAhead::Stats stream{};
+		ReadAhead::Config streamConfig{};
+		Player::Status status{};
+		Player::Mode mode{};
+		Player::Flags flags;
+		bool muted{};
+		bool preloaded{};
+		bool canUndo{};
+		bool canRedo{};
+		bool canReopen{};
+		// the rendered track, while analysing and playing from memory
+		std::shared_ptr<SampleStore const> samples;
+
+		bool playing() const noexcept { return status == Player::Status::ePlaying; }
+		bool flag(Player::Flag flag) const noexcept { return flags[flag]; }
+		bool empty() const noexcept { return tracks->empty(); }
+		std::size_t size() const noexcept { return tracks->size(); }
+	};
+
+	// Index based changes to the tracklist, applied together
+	struct Edit {
+		std::vector<std::size_t> removed{};
+
+		bool empty() const noexcept { return removed.empty(); }
+	};
+
+	explicit PlayerThread(ktl::not_null<capo::Instance*> capo, Drive drive = Drive::eThread);
+	PlayerThread& operator=(PlayerThread&&) = delete;
+	~PlayerThread() noexcept;
+
+	// UI thread: moves state() to the latest snapshot (ticking the player first if driven by the caller); call once per frame
+	void sync();
+	State const& state() const noexcept { return *m_state; }
+	// UI thread: tracks added since the last call
+	std::vector<Player::Added> added();
+	// UI thread: plays, skips and completions since the last call, in order
+	std::vector<Player::Event> events();
+	// volume and seek deltas dropped for a full queue
+	std::uint64_t dropped() const noexcept;
+
+	void play();
+	void pause();
+	void stop();
+	void playPause();
+	// Wraps around at the end
+	void next();
+	// Restarts the track if past the first couple of seconds
+	void prev();
+	// Relative: moves on to the next track if delta runs past the end
+	void seek(capo::Time delta);
+	void seekTo(capo::Time stamp);
+	void gain(float gain);
+	void volume(float delta);
+	void muteUnmute();
+	void swapAhead();
+	void swapBehind();
+	void clear();
+	// Of the active playlist
+	void undo();
+	void redo();
+	void mode(Player::Mode mode);
+	void flag(Player::Flag flag, bool set);
+	void preloadLimit(std::size_t bytes);
+	void cueLead(capo::Time lead);
+	void equalizer(Equalizer::Preset const& preset);
+	// Publish the rendered track in State::samples (in-memory tracks only)
+	void analyse(bool on);
+	void stream(ReadAhead::Config const& config);
+
+	// Index based commands are dropped if the tracklist has moved on from revision
+	void select(std::size_t index, std::uint64_t revision);
+	void edit(Edit edit, std::uint64_t revision);
+	// Bulk edits of the active playlist (removing: edit()), each applied in one pass
+	void move(std::vector<std::size_t> indices, std::size_t position, std::uint64_t revision);
+	void playNext(std::vector<std::size_t> indices, std::uint64_t revision);
+	void dedupe(std::vector<std::size_t> indices, std::uint64_t revision);
+	// Path based, so never dropped for being stale: applied to the tracklist as it is by then
+	void watched(Player::Changes changes);
+	// Plays if the tracklist was empty and autoplay is set
+	void add(std::vector<std::string> paths, bool autoplay);
+	void restore(Playlist playlists, std::size_t active, std::size_t head, capo::Time position);
+	// Playlists: new and copied ones become active
+	void newList(std::string name);
+	void copyList(std::size_t index, std::string name, std::uint64_t revision);
+	void closeList(std::size_t index, std::uint64_t revision);
+	void reopenList();
+	void renameList(std::size_t index, std::string name, std::uint64_t revision);
+	// Smart playlists: fill() is dropped if the list's rule is no longer rule
+	void ruleList(std::size_t index, std::string rule, std::uint64_t revision);
+	void fill(std::size_t index, std::string rule, std::vector<std::string> paths);
+	void selectList(std::size_t index, std::uint64_t revision);
+	// Metadata (loudness, to skip probing unchanged files) for paths, in order
+	void known(std::vector<std::string> paths, std::vector<Library::Meta> metas);
+
+  private:
+	struct Command;
+	struct Shared;
+
+	// Appends to the overflow list while it's active
+	bool spill(Command& command);
+	void push(Command command);
+
+	std::unique_ptr<Shared> m_shared;
+	State const* m_state{};
+	std::uint64_t m_reported{};
+	Drive m_drive{};
+	ktl::kthread m_thread;
+};
+} // namespace jk
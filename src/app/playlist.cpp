@@ -1,10 +1,17 @@
+#include <app/library.hpp>
 #include <app/playlist.hpp>
+#include <ktl/kformat.hpp>
+#include <misc/alloc_stats.hpp>
 #include <misc/log.hpp>
 #include <misc/version.hpp>
+#include <charconv>
+#include <filesystem>
 #include <fstream>
 #include <optional>
 
 namespace jk {
+namespace stdfs = std::filesystem;
+
 namespace {
 std::optional<Version> getVersion(std::string_view header, std::string_view prefix) noexcept {
 	if (header.empty() || header[0] != '#') { return std::nullopt; }
@@ -15,6 +22,14 @@ std::optional<Version> getVersion(std::string_view header, std::string_view pref
 	}
 	return std::nullopt;
 }
+
+std::string_view resolve(std::string_view line, Library const* library) noexcept {
+	if (!library) { return {}; }
+	Library::Id id{};
+	line = line.substr(1);
+	if (std::from_chars(line.data(), line.data() + line.size(), id).ec != std::errc{}) { return {}; }
+	return library->path(id);
+}
 } // namespace
 
 bool Playlist::valid(char const* path, bool silent, std::string_view prefix) {
@@ -45,26 +60,103 @@ std::size_t Playlist::load(char const* path, std::string_view prefix) {
 	auto file = std::ifstream(path);
 	std::size_t ret{};
 	for (std::string line; std::getline(file, line); line.clear()) {
-		if (!line.empty() && line[0] != '#') {
-			tracks.push_back(std::move(line));
-			++ret;
+		if (std::string_view(line).starts_with(section_v)) {
+			sections.push_back({line.substr(section_v.size()), tracks.size()});
+			continue;
 		}
+		if (std::string_view(line).starts_with(rule_v) && !sections.empty()) {
+			sections.back().rule = line.substr(rule_v.size());
+			continue;
+		}
+		if (line.empty() || line[0] == '#') { continue; }
+		if (line[0] == library_id_v) {
+			auto const track = resolve(line, library);
+			if (track.empty()) {
+				Log::warn("[Playlist] Unknown library track [{}]", line);
+				continue;
+			}
+			line = track;
+		}
+		tracks.push_back(std::move(line));
+		++ret;
 	}
 	return ret;
 }
 
-bool Playlist::save(char const* path, std::string_view prefix) {
-	if (auto file = std::ofstream(path, std::ios::trunc)) {
+bool Playlist::save(char const* path, std::string_view prefix) const {
+	auto const temp = std::string(path) + ".tmp";
+	{
+		auto file = std::ofstream(temp, std::ios::trunc);
+		if (!file) {
+			Log::warn("[Playlist] Failed to open [{}] for writing", temp);
+			return false;
+		}
 		file << "# " << prefix << ' ' << Version::app().toString().data() << "\n\n";
 		file << "#\n";
 		file << "# Lines starting with # are ignored, except the first line (header)\n";
 		file << "# Header must be in the above format (" << prefix << " <version>)\n";
-		file << "# Tracks should be absolute paths\n";
+		file << "# Tracks should be absolute paths, or library ids (" << library_id_v << "<id>)\n";
+		file << "# \"" << section_v << "<name>\" starts a named playlist\n";
+		file << "# \"" << rule_v << "<rule>\" after it makes a smart playlist, e.g. " << rule_v << "length > 5m and played > 30d\n";
 		file << "#\n\n";
-		for (auto const& track : tracks) { file << track << '\n'; }
-		Log::info("[Playlist] Save to [{}] successful", path);
-		return true;
+		auto section = sections.begin();
+		for (std::size_t i = 0; i < tracks.size() || section != sections.end(); ++i) {
+			for (; section != sections.end() && section->first <= i; ++section) {
+				file << section_v << section->name << '\n';
+				if (!section->rule.empty()) { file << rule_v << section->rule << '\n'; }
+			}
+			if (i >= tracks.size()) { break; }
+			auto const& track = tracks[i];
+			if (auto const id = library ? library->find(track) : Library::null_id; id != Library::null_id) {
+				file << library_id_v << id << '\n';
+			} else {
+				file << track << '\n';
+			}
+		}
+		if (!file.flush()) {
+			Log::warn("[Playlist] Failed to write [{}]", temp);
+			file.close();
+			std::error_code ec;
+			stdfs::remove(temp, ec);
+			return false;
+		}
 	}
-	return false;
+	std::error_code ec;
+	stdfs::rename(temp, path, ec);
+	if (ec) {
+		Log::warn("[Playlist] Failed to replace [{}]: {}", path, ec.message());
+		stdfs::remove(temp, ec);
+		return false;
+	}
+	Log::info("[Playlist] Save to [{}] successful", path);
+	return true;
+}
+
+Playlist Playlist::snapshot() const {
+	Playlist ret;
+	ret.sections = sections;
+	ret.tracks.reserve(tracks.size());
+	for (auto const& track : tracks) {
+		if (auto const id = library ? library->find(track) : Library::null_id; id != Library::null_id) {
+			ret.tracks.push_back(ktl::kformat("{}{}", library_id_v, id));
+		} else {
+			ret.tracks.push_back(track);
+		}
+	}
+	return ret;
+}
+
+PlaylistWriter::PlaylistWriter() {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eIo);
+		while (auto request = m_queue.pop()) { m_status.store(request->list.save(request->path.data()) ? Status::eSaved : Status::eFailed); }
+	});
+}
+
+PlaylistWriter::~PlaylistWriter() noexcept { m_queue.active(false); }
+
+void PlaylistWriter::save(Playlist snapshot, std::string path) {
+	m_status.store(Status::eBusy);
+	m_queue.push({std::move(snapshot), std::move(path)});
 }
 } // namespace jk
@@ -1,14 +1,62 @@
 #pragma once
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <atomic>
 #include <string>
 #include <vector>
 
 namespace jk {
+class Library;
+
 struct Playlist {
 	static constexpr std::string_view default_prefix_v = "jukebox playlist";
+	static constexpr char library_id_v = '@';
+	// "#| <name>" starts a named list: several playlists in one file
+	static constexpr std::string_view section_v = "#| ";
+	// "#? <rule>" right after a section makes it a smart playlist (see SmartRule); its tracks are the last matches
+	static constexpr std::string_view rule_v = "#? ";
+
+	struct Section {
+		std::string name;
+		std::size_t first{}; // index into tracks; runs up to the next section's first
+		std::string rule{};
+	};
+
 	std::vector<std::string> tracks;
+	// Empty if the file holds a single unnamed list
+	std::vector<Section> sections{};
+	// Resolves / writes tracks as library ids (@<id>) when set
+	Library const* library{};
 
 	static bool valid(char const* path, bool silent, std::string_view prefix = default_prefix_v);
 	std::size_t load(char const* path, std::string_view prefix = default_prefix_v);
-	bool save(char const* path, std::string_view prefix = default_prefix_v);
+	// Writes a temp file and renames it over path, so path is never left half-written
+	bool save(char const* path, std::string_view prefix = default_prefix_v) const;
+	// Copy with tracks already written out as library ids where known; safe to save off the main thread
+	Playlist snapshot() const;
+};
+
+///
+/// \brief Saves playlist snapshots on a worker thread
+///
+class PlaylistWriter {
+  public:
+	enum class Status { eIdle, eBusy, eSaved, eFailed };
+
+	PlaylistWriter();
+	~PlaylistWriter() noexcept;
+
+	void save(Playlist snapshot, std::string path);
+	Status status() const noexcept { return m_status.load(); }
+
+  private:
+	struct Request {
+		Playlist list;
+		std::string path;
+	};
+
+	std::atomic<Status> m_status{};
+	ktl::async_queue<Request> m_queue;
+	ktl::kthread m_thread;
 };
 } // namespace jk
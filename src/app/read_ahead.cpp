@@ -0,0 +1,178 @@
+#include <app/read_ahead.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace jk {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// exponential smoothing of per-chunk measurements
+constexpr float smooth_v = 0.1f;
+} // namespace
+
+struct ReadAhead::Shared {
+	std::mutex mutex;
+	std::condition_variable cv;
+	Config config;
+	Stats stats;
+	std::string path;
+	std::uint64_t generation{};
+	std::uint64_t read{}; // next offset to read
+	float bytesPerSecond{};
+	std::size_t fastRun{};
+	bool stop{};
+
+	std::uint64_t target() const noexcept { return std::min(stats.size, stats.position + stats.depth * config.chunk); }
+	bool pending() const noexcept { return stats.active && read < target(); }
+};
+
+ReadAhead::ReadAhead() : ReadAhead(Config{}) {}
+
+ReadAhead::ReadAhead(Config const& config) : m_shared(std::make_unique<Shared>()) {
+	this->config(config);
+	m_shared->stats.depth = m_shared->config.depth;
+	m_thread = ktl::kthread([this]() { run(); });
+}
+
+ReadAhead::~ReadAhead() noexcept {
+	{
+		auto lock = std::scoped_lock(m_shared->mutex);
+		m_shared->stop = true;
+	}
+	m_shared->cv.notify_one();
+	m_thread.join();
+}
+
+ReadAhead& ReadAhead::config(Config const& config) {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	auto& cfg = m_shared->config;
+	cfg = config;
+	cfg.chunk = std::clamp(cfg.chunk, std::size_t(16U * 1024U), std::size_t(16U * 1024U * 1024U));
+	cfg.minDepth = std::max(cfg.minDepth, std::size_t(1));
+	cfg.maxDepth = std::max(cfg.maxDepth, cfg.minDepth);
+	cfg.depth = std::clamp(cfg.depth, cfg.minDepth, cfg.maxDepth);
+	m_shared->stats.depth = std::clamp(m_shared->stats.depth, cfg.minDepth, cfg.maxDepth);
+	m_shared->cv.notify_one();
+	return *this;
+}
+
+ReadAhead::Config ReadAhead::config() const {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	return m_shared->config;
+}
+
+void ReadAhead::open(std::string path, float duration) {
+	std::error_code ec;
+	auto const size = std::uint64_t(std::filesystem::file_size(path, ec));
+	auto lock = std::scoped_lock(m_shared->mutex);
+	auto& shared = *m_shared;
+	shared.path = std::move(path);
+	++shared.generation;
+	shared.read = 0;
+	shared.fastRun = 0;
+	shared.bytesPerSecond = !ec && duration > 0.0f ? float(size) / duration : 0.0f;
+	// depth carries over between tracks: it reflects the disk, not the track
+	shared.stats = {.size = ec ? 0 : size, .depth = shared.stats.depth, .underruns = shared.stats.underruns, .grown = shared.stats.grown, .shrunk = shared.stats.shrunk};
+	shared.stats.active = shared.bytesPerSecond > 0.0f;
+	shared.stats.playMs = shared.stats.active ? float(shared.config.chunk) / shared.bytesPerSecond * 1000.0f : 0.0f;
+	shared.cv.notify_one();
+}
+
+void ReadAhead::close() {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	++m_shared->generation;
+	m_shared->stats.active = false;
+}
+
+void ReadAhead::advance(float position) {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	auto& shared = *m_shared;
+	if (!shared.stats.active) { return; }
+	auto const offset = std::min(std::uint64_t(std::max(position, 0.0f) * shared.bytesPerSecond), shared.stats.size);
+	// seeked outside what has been read: restart from the new position
+	if (offset < shared.stats.position || offset > shared.read) { shared.read = offset; }
+	shared.stats.position = offset;
+	shared.stats.ahead = shared.read - offset;
+	if (shared.pending()) { shared.cv.notify_one(); }
+}
+
+void ReadAhead::underrun() {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	auto& shared = *m_shared;
+	++shared.stats.underruns;
+	shared.fastRun = 0;
+	if (shared.config.adaptive && shared.stats.depth < shared.config.maxDepth) {
+		shared.stats.depth = std::min(shared.stats.depth * 2, shared.config.maxDepth);
+		++shared.stats.grown;
+		Log::info("[ReadAhead] Underrun, read-ahead raised to {} x {} KiB", shared.stats.depth, shared.config.chunk / 1024);
+		shared.cv.notify_one();
+	}
+}
+
+ReadAhead::Stats ReadAhead::stats() const {
+	auto lock = std::scoped_lock(m_shared->mutex);
+	return m_shared->stats;
+}
+
+void ReadAhead::run() {
+	alloc::Scope const scope(alloc::Tag::eIo);
+	auto& shared = *m_shared;
+	std::ifstream file;
+	std::uint64_t generation{};
+	std::vector<char> buffer;
+	while (true) {
+		std::string path;
+		std::uint64_t offset{};
+		std::size_t chunk{};
+		{
+			auto lock = std::unique_lock(shared.mutex);
+			shared.cv.wait(lock, [&] { return shared.stop || shared.pending(); });
+			if (shared.stop) { return; }
+			if (generation != shared.generation) {
+				generation = shared.generation;
+				path = shared.path;
+			}
+			offset = shared.read;
+			chunk = shared.config.chunk;
+		}
+		if (!path.empty()) { file = std::ifstream(path, std::ios::binary); }
+		buffer.resize(chunk);
+		auto const start = Clock::now();
+		file.clear();
+		file.seekg(std::streamoff(offset));
+		file.read(buffer.data(), std::streamsize(chunk));
+		auto const got = std::uint64_t(file.gcount());
+		auto const ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		auto lock = std::scoped_lock(shared.mutex);
+		if (generation != shared.generation || offset != shared.read) { continue; }
+		auto& stats = shared.stats;
+		if (got == 0) {
+			// unreadable or truncated: stop until the next track
+			stats.active = false;
+			continue;
+		}
+		shared.read += got;
+		stats.ahead = shared.read - std::min(shared.read, stats.position);
+		stats.readMs = stats.readMs == 0.0f ? ms : stats.readMs + (ms - stats.readMs) * smooth_v;
+		if (ms > 0.0f) {
+			auto const rate = float(got) / (1024.0f * 1024.0f) / (ms / 1000.0f);
+			stats.mibPerSecond = stats.mibPerSecond == 0.0f ? rate : stats.mibPerSecond + (rate - stats.mibPerSecond) * smooth_v;
+		}
+		if (!shared.config.adaptive) { continue; }
+		shared.fastRun = ms < stats.playMs * fast_ratio_v ? shared.fastRun + 1 : 0;
+		if (shared.fastRun >= shrink_after_v && stats.depth > shared.config.minDepth) {
+			--stats.depth;
+			++stats.shrunk;
+			shared.fastRun = 0;
+			Log::debug("[ReadAhead] I/O consistently fast, read-ahead lowered to {} x {} KiB", stats.depth, chunk / 1024);
+		}
+	}
+}
+} // namespace jk
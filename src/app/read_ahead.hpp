@@ -0,0 +1,65 @@
+#pragma once
+#include <ktl/async/kthread.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace jk {
+///
+/// \brief Reads ahead of the play position while streaming, so capo's own reads are served from the page cache
+///
+/// capo's stream buffer is internal and fixed; this keeps depth chunks past the play position resident instead.
+/// With adaptive set, depth doubles after each underrun and steps down after a long run of chunks read far faster than they play.
+///
+class ReadAhead {
+  public:
+	struct Config {
+		std::size_t chunk{256U * 1024U}; // bytes
+		std::size_t minDepth{2};		 // chunks
+		std::size_t maxDepth{64};
+		std::size_t depth{8}; // initial
+		bool adaptive{true};
+	};
+
+	struct Stats {
+		std::uint64_t size{};
+		std::uint64_t position{}; // estimated play offset
+		std::uint64_t ahead{};	  // resident past position
+		std::size_t depth{};
+		float readMs{}; // per chunk, smoothed
+		float mibPerSecond{};
+		float playMs{}; // per chunk at the track's bit rate
+		std::uint64_t underruns{};
+		std::uint64_t grown{};
+		std::uint64_t shrunk{};
+		bool active{};
+	};
+
+	// a chunk read in under this fraction of its play time counts towards shrinking
+	static constexpr float fast_ratio_v = 0.05f;
+	static constexpr std::size_t shrink_after_v = 64;
+
+	ReadAhead();
+	explicit ReadAhead(Config const& config);
+	~ReadAhead() noexcept;
+
+	ReadAhead& config(Config const& config);
+	Config config() const;
+
+	// duration (s) maps play position to a byte offset
+	void open(std::string path, float duration);
+	void close();
+	void advance(float position);
+	void underrun();
+
+	Stats stats() const;
+
+  private:
+	struct Shared;
+
+	void run();
+
+	std::unique_ptr<Shared> m_shared;
+	ktl::kthread m_thread;
+};
+} // namespace jk
@@ -0,0 +1,61 @@
+#include <app/input_log.hpp>
+#include <app/jukebox.hpp>
+#include <app/replay.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+namespace jk {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+float percentile(std::vector<float> const& sorted, float p) noexcept {
+	if (sorted.empty()) { return 0.0f; }
+	auto const index = std::size_t(p * float(sorted.size() - 1) + 0.5f);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+} // namespace
+
+std::optional<Replay::Report> Replay::run(char const* path) {
+	auto replay = InputReplay::load(path);
+	if (!replay) { return std::nullopt; }
+	auto jukebox = Jukebox::headless();
+	if (!jukebox) { return std::nullopt; }
+	std::vector<float> frames;
+	std::uint64_t recorded{};
+	while (auto entry = replay->next()) {
+		switch (entry->type) {
+		case InputLog::Type::eFrame: {
+			auto const start = Clock::now();
+			jukebox->update();
+			frames.push_back(std::chrono::duration<float, std::milli>(Clock::now() - start).count());
+			recorded += entry->micros;
+			break;
+		}
+		case InputLog::Type::eKey:
+			if (!entry->captured) { jukebox->onKey(entry->key); }
+			break;
+		case InputLog::Type::eFileDrop: jukebox->onFileDrop(entry->paths); break;
+		case InputLog::Type::eAdd: jukebox->onAdd(std::move(entry->paths.front())); break;
+		case InputLog::Type::eAction: jukebox->onAction(entry->action.action, entry->action.value); break;
+		case InputLog::Type::eRenameList: jukebox->onRenameList(std::size_t(entry->list), std::move(entry->text)); break;
+		case InputLog::Type::eRuleList: jukebox->onRuleList(std::size_t(entry->list), std::move(entry->text)); break;
+		}
+	}
+	Report ret;
+	ret.frames = frames.size();
+	ret.steady = jukebox->steady();
+	if (frames.empty()) { return ret; }
+	ret.recorded = float(recorded) / 1000.0f / float(frames.size());
+	ret.mean = std::accumulate(frames.begin(), frames.end(), 0.0f) / float(frames.size());
+	std::sort(frames.begin(), frames.end());
+	ret.p50 = percentile(frames, 0.50f);
+	ret.p95 = percentile(frames, 0.95f);
+	ret.p99 = percentile(frames, 0.99f);
+	ret.max = frames.back();
+	Log::info("[Replay] Replayed {} frames from [{}]", ret.frames, path);
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,25 @@
+#pragma once
+#include <app/jukebox.hpp>
+#include <cstddef>
+#include <optional>
+
+namespace jk {
+///
+/// \brief Feeds a recorded input log into a headless Jukebox (no window, no UI) and times each frame
+///
+struct Replay {
+	struct Report {
+		std::size_t frames{};
+		// milliseconds
+		float recorded{};
+		float mean{};
+		float p50{};
+		float p95{};
+		float p99{};
+		float max{};
+		Jukebox::Steady steady{};
+	};
+
+	static std::optional<Report> run(char const* path);
+};
+} // namespace jk
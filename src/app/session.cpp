@@ -0,0 +1,88 @@
+#include <app/library.hpp>
+#include <app/playlist.hpp>
+#include <app/session.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <iterator>
+
+namespace jk {
+namespace {
+// publish in batches so large lists show progress without contending on every track
+constexpr std::size_t batch_v = 256;
+} // namespace
+
+Session::Session(std::string path, Library const* library) : m_path(std::move(path)), m_library(library) {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eIo);
+		while (auto tracks = m_queue.pop()) {
+			std::vector<Result> batch;
+			batch.reserve(batch_v);
+			std::size_t missing{};
+			auto const flush = [&] {
+				auto lock = std::scoped_lock(m_done.mutex);
+				std::move(batch.begin(), batch.end(), std::back_inserter(m_done.results));
+				batch.clear();
+			};
+			for (auto& track : *tracks) {
+				bool const present = Library::Meta::stat(track).has_value();
+				if (!present) {
+					Log::warn("[Session] Missing [{}]", track);
+					++missing;
+				}
+				batch.push_back({std::move(track), present});
+				if (batch.size() >= batch_v) { flush(); }
+			}
+			flush();
+			Log::info("[Session] Validated {} tracks, {} missing", tracks->size(), missing);
+		}
+	});
+}
+
+Session::~Session() noexcept {
+	m_queue.active(false);
+	if (m_dirty) { save(); }
+}
+
+Playlist Session::load() const {
+	Playlist ret;
+	ret.library = m_library;
+	if (!Playlist::valid(m_path.data(), true, prefix_v)) { return ret; }
+	if (auto const loaded = ret.load(m_path.data(), prefix_v); loaded > 0) {
+		Log::info("[Session] Restored {} tracks in {} playlists from [{}]", loaded, std::max(ret.sections.size(), std::size_t(1)), m_path);
+	}
+	return ret;
+}
+
+bool Session::save() const {
+	if (!m_tracks) { return false; }
+	auto list = m_tracks->playlists();
+	list.library = m_library;
+	return list.save(m_path.data(), prefix_v);
+}
+
+void Session::snapshot(std::shared_ptr<Player::Tracklist const> tracks) {
+	m_tracks = std::move(tracks);
+	m_dirty = true;
+}
+
+void Session::validate(std::vector<std::string> tracks) {
+	if (tracks.empty()) { return; }
+	m_queue.push(std::move(tracks));
+}
+
+void Session::update() {
+	std::vector<Result> results;
+	{
+		auto lock = std::scoped_lock(m_done.mutex);
+		std::swap(results, m_done.results);
+	}
+	for (auto& result : results) {
+		if (result.present) {
+			if (auto it = m_missing.find(result.path); it != m_missing.end()) { m_missing.erase(it); }
+		} else {
+			m_missing.insert(std::move(result.path));
+		}
+	}
+}
+} // namespace jk
@@ -0,0 +1,77 @@
+#pragma once
+#include <app/player.hpp>
+#include <app/playlist.hpp>
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Playlists persisted across runs
+///
+/// Every playlist is saved to the one file, each as a named section.
+/// Restored tracks are not probed: they are checked for existence on a worker thread instead, and missing ones are marked.
+/// The latest snapshot is saved on destruction: snapshots share the player's tracklist, and paths are only joined then.
+///
+class Session {
+  public:
+	static constexpr std::string_view prefix_v = "jukebox session";
+
+	Session(std::string path, Library const* library);
+	~Session() noexcept;
+
+	Playlist load() const;
+	bool save() const;
+	void snapshot(std::shared_ptr<Player::Tracklist const> tracks);
+
+	void validate(std::vector<std::string> tracks);
+	// Main thread: collect validation results
+	void update();
+	bool missing(std::string_view path) const noexcept { return m_missing.find(path) != m_missing.end(); }
+	// As PathStore splits paths: looked up without joining them
+	bool missing(std::string_view directory, std::string_view filename) const noexcept {
+		return m_missing.find(Split{directory, filename}) != m_missing.end();
+	}
+	std::size_t missingCount() const noexcept { return m_missing.size(); }
+
+  private:
+	struct Result {
+		std::string path;
+		bool present{};
+	};
+
+	struct Split {
+		std::string_view directory;
+		std::string_view filename;
+	};
+	// Orders a Split as if its parts were joined
+	struct PathLess {
+		using is_transparent = void;
+
+		static int compare(std::string_view path, Split split) noexcept {
+			if (auto const ret = path.substr(0, split.directory.size()).compare(split.directory); ret != 0) { return ret; }
+			return path.substr(split.directory.size()).compare(split.filename);
+		}
+
+		bool operator()(std::string_view lhs, std::string_view rhs) const noexcept { return lhs < rhs; }
+		bool operator()(std::string_view lhs, Split rhs) const noexcept { return compare(lhs, rhs) < 0; }
+		bool operator()(Split lhs, std::string_view rhs) const noexcept { return compare(rhs, lhs) > 0; }
+	};
+
+	std::shared_ptr<Player::Tracklist const> m_tracks;
+	std::set<std::string, PathLess> m_missing;
+	std::string m_path;
+	Library const* m_library{};
+	bool m_dirty{};
+	struct {
+		std::vector<Result> results;
+		std::mutex mutex;
+	} m_done;
+	ktl::async_queue<std::vector<std::string>> m_queue;
+	ktl::kthread m_thread;
+};
+} // namespace jk
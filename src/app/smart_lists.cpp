@@ -0,0 +1,346 @@
+#include <app/smart_lists.hpp>
+#include <app/track_source.hpp>
+#include <misc/log.hpp>
+#include <misc/simd.hpp>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <limits>
+
+namespace jk {
+namespace {
+using Field = SmartRule::Field;
+using Op = SmartRule::Op;
+
+constexpr float inf_v = std::numeric_limits<float>::infinity();
+
+struct Range {
+	float lo{};
+	float hi{};
+	bool invert{};
+};
+
+constexpr std::pair<std::string_view, Op> ops_v[] = {
+	{"<=", Op::eLessEqual}, {">=", Op::eGreaterEqual}, {"!=", Op::eNotEqual}, {"<", Op::eLess},
+	{">", Op::eGreater},	{"=", Op::eEqual},			{"under ", Op::eUnder},
+};
+
+constexpr std::pair<std::string_view, Field> fields_v[] = {
+	{"length", Field::eLength}, {"modified", Field::eModified}, {"played", Field::ePlayed}, {"plays", Field::ePlays},
+	{"skips", Field::eSkips},	{"format", Field::eFormat},		{"dir", Field::eDir},
+};
+
+constexpr std::pair<std::string_view, capo::FileFormat> formats_v[] = {
+	{"wav", capo::FileFormat::eWav},
+	{"mp3", capo::FileFormat::eMp3},
+	{"flac", capo::FileFormat::eFlac},
+};
+
+constexpr std::string_view trim(std::string_view str) noexcept {
+	while (!str.empty() && str.front() == ' ') { str.remove_prefix(1); }
+	while (!str.empty() && str.back() == ' ') { str.remove_suffix(1); }
+	return str;
+}
+
+constexpr bool isAge(Field field) noexcept { return field == Field::eModified || field == Field::ePlayed; }
+
+std::optional<float> number(std::string_view str) {
+	float ret{};
+	auto const [end, ec] = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (ec != std::errc() || end != str.data() + str.size()) { return std::nullopt; }
+	return ret;
+}
+
+// "90", "1.5m", "30d": in seconds; a bare number is in units of unit
+std::optional<float> seconds(std::string_view str, float unit) {
+	if (!str.empty()) {
+		switch (str.back()) {
+		case 's': unit = 1.0f; break;
+		case 'm': unit = 60.0f; break;
+		case 'h': unit = 60.0f * 60.0f; break;
+		case 'd': unit = float(History::day_v); break;
+		default: break;
+		}
+		if (std::isalpha(static_cast<unsigned char>(str.back()))) { str.remove_suffix(1); }
+	}
+	auto const ret = number(str);
+	if (!ret) { return std::nullopt; }
+	return *ret * unit;
+}
+
+// age OP value <=> time OP' now - value
+constexpr Op mirror(Op op) noexcept {
+	switch (op) {
+	case Op::eLess: return Op::eGreater;
+	case Op::eLessEqual: return Op::eGreaterEqual;
+	case Op::eGreater: return Op::eLess;
+	case Op::eGreaterEqual: return Op::eLessEqual;
+	default: return op;
+	}
+}
+
+Range range(Op op, float value) {
+	switch (op) {
+	case Op::eLess: return {-inf_v, std::nextafter(value, -inf_v)};
+	case Op::eLessEqual: return {-inf_v, value};
+	case Op::eGreater: return {std::nextafter(value, inf_v), inf_v};
+	case Op::eGreaterEqual: return {value, inf_v};
+	case Op::eNotEqual: return {value, value, true};
+	default: return {value, value};
+	}
+}
+
+float days(std::int64_t time) noexcept { return float(double(time) / double(History::day_v)); }
+
+// file_clock's epoch is implementation defined: measure it against the system clock, once
+std::int64_t unixTime(std::int64_t mtime) noexcept {
+	using namespace std::chrono;
+	static auto const offset = file_clock::now().time_since_epoch() - duration_cast<file_clock::duration>(system_clock::now().time_since_epoch());
+	return duration_cast<std::chrono::seconds>(file_clock::duration(mtime) - offset).count();
+}
+} // namespace
+
+std::optional<SmartRule> SmartRule::parse(std::string_view text) {
+	SmartRule ret;
+	auto const fail = [text](std::string_view why) {
+		Log::warn("[SmartLists] Invalid rule [{}]: {}", text, why);
+		return std::nullopt;
+	};
+	for (auto rest = text; !trim(rest).empty();) {
+		auto const split = rest.find(" and ");
+		auto str = trim(rest.substr(0, split));
+		rest = split == std::string_view::npos ? std::string_view() : rest.substr(split + 5);
+		Clause clause;
+		if (str.starts_with("not ")) {
+			clause.negate = true;
+			str = trim(str.substr(4));
+		}
+		auto const field = std::find_if(std::begin(fields_v), std::end(fields_v), [str](auto const& f) { return str.starts_with(f.first); });
+		if (field == std::end(fields_v)) { return fail("unknown field"); }
+		clause.field = field->second;
+		str = trim(str.substr(field->first.size()));
+		auto const op = std::find_if(std::begin(ops_v), std::end(ops_v), [str](auto const& o) { return str.starts_with(o.first); });
+		if (op == std::end(ops_v)) { return fail("unknown operator"); }
+		clause.op = op->second;
+		auto const value = trim(str.substr(op->first.size()));
+		if (value.empty()) { return fail("missing value"); }
+		bool const equality = clause.op == Op::eEqual || clause.op == Op::eNotEqual;
+		switch (clause.field) {
+		case Field::eFormat: {
+			auto const format = std::find_if(std::begin(formats_v), std::end(formats_v), [value](auto const& f) { return f.first == value; });
+			if (!equality || format == std::end(formats_v)) { return fail("format takes = / != wav, mp3 or flac"); }
+			clause.value = float(format->second);
+			break;
+		}
+		case Field::eDir:
+			if (!equality && clause.op != Op::eUnder) { return fail("dir takes = / != / under"); }
+			// directories are stored with their trailing separator
+			clause.dir = value;
+			if (clause.dir.back() != '/' && clause.dir.back() != '\\') { clause.dir += value.find('\\') != std::string_view::npos ? '\\' : '/'; }
+			break;
+		default: {
+			if (clause.op == Op::eUnder) { return fail("under only applies to dir"); }
+			auto const age = isAge(clause.field);
+			// ages default to days, lengths to seconds
+			auto const parsed = age || clause.field == Field::eLength ? seconds(value, age ? float(History::day_v) : 1.0f) : number(value);
+			if (!parsed) { return fail("invalid number"); }
+			clause.value = *parsed;
+			break;
+		}
+		}
+		ret.clauses.push_back(std::move(clause));
+	}
+	if (ret.clauses.empty()) { return fail("no clauses"); }
+	return ret;
+}
+
+bool SmartRule::relative() const noexcept {
+	return std::any_of(clauses.begin(), clauses.end(), [](Clause const& clause) { return isAge(clause.field); });
+}
+
+void TrackColumns::set(Library::Id id, std::string_view path, Library::Meta const& meta) {
+	if (id >= size()) {
+		auto const rows = std::size_t(id) + 1;
+		m_lengths.resize(rows);
+		m_modified.resize(rows);
+		m_played.resize(rows);
+		m_plays.resize(rows);
+		m_skips.resize(rows);
+		m_dirs.resize(rows);
+		m_formats.resize(rows);
+	}
+	m_lengths[id] = meta.length;
+	m_modified[id] = meta.mtime != 0 ? days(unixTime(meta.mtime)) : 0.0f;
+	auto const sep = path.find_last_of("/\\");
+	m_dirs[id] = directory(sep == std::string_view::npos ? std::string_view() : path.substr(0, sep + 1));
+	m_formats[id] = std::uint8_t(TrackSource::format(path).value_or(capo::FileFormat::eUnknown));
+}
+
+void TrackColumns::played(Library::Id id, History::Stats const& stats) {
+	if (id >= size()) { return; }
+	m_played[id] = stats.last != 0 ? days(stats.last) : 0.0f;
+	m_plays[id] = float(stats.plays);
+	m_skips[id] = float(stats.skips);
+}
+
+void TrackColumns::clear() { *this = {}; }
+
+void TrackColumns::evaluate(SmartRule const& rule, std::size_t first, std::span<std::uint8_t> out, std::int64_t now) const {
+	auto const rows = first < size() ? std::min(out.size(), size() - first) : 0;
+	std::fill(out.begin(), out.begin() + std::ptrdiff_t(rows), std::uint8_t(0xff));
+	std::fill(out.begin() + std::ptrdiff_t(rows), out.end(), std::uint8_t(0));
+	auto const mask = out.first(rows);
+	auto const today = days(now);
+	for (auto const& clause : rule.clauses) {
+		auto const column = [first, rows](std::vector<float> const& values) { return std::span(values).subspan(first, rows); };
+		switch (clause.field) {
+		case Field::eFormat:
+			simd::equal(std::span(m_formats).subspan(first, rows), std::uint8_t(clause.value), clause.negate != (clause.op == Op::eNotEqual), mask);
+			continue;
+		case Field::eDir: directories(clause, first, mask); continue;
+		default: break;
+		}
+		auto const age = isAge(clause.field);
+		auto const [lo, hi, invert] = range(age ? mirror(clause.op) : clause.op, age ? today - clause.value / float(History::day_v) : clause.value);
+		auto const values = [&] {
+			switch (clause.field) {
+			case Field::eModified: return column(m_modified);
+			case Field::ePlayed: return column(m_played);
+			case Field::ePlays: return column(m_plays);
+			case Field::eSkips: return column(m_skips);
+			default: return column(m_lengths);
+			}
+		}();
+		simd::within(values, lo, hi, clause.negate != invert, mask);
+	}
+}
+
+std::uint32_t TrackColumns::directory(std::string_view dir) {
+	if (auto const it = m_dirIds.find(dir); it != m_dirIds.end()) { return it->second; }
+	auto const& name = m_dirNames.emplace_back(dir);
+	auto const ret = std::uint32_t(m_dirNames.size() - 1);
+	m_dirIds.emplace(name, ret);
+	return ret;
+}
+
+void TrackColumns::directories(SmartRule::Clause const& clause, std::size_t first, std::span<std::uint8_t> out) const {
+	auto const matches = [&clause](std::string_view dir) { return clause.op == Op::eUnder ? dir.starts_with(clause.dir) : dir == clause.dir; };
+	std::uint8_t const flip = clause.negate != (clause.op == Op::eNotEqual) ? 0xff : 0;
+	auto const dirs = std::span(m_dirs).subspan(first, out.size());
+	if (out.size() < m_dirNames.size()) {
+		for (std::size_t i = 0; i < out.size(); ++i) { out[i] &= std::uint8_t(matches(m_dirNames[dirs[i]]) ? 0xff : 0) ^ flip; }
+		return;
+	}
+	// one test per directory, then a lookup per row
+	std::vector<std::uint8_t> table(m_dirNames.size());
+	for (std::size_t d = 0; d < table.size(); ++d) { table[d] = std::uint8_t(matches(m_dirNames[d]) ? 0xff : 0) ^ flip; }
+	for (std::size_t i = 0; i < out.size(); ++i) { out[i] &= table[dirs[i]]; }
+}
+
+std::vector<SmartLists::Result> SmartLists::update(std::span<std::string const> rules, Library& library, History const* history,
+												   std::span<std::string const> played) {
+	std::vector<Result> ret;
+	if (rules.empty()) {
+		if (m_loaded) {
+			m_queries.clear();
+			m_columns.clear();
+			m_loaded = false;
+		}
+		return ret;
+	}
+	auto const changes = library.takeChanges();
+	std::vector<Library::Id> touched;
+	bool const full = !m_loaded || changes.overflow;
+	if (full) {
+		load(library, history);
+	} else {
+		touched = changes.ids;
+		for (auto const& path : played) {
+			if (auto const id = library.find(path); id != Library::null_id) { touched.push_back(id); }
+		}
+		std::sort(touched.begin(), touched.end());
+		touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+		for (auto const id : touched) {
+			auto const entry = library.entry(id);
+			if (!entry) { continue; }
+			m_columns.set(id, entry->path, entry->meta);
+			if (auto const stats = history ? history->stats(entry->path) : std::nullopt) { m_columns.played(id, *stats); }
+		}
+	}
+
+	std::erase_if(m_queries, [rules](Query const& query) { return std::find(rules.begin(), rules.end(), query.text) == rules.end(); });
+	auto const now = History::now();
+	auto const steady = std::chrono::steady_clock::now();
+	bool const refresh = steady - m_refreshed >= refresh_v;
+	if (refresh) { m_refreshed = steady; }
+	for (auto& query : m_queries) {
+		if (full || (refresh && query.rule.relative())) {
+			auto const previous = std::move(query.matches);
+			query.matches.clear();
+			evaluate(query, 0, now);
+			query.changed = query.matches != previous;
+			continue;
+		}
+		auto const rows = query.matches.size();
+		// rows appended since are new tracks; the rest only change if touched
+		evaluate(query, rows, now);
+		std::uint8_t match{};
+		for (auto const id : touched) {
+			if (id >= rows) { break; }
+			m_columns.evaluate(query.rule, id, {&match, 1}, now);
+			if (match != query.matches[id]) {
+				query.matches[id] = match;
+				query.changed = true;
+			}
+		}
+	}
+	for (auto const& text : rules) {
+		if (text.empty() || std::any_of(m_queries.begin(), m_queries.end(), [&text](Query const& query) { return query.text == text; })) { continue; }
+		if (std::find(m_invalid.begin(), m_invalid.end(), text) != m_invalid.end()) { continue; }
+		auto rule = SmartRule::parse(text);
+		if (!rule) {
+			m_invalid.push_back(text);
+			continue;
+		}
+		auto& query = m_queries.emplace_back(Query{text, std::move(*rule)});
+		evaluate(query, 0, now);
+		query.changed = true;
+	}
+
+	for (auto& query : m_queries) {
+		if (!query.changed) { continue; }
+		query.changed = false;
+		auto& result = ret.emplace_back(Result{query.text});
+		for (std::size_t id = 0; id < query.matches.size(); ++id) {
+			if (query.matches[id] != 0) { result.paths.emplace_back(library.path(Library::Id(id))); }
+		}
+		Log::info("[SmartLists] [{}]: {} tracks", query.text, result.paths.size());
+	}
+	return ret;
+}
+
+void SmartLists::load(Library const& library, History const* history) {
+	m_columns.clear();
+	auto const rows = library.size();
+	for (std::size_t id = 0; id < rows; ++id) {
+		if (auto const entry = library.entry(Library::Id(id))) { m_columns.set(Library::Id(id), entry->path, entry->meta); }
+	}
+	// far fewer tracks played than known: look those up rather than every row in the history
+	if (history) {
+		for (auto const& entry : history->entries()) {
+			if (auto const id = library.find(entry.path); id != Library::null_id) { m_columns.played(id, entry.stats); }
+		}
+	}
+	m_loaded = true;
+	Log::info("[SmartLists] Loaded {} tracks", m_columns.size());
+}
+
+void SmartLists::evaluate(Query& query, std::size_t first, std::int64_t now) {
+	if (first >= m_columns.size()) { return; }
+	query.matches.resize(m_columns.size());
+	auto const out = std::span(query.matches).subspan(first);
+	m_columns.evaluate(query.rule, first, out, now);
+	if (std::any_of(out.begin(), out.end(), [](std::uint8_t match) { return match != 0; })) { query.changed = true; }
+}
+} // namespace jk
@@ -0,0 +1,112 @@
+#pragma once
+#include <app/history.hpp>
+#include <app/library.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Rule of a smart playlist: clauses joined by "and", each optionally negated with "not"
+///
+/// Text form, as stored in playlist files: "length > 5m and dir under /archive and played > 30d".
+/// Fields: length, modified and played (ages: "played > 30d" is not played in 30 days, or never), plays, skips (counts),
+/// format (= / != wav, mp3, flac) and dir (= / under a directory). Times take an s / m / h / d suffix.
+///
+struct SmartRule {
+	enum class Field : std::uint8_t { eLength, eModified, ePlayed, ePlays, eSkips, eFormat, eDir };
+	enum class Op : std::uint8_t { eLess, eLessEqual, eGreater, eGreaterEqual, eEqual, eNotEqual, eUnder };
+
+	struct Clause {
+		std::string dir{};
+		float value{}; // seconds, a count or a capo::FileFormat
+		Field field{};
+		Op op{};
+		bool negate{};
+	};
+
+	std::vector<Clause> clauses{};
+
+	// Logs why and returns nullopt if text is not a valid rule
+	static std::optional<SmartRule> parse(std::string_view text);
+	// Has clauses relative to the current time (modified / played)
+	bool relative() const noexcept;
+};
+
+///
+/// \brief Library tracks as columns, one row per library id, queried by smart playlist rules
+///
+/// A rule is evaluated a clause at a time, each a SIMD scan of one column (see simd::within / simd::equal) into a byte mask,
+/// rather than walking per track objects. Times are kept as days since the epoch: a float is exact to a few minutes.
+///
+class TrackColumns {
+  public:
+	std::size_t size() const noexcept { return m_lengths.size(); }
+
+	// Grows to id + 1 rows if needed
+	void set(Library::Id id, std::string_view path, Library::Meta const& meta);
+	void played(Library::Id id, History::Stats const& stats);
+	void clear();
+
+	// out[i] = 0xff if row first + i matches rule, else 0; now is the unix time relative clauses are against
+	void evaluate(SmartRule const& rule, std::size_t first, std::span<std::uint8_t> out, std::int64_t now) const;
+
+  private:
+	std::uint32_t directory(std::string_view dir);
+	void directories(SmartRule::Clause const& clause, std::size_t first, std::span<std::uint8_t> out) const;
+
+	std::vector<float> m_lengths; // seconds
+	std::vector<float> m_modified;
+	std::vector<float> m_played; // last play, 0 if never
+	std::vector<float> m_plays;
+	std::vector<float> m_skips;
+	std::vector<std::uint32_t> m_dirs;
+	std::vector<std::uint8_t> m_formats;
+	// interned: views into the (address stable) names
+	std::deque<std::string> m_dirNames;
+	std::unordered_map<std::string_view, std::uint32_t> m_dirIds;
+};
+
+///
+/// \brief Keeps the matches of every smart playlist's rule up to date with the library and play history
+///
+/// New rules are evaluated in full; after that only the rows of tracks upserted into the library or played since the last
+/// update are re-evaluated, along with new rows. Rules on ages are re-evaluated in full every refresh_v, as time moves on.
+/// Columns are only loaded once there is a rule to evaluate.
+///
+class SmartLists {
+  public:
+	static constexpr auto refresh_v = std::chrono::minutes(1);
+
+	struct Result {
+		std::string rule;
+		std::vector<std::string> paths{}; // in library order
+	};
+
+	// Call once per frame with the rules in use and the paths played since the last call;
+	// returns the rules whose matches have changed (new ones included)
+	std::vector<Result> update(std::span<std::string const> rules, Library& library, History const* history, std::span<std::string const> played);
+
+  private:
+	struct Query {
+		std::string text;
+		SmartRule rule;
+		std::vector<std::uint8_t> matches{}; // per row
+		bool changed{};
+	};
+
+	void load(Library const& library, History const* history);
+	void evaluate(Query& query, std::size_t first, std::int64_t now);
+
+	TrackColumns m_columns;
+	std::vector<Query> m_queries;
+	std::vector<std::string> m_invalid; // logged once
+	std::chrono::steady_clock::time_point m_refreshed{};
+	bool m_loaded{};
+};
+} // namespace jk
@@ -0,0 +1,169 @@
+#include <app/spectrum.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/fft.hpp>
+#include <misc/simd.hpp>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <thread>
+#include <vector>
+
+namespace jk {
+namespace stdch = std::chrono;
+
+namespace {
+constexpr float floor_db_v = -60.0f;
+constexpr float fall_v = 1.0f / 30.0f; // full scale to zero in half a second
+constexpr float min_freq_v = 40.0f;
+constexpr float max_freq_v = 16000.0f;
+
+float normalize(float amplitude) noexcept {
+	if (amplitude <= 0.0f) { return 0.0f; }
+	return std::clamp((20.0f * std::log10(amplitude) - floor_db_v) / -floor_db_v, 0.0f, 1.0f);
+}
+
+constexpr float fall(float current, float target) noexcept { return std::max(target, current - fall_v); }
+} // namespace
+
+struct Spectrum::Analyser {
+	Fft fft{fft_size_v};
+	std::vector<float> window = std::vector<float>(fft_size_v);
+	std::vector<float> re = std::vector<float>(fft_size_v);
+	std::vector<float> im = std::vector<float>(fft_size_v);
+	std::vector<float> mags = std::vector<float>(fft_size_v / 2);
+	// grow to fit the largest window seen, then stay put
+	std::vector<std::int16_t> pcm;
+	std::vector<float> decoded;
+	std::array<std::size_t, bands_v + 1> edges{};
+	std::size_t sampleRate{};
+	Frame state;
+
+	Analyser() {
+		// Hann
+		for (std::size_t i = 0; i < fft_size_v; ++i) { window[i] = 0.5f - 0.5f * std::cos(2.0f * std::numbers::pi_v<float> * float(i) / float(fft_size_v - 1)); }
+	}
+
+	void rate(std::size_t rate) noexcept {
+		if (rate == sampleRate || rate == 0) { return; }
+		sampleRate = rate;
+		float const top = std::min(max_freq_v, float(rate) * 0.5f);
+		for (std::size_t i = 0; i <= bands_v; ++i) {
+			float const freq = min_freq_v * std::pow(top / min_freq_v, float(i) / float(bands_v));
+			edges[i] = std::clamp(std::size_t(freq * float(fft_size_v) / float(rate)), std::size_t(1), mags.size());
+			if (i > 0 && edges[i] <= edges[i - 1]) { edges[i] = std::min(edges[i - 1] + 1, mags.size()); }
+		}
+	}
+
+	void decay() noexcept {
+		for (auto& band : state.bands) { band = fall(band, 0.0f); }
+		for (auto& peak : state.peak) { peak = fall(peak, 0.0f); }
+		for (auto& rms : state.rms) { rms = fall(rms, 0.0f); }
+	}
+
+	// gain: as applied on playback (volume, normalization), which the rendered samples don't include
+	void analyse(SampleStore const& samples, float position, float gain) {
+		auto const channels = samples.channels();
+		rate(samples.sampleRate());
+		auto const end = std::min(std::size_t(position * float(sampleRate)), samples.frames());
+		// enough to cover both the FFT window and 50ms of levels leading up to the playhead
+		auto const span = std::max(fft_size_v, sampleRate / 20);
+		auto const begin = end > span ? end - span : 0;
+		pcm.resize(span * channels);
+		decoded.resize(span * channels);
+		auto const count = samples.read(begin, std::span{pcm}.first((end - begin) * channels));
+		auto const frames = std::span<float const>{decoded}.first(count * channels);
+		simd::toFloat(std::span<std::int16_t const>{pcm}.first(frames.size()), decoded);
+		spectrum(frames, channels, gain);
+		levels(frames, channels, gain);
+	}
+
+	void spectrum(std::span<float const> frames, std::size_t channels, float level) noexcept {
+		auto const count = std::min(frames.size() / channels, fft_size_v);
+		auto const* in = frames.data() + frames.size() - count * channels;
+		std::fill(re.begin(), re.end(), 0.0f);
+		std::fill(im.begin(), im.end(), 0.0f);
+		float const scale = 1.0f / float(channels);
+		for (std::size_t f = 0; f < count; ++f) {
+			float mixed{};
+			for (std::size_t c = 0; c < channels; ++c) { mixed += in[f * channels + c]; }
+			re[fft_size_v - count + f] = mixed * scale;
+		}
+		simd::multiply(re, window);
+		fft(re, im);
+		simd::magnitudes(re, im, mags);
+		// Hann coherent gain is 0.5: full scale sine peaks at N / 4
+		float const gain = 4.0f / float(fft_size_v) * level;
+		for (std::size_t b = 0; b < bands_v; ++b) {
+			float peak{};
+			for (auto i = edges[b]; i < edges[b + 1]; ++i) { peak = std::max(peak, mags[i]); }
+			state.bands[b] = fall(state.bands[b], normalize(peak * gain));
+		}
+	}
+
+	void levels(std::span<float const> frames, std::size_t channels, float gain) noexcept {
+		// 50ms of audio leading up to the playhead
+		auto const count = std::min(frames.size() / channels, std::max(sampleRate / 20, std::size_t(1)));
+		auto const* in = frames.data() + frames.size() - count * channels;
+		for (std::size_t c = 0; c < channels_v; ++c) {
+			auto const channel = std::min(c, channels - 1);
+			float peak{};
+			double sum{};
+			for (std::size_t f = 0; f < count; ++f) {
+				float const s = in[f * channels + channel];
+				peak = std::max(peak, std::fabs(s));
+				sum += double(s) * double(s);
+			}
+			float const rms = count > 0 ? float(std::sqrt(sum / double(count))) : 0.0f;
+			state.peak[c] = fall(state.peak[c], std::min(peak * gain, 1.0f));
+			state.rms[c] = fall(state.rms[c], std::min(rms * gain, 1.0f));
+		}
+	}
+};
+
+Spectrum::Spectrum() : m_analyser(std::make_unique<Analyser>()) {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		auto const period = stdch::duration_cast<stdch::steady_clock::duration>(stdch::duration<float>(1.0f / rate_v));
+		auto next = stdch::steady_clock::now();
+		while (!m_stop.load()) {
+			tick();
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+	});
+}
+
+Spectrum::~Spectrum() noexcept {
+	m_stop.store(true);
+	m_thread.join();
+}
+
+void Spectrum::source(std::shared_ptr<SampleStore const> samples) {
+	auto lock = std::scoped_lock(m_source.mutex);
+	m_source.samples = std::move(samples);
+}
+
+void Spectrum::position(capo::Time time, bool playing, float gain) noexcept {
+	m_position.store(time.count(), std::memory_order_relaxed);
+	m_playing.store(playing, std::memory_order_relaxed);
+	m_gain.store(gain, std::memory_order_relaxed);
+}
+
+void Spectrum::tick() {
+	auto const start = stdch::steady_clock::now();
+	std::shared_ptr<SampleStore const> samples;
+	{
+		auto lock = std::scoped_lock(m_source.mutex);
+		samples = m_source.samples;
+	}
+	if (samples && samples->channels() > 0 && m_playing.load(std::memory_order_relaxed)) {
+		m_analyser->analyse(*samples, m_position.load(std::memory_order_relaxed), m_gain.load(std::memory_order_relaxed));
+	} else {
+		m_analyser->decay();
+	}
+	m_frames.back() = m_analyser->state;
+	m_frames.publish();
+	auto const busy = stdch::duration<float>(stdch::steady_clock::now() - start).count() * rate_v;
+	m_load.store(m_load.load(std::memory_order_relaxed) * 0.95f + busy * 0.05f, std::memory_order_relaxed);
+}
+} // namespace jk
@@ -0,0 +1,61 @@
+#pragma once
+#include <capo/capo.hpp>
+#include <ktl/async/kthread.hpp>
+#include <misc/sample_store.hpp>
+#include <misc/triple_buffer.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace jk {
+///
+/// \brief Spectrum bands and VU levels of the playing track, analysed on a worker thread at display rate
+///
+/// Reads the rendered (equalized) track the player holds in memory; the worker runs for as long as the instance lives.
+///
+class Spectrum {
+  public:
+	static constexpr std::size_t fft_size_v = 2048;
+	static constexpr std::size_t bands_v = 32;
+	static constexpr std::size_t channels_v = 2;
+	static constexpr float rate_v = 60.0f;
+
+	struct Frame {
+		// normalized [0, 1] (-60dB to 0dB)
+		std::array<float, bands_v> bands{};
+		// linear [0, 1]
+		std::array<float, channels_v> peak{};
+		std::array<float, channels_v> rms{};
+	};
+
+	Spectrum();
+	~Spectrum() noexcept;
+
+	void source(std::shared_ptr<SampleStore const> samples);
+	// gain: as applied on playback (volume * normalization)
+	void position(capo::Time time, bool playing, float gain) noexcept;
+
+	Frame const& frame() noexcept { return m_frames.front(); }
+	// fraction of one core spent analysing
+	float load() const noexcept { return m_load.load(std::memory_order_relaxed); }
+
+  private:
+	struct Analyser;
+
+	void tick();
+
+	TripleBuffer<Frame> m_frames;
+	struct {
+		std::shared_ptr<SampleStore const> samples;
+		std::mutex mutex;
+	} m_source;
+	std::unique_ptr<Analyser> m_analyser;
+	std::atomic<float> m_position{};
+	std::atomic<float> m_gain{1.0f};
+	std::atomic<bool> m_playing{};
+	std::atomic<float> m_load{};
+	std::atomic<bool> m_stop{};
+	ktl::kthread m_thread;
+};
+} // namespace jk
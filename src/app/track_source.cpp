@@ -0,0 +1,40 @@
+#include <app/track_source.hpp>
+#include <misc/log.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+
+namespace jk {
+namespace {
+std::atomic<TrackSource::Input> g_input{TrackSource::Input::eMapped};
+
+bool hasExtension(std::string_view path, std::string_view ext) noexcept {
+	if (path.size() < ext.size()) { return false; }
+	auto const tail = path.substr(path.size() - ext.size());
+	return std::equal(tail.begin(), tail.end(), ext.begin(), [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+} // namespace
+
+void TrackSource::input(Input input) noexcept { g_input.store(input); }
+
+TrackSource::Input TrackSource::input() noexcept { return g_input.load(); }
+
+std::optional<capo::FileFormat> TrackSource::format(std::string_view path) noexcept {
+	if (hasExtension(path, ".wav")) { return capo::FileFormat::eWav; }
+	if (hasExtension(path, ".mp3")) { return capo::FileFormat::eMp3; }
+	if (hasExtension(path, ".flac")) { return capo::FileFormat::eFlac; }
+	return std::nullopt;
+}
+
+capo::Result<capo::PCM> TrackSource::decode(std::string const& path, MappedFile::Hint hint) {
+	auto const fmt = format(path);
+	if (input() == Input::eMapped && fmt) {
+		if (auto file = MappedFile::open(path.data()); file && !file->empty()) {
+			file->advise(hint);
+			return capo::PCM::fromMemory(file->bytes(), *fmt);
+		}
+		Log::debug("[TrackSource] Failed to map [{}], falling back to buffered", path);
+	}
+	return capo::PCM::fromFile(path, fmt);
+}
+} // namespace jk
@@ -0,0 +1,23 @@
+#pragma once
+#include <capo/capo.hpp>
+#include <misc/mapped_file.hpp>
+#include <optional>
+#include <string>
+
+namespace jk {
+///
+/// \brief Decodes whole tracks, reading either through capo's buffered file I/O or a memory mapping
+///
+/// Mapped input decodes straight out of the page cache; formats not known by extension fall back to buffered.
+///
+class TrackSource {
+  public:
+	enum class Input { eBuffered, eMapped };
+
+	static void input(Input input) noexcept;
+	static Input input() noexcept;
+
+	static std::optional<capo::FileFormat> format(std::string_view path) noexcept;
+	static capo::Result<capo::PCM> decode(std::string const& path, MappedFile::Hint hint);
+};
+} // namespace jk
@@ -0,0 +1,135 @@
+#include <app/library.hpp>
+#include <app/track_source.hpp>
+#include <app/waveform.hpp>
+#include <capo/capo.hpp>
+#include <misc/alloc_stats.hpp>
+#include <misc/log.hpp>
+#include <misc/simd.hpp>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace jk {
+namespace stdfs = std::filesystem;
+
+namespace {
+constexpr char magic_v[8] = {'j', 'k', 'p', 'e', 'a', 'k', 's', '1'};
+constexpr std::uint32_t refine_v = Waveform::levels_v[1] / Waveform::levels_v[0];
+
+std::string cacheFile(std::string_view dir, std::string_view path) {
+	auto const meta = Library::Meta::stat(path);
+	if (!meta) { return {}; }
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (char const ch : path) { hash = (hash ^ std::uint8_t(ch)) * 1099511628211ULL; }
+	hash ^= std::uint64_t(meta->mtime) * 31 + meta->size;
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.peaks", static_cast<unsigned long long>(hash));
+	return (stdfs::path(dir) / name).generic_string();
+}
+
+Waveform::Column column(simd::Peak const& peak) noexcept {
+	if (peak.count == 0) { return {}; }
+	auto const rms = std::sqrt(double(peak.sumSquares) / double(peak.count));
+	return {peak.min, peak.max, std::int16_t(std::min(rms, 32767.0))};
+}
+
+std::shared_ptr<Waveform::Peaks const> analyse(capo::PCM const& pcm) {
+	auto const channels = std::max(pcm.meta.channels, std::size_t(1));
+	auto const frames = pcm.samples.size() / channels;
+	if (frames == 0) { return {}; }
+	auto const finest = Waveform::levels_v.back();
+	std::vector<simd::Peak> peaks(finest);
+	for (std::uint32_t i = 0; i < finest; ++i) {
+		auto const begin = frames * i / finest * channels;
+		auto const end = frames * (i + 1) / finest * channels;
+		peaks[i] = simd::peak(std::span(pcm.samples).subspan(begin, end - begin));
+	}
+	auto ret = std::make_shared<Waveform::Peaks>();
+	for (std::size_t level = Waveform::levels_v.size(); level-- > 0;) {
+		if (peaks.size() > Waveform::levels_v[level]) {
+			// fold adjacent columns of the finer level
+			std::vector<simd::Peak> coarse(peaks.size() / refine_v);
+			for (std::size_t i = 0; i < peaks.size(); ++i) { coarse[i / refine_v] += peaks[i]; }
+			peaks = std::move(coarse);
+		}
+		auto& out = ret->levels[level];
+		out.reserve(peaks.size());
+		for (auto const& peak : peaks) { out.push_back(column(peak)); }
+	}
+	return ret;
+}
+
+std::shared_ptr<Waveform::Peaks const> load(std::string const& path) {
+	auto file = std::ifstream(path, std::ios::binary);
+	if (!file) { return {}; }
+	char magic[sizeof(magic_v)]{};
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, magic_v, sizeof(magic_v)) != 0) { return {}; }
+	auto ret = std::make_shared<Waveform::Peaks>();
+	for (std::size_t level = 0; level < Waveform::levels_v.size(); ++level) {
+		auto& out = ret->levels[level];
+		out.resize(Waveform::levels_v[level]);
+		if (!file.read(reinterpret_cast<char*>(out.data()), std::streamsize(out.size() * sizeof(Waveform::Column)))) { return {}; }
+	}
+	return ret;
+}
+
+void save(std::string const& path, Waveform::Peaks const& peaks) {
+	std::error_code ec;
+	stdfs::create_directories(stdfs::path(path).parent_path(), ec);
+	auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	if (!file) { return; }
+	file.write(magic_v, sizeof(magic_v));
+	for (auto const& level : peaks.levels) { file.write(reinterpret_cast<char const*>(level.data()), std::streamsize(level.size() * sizeof(Waveform::Column))); }
+}
+} // namespace
+
+std::span<Waveform::Column const> Waveform::Peaks::level(float width) const noexcept {
+	for (auto const& ret : levels) {
+		if (float(ret.size()) >= width) { return ret; }
+	}
+	return levels.back();
+}
+
+Waveform::Waveform(std::string cacheDir) : m_cacheDir(std::move(cacheDir)) {
+	m_thread = ktl::kthread([this]() {
+		alloc::Scope const scope(alloc::Tag::eAudio);
+		while (auto request = m_queue.pop()) {
+			if (request->generation != m_generation.load()) { continue; }
+			compute(request->path);
+		}
+	});
+}
+
+Waveform::~Waveform() noexcept { m_queue.active(false); }
+
+void Waveform::request(std::string_view path) {
+	if (path == m_requested) { return; }
+	m_requested = path;
+	if (!path.empty()) { m_queue.push({m_requested, ++m_generation}); }
+}
+
+std::shared_ptr<Waveform::Peaks const> Waveform::peaks() const {
+	auto lock = std::scoped_lock(m_result.mutex);
+	return m_result.path == m_requested ? m_result.peaks : nullptr;
+}
+
+void Waveform::compute(std::string const& path) {
+	auto const cache = cacheFile(m_cacheDir, path);
+	auto peaks = cache.empty() ? nullptr : load(cache);
+	if (!peaks) {
+		auto pcm = TrackSource::decode(path, MappedFile::Hint::eSequential);
+		if (!pcm) {
+			Log::warn("[Waveform] Failed to decode [{}]", path);
+			return;
+		}
+		peaks = analyse(*pcm);
+		if (!peaks) { return; }
+		if (!cache.empty()) { save(cache, *peaks); }
+		Log::debug("[Waveform] Computed peaks for [{}]", path);
+	}
+	auto lock = std::scoped_lock(m_result.mutex);
+	m_result.peaks = std::move(peaks);
+	m_result.path = path;
+}
+} // namespace jk
@@ -0,0 +1,59 @@
+#pragma once
+#include <ktl/async/async_queue.hpp>
+#include <ktl/async/kthread.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Min / max / RMS overview of a track, computed and cached off the UI thread
+///
+class Waveform {
+  public:
+	struct Column {
+		std::int16_t min{};
+		std::int16_t max{};
+		std::int16_t rms{};
+	};
+
+	// Column counts per zoom level, each a 4x refinement of the previous
+	static constexpr std::array<std::uint32_t, 3> levels_v = {256, 1024, 4096};
+
+	struct Peaks {
+		std::array<std::vector<Column>, levels_v.size()> levels;
+
+		std::span<Column const> level(float width) const noexcept;
+	};
+
+	Waveform(std::string cacheDir);
+	~Waveform() noexcept;
+
+	void request(std::string_view path);
+	std::shared_ptr<Peaks const> peaks() const;
+
+  private:
+	struct Request {
+		std::string path;
+		std::uint64_t generation{};
+	};
+
+	void compute(std::string const& path);
+
+	struct {
+		std::shared_ptr<Peaks const> peaks;
+		std::string path;
+		mutable std::mutex mutex;
+	} m_result;
+	std::string m_cacheDir;
+	std::string m_requested;
+	std::atomic<std::uint64_t> m_generation{};
+	ktl::async_queue<Request> m_queue;
+	ktl::kthread m_thread;
+};
+} // namespace jk
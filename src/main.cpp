@@ -1,9 +1,20 @@
+#include <app/export.hpp>
 #include <app/jukebox.hpp>
+#include <app/library.hpp>
+#include <app/replay.hpp>
 #include <dibs/bridge.hpp>
 #include <dibs/dibs.hpp>
 #include <ktl/fixed_vector.hpp>
+#include <misc/equalizer.hpp>
 #include <misc/log.hpp>
 #include <misc/version.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+#include <vector>
 
 namespace {
 std::string windowTitle(std::string_view appName) {
@@ -15,14 +26,143 @@ std::string windowTitle(std::string_view appName) {
 		return ktl::kformat("{} {}", appName.data(), app.data());
 	}
 }
+
+struct Args {
+	char const* record{};
+	char const* replay{};
+	// fail a replay if the 95th percentile frame exceeds this (ms)
+	float budget{};
+	// fail a replay if a steady state frame touched the heap
+	bool zeroAlloc{};
+	bool benchEq{};
+	char const* exportPath{};
+	jk::Export::Options exportOptions;
+};
+
+Args parseArgs(int argc, char** argv) {
+	Args ret;
+	for (int i = 1; i < argc; ++i) {
+		auto const arg = std::string_view(argv[i]);
+		if (arg == "--bench-eq") {
+			ret.benchEq = true;
+			continue;
+		}
+		if (arg == "--zero-alloc") {
+			ret.zeroAlloc = true;
+			continue;
+		}
+		if (arg == "--concat" || arg == "--normalize") {
+			(arg == "--concat" ? ret.exportOptions.concat : ret.exportOptions.normalize) = true;
+			continue;
+		}
+		if (i + 1 >= argc) { break; }
+		if (arg == "--record") {
+			ret.record = argv[i + 1];
+		} else if (arg == "--replay") {
+			ret.replay = argv[i + 1];
+		} else if (arg == "--budget") {
+			ret.budget = float(std::atof(argv[i + 1]));
+		} else if (arg == "--export") {
+			ret.exportPath = argv[i + 1];
+		} else if (arg == "--out") {
+			ret.exportOptions.output = argv[i + 1];
+		} else if (arg == "--gain") {
+			ret.exportOptions.gainDb = float(std::atof(argv[i + 1]));
+		} else if (arg == "--jobs") {
+			ret.exportOptions.jobs = std::size_t(std::max(std::atoi(argv[i + 1]), 0));
+		} else if (arg == "--memory-mb") {
+			ret.exportOptions.memoryBudget = std::size_t(std::max(std::atoi(argv[i + 1]), 1)) * 1024U * 1024U;
+		}
+		++i;
+	}
+	return ret;
+}
+
+int benchEqualizer() {
+	static constexpr float rate_v = 48000.0f;
+	static constexpr std::size_t channels_v = 2;
+	// a minute of stereo noise, a few passes per band count
+	std::vector<std::int16_t> samples(std::size_t(rate_v) * 60 * channels_v);
+	auto rng = std::mt19937(42);
+	auto dist = std::uniform_int_distribution<int>(-8000, 8000);
+	for (auto& sample : samples) { sample = std::int16_t(dist(rng)); }
+	std::printf("bands | M samples/s | x realtime\n");
+	for (std::size_t bands = 1; bands <= jk::Equalizer::max_bands_v; bands *= 2) {
+		jk::Equalizer::Preset preset;
+		for (std::size_t b = 0; b < bands; ++b) { preset.bands[preset.count++] = {jk::Equalizer::Band::Type::ePeak, 60.0f * float(1 << b), 1.0f, 3.0f}; }
+		jk::Equalizer eq;
+		eq.prepare(preset, rate_v, channels_v);
+		static constexpr int passes_v = 3;
+		auto const start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < passes_v; ++pass) { eq.process(samples); }
+		auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto const rate = double(samples.size() * passes_v) / elapsed;
+		std::printf("%5zu | %11.1f | %10.0f\n", bands, rate / 1e6, rate / (double(rate_v) * double(channels_v)));
+	}
+	return 0;
+}
+
+int replay(Args const& args) {
+	auto const report = jk::Replay::run(args.replay);
+	if (!report) { return 30; }
+	std::printf("frames: %zu\nrecorded mean: %.3f ms\nreplay mean: %.3f ms\np50: %.3f ms\np95: %.3f ms\np99: %.3f ms\nmax: %.3f ms\n", report->frames,
+				report->recorded, report->mean, report->p50, report->p95, report->p99, report->max);
+	if constexpr (jk::alloc::enabled_v) {
+		std::printf("steady frames: %zu\nsteady allocations: %llu (%llu bytes)\n", report->steady.frames, (unsigned long long)report->steady.allocs.count,
+					(unsigned long long)report->steady.allocs.bytes);
+	}
+	if (args.budget > 0.0f && report->p95 > args.budget) {
+		std::printf("FAIL: p95 %.3f ms exceeds budget %.3f ms\n", report->p95, args.budget);
+		return 1;
+	}
+	if (args.zeroAlloc) {
+		if constexpr (!jk::alloc::enabled_v) {
+			std::printf("FAIL: --zero-alloc needs allocation tracking (Debug, or JUKEBOX_TRACK_ALLOCS)\n");
+			return 1;
+		}
+		if (report->steady.frames == 0) {
+			std::printf("FAIL: no steady state frames to check\n");
+			return 1;
+		}
+		if (report->steady.allocs.count > 0) {
+			std::printf("FAIL: steady state frames allocated %llu times\n", (unsigned long long)report->steady.allocs.count);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int exportPlaylist(Args const& args) {
+	auto options = args.exportOptions;
+	if (options.output.empty()) { options.output = options.concat ? "jukebox_export.wav" : "jukebox_export"; }
+	// resolves library ids (@<id>) in playlists saved with them
+	auto library = jk::Library::open("jukebox_library.bin");
+	jk::Playlist list;
+	list.library = library.get();
+	if (list.load(args.exportPath) == 0) {
+		std::printf("Failed to load playlist [%s]\n", args.exportPath);
+		return 50;
+	}
+	auto const report = jk::Export::run(list, options);
+	if (!report) { return 50; }
+	std::printf("tracks: %zu (%zu failed)\nthreads: %zu\naudio: %.1f s\nelapsed: %.2f s\nspeed: %.1fx realtime\nwritten: %.1f MiB\npeak decoded: %.1f MiB\n",
+				report->tracks, report->failed, report->threads, report->audio, report->elapsed, report->realtime(), double(report->bytes) / (1024.0 * 1024.0),
+				double(report->peakMemory) / (1024.0 * 1024.0));
+	return report->failed > 0 ? 1 : 0;
+}
 } // namespace
 
-int main() {
+int main(int argc, char** argv) {
 	auto file = jk::Log::toFile("jukebox_log.txt");
+	auto const args = parseArgs(argc, argv);
+	if (args.benchEq) { return benchEqualizer(); }
+	if (args.replay) { return replay(args); }
+	if (args.exportPath) { return exportPlaylist(args); }
 	auto dibsInst = dibs::Instance::Builder{}.extent({650U, 300U}).title(windowTitle("Jukebox").data()).flags(dibs::Instance::Flag::eHidden)();
 	if (!dibsInst) { return 10; }
 	auto jukebox = jk::Jukebox::make(dibs::Bridge::glfw(*dibsInst));
 	if (!jukebox) { return 20; }
+	if (args.record && !jukebox->record(args.record)) { return 40; }
 	glfwShowWindow(dibs::Bridge::glfw(*dibsInst));
 	while (!dibsInst->closing()) {
 		auto const poll = dibsInst->poll();
@@ -0,0 +1,90 @@
+#include <misc/alloc_stats.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace jk::alloc {
+namespace {
+struct Atomic {
+	std::atomic<std::uint64_t> count{};
+	std::atomic<std::uint64_t> bytes{};
+};
+
+std::array<Atomic, std::size_t(Tag::eCOUNT_)> g_stats{};
+thread_local Tag t_tag = Tag::eOther;
+thread_local Counter t_counter{};
+
+[[maybe_unused]] void record(std::size_t size) noexcept {
+	auto& stats = g_stats[std::size_t(t_tag)];
+	stats.count.fetch_add(1, std::memory_order_relaxed);
+	stats.bytes.fetch_add(size, std::memory_order_relaxed);
+	++t_counter.count;
+	t_counter.bytes += size;
+}
+} // namespace
+
+Stats global() noexcept {
+	Stats ret;
+	for (std::size_t i = 0; i < ret.size(); ++i) { ret[i] = {g_stats[i].count.load(std::memory_order_relaxed), g_stats[i].bytes.load(std::memory_order_relaxed)}; }
+	return ret;
+}
+
+Counter thread() noexcept { return t_counter; }
+
+Scope::Scope(Tag tag) noexcept : m_previous(t_tag) { t_tag = tag; }
+Scope::~Scope() noexcept { t_tag = m_previous; }
+} // namespace jk::alloc
+
+#if defined(JK_DEBUG) || defined(JK_TRACK_ALLOCS)
+namespace {
+void* allocate(std::size_t size) {
+	jk::alloc::record(size);
+	if (void* ret = std::malloc(size == 0 ? 1 : size)) { return ret; }
+	throw std::bad_alloc();
+}
+
+void* allocate(std::size_t size, std::align_val_t align) {
+	jk::alloc::record(size);
+	auto const alignment = std::size_t(align);
+#if defined(_WIN32)
+	if (void* ret = _aligned_malloc(size == 0 ? 1 : size, alignment)) { return ret; }
+#else
+	// aligned_alloc wants a multiple of the alignment
+	if (void* ret = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) { return ret; }
+#endif
+	throw std::bad_alloc();
+}
+
+void deallocate(void* ptr, std::align_val_t) noexcept {
+#if defined(_WIN32)
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+} // namespace
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) { return nullptr; }
+}
+void* operator new(std::size_t size, std::align_val_t align) { return allocate(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return allocate(size, align); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t align) noexcept { deallocate(ptr, align); }
+void operator delete[](void* ptr, std::align_val_t align) noexcept { deallocate(ptr, align); }
+void operator delete(void* ptr, std::size_t, std::align_val_t align) noexcept { deallocate(ptr, align); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t align) noexcept { deallocate(ptr, align); }
+#endif
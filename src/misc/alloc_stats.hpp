@@ -0,0 +1,46 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace jk::alloc {
+///
+/// \brief Heap allocation counters, fed by the global operator new replacement (debug builds, or with JK_TRACK_ALLOCS)
+///
+/// Allocations are attributed to the calling thread's current Tag, set through Scope.
+///
+#if defined(JK_DEBUG) || defined(JK_TRACK_ALLOCS)
+constexpr bool enabled_v = true;
+#else
+constexpr bool enabled_v = false;
+#endif
+
+enum class Tag : std::uint8_t { eOther, eUi, eAudio, eIo, eCOUNT_ };
+constexpr std::array<std::string_view, std::size_t(Tag::eCOUNT_)> tag_names_v = {"other", "ui", "audio", "io"};
+
+struct Counter {
+	std::uint64_t count{};
+	std::uint64_t bytes{};
+
+	constexpr Counter operator-(Counter const& rhs) const noexcept { return {count - rhs.count, bytes - rhs.bytes}; }
+};
+
+using Stats = std::array<Counter, std::size_t(Tag::eCOUNT_)>;
+
+// All threads since startup, by tag
+Stats global() noexcept;
+// Calling thread since startup
+Counter thread() noexcept;
+
+class Scope {
+  public:
+	explicit Scope(Tag tag) noexcept;
+	~Scope() noexcept;
+
+	Scope(Scope const&) = delete;
+	Scope& operator=(Scope const&) = delete;
+
+  private:
+	Tag m_previous;
+};
+} // namespace jk::alloc
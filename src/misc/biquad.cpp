@@ -0,0 +1,107 @@
+#include <misc/biquad.hpp>
+#include <misc/simd.hpp>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+namespace jk {
+Biquad Biquad::kShelf(float sampleRate) noexcept {
+	double const f0 = 1681.974450955533;
+	double const gain = 3.999843853973347;
+	double const q = 0.7071752369554196;
+	double const k = std::tan(std::numbers::pi * f0 / double(sampleRate));
+	double const vh = std::pow(10.0, gain / 20.0);
+	double const vb = std::pow(vh, 0.4996667741545416);
+	double const a0 = 1.0 + k / q + k * k;
+	return {
+		float((vh + vb * k / q + k * k) / a0),
+		float(2.0 * (k * k - vh) / a0),
+		float((vh - vb * k / q + k * k) / a0),
+		float(2.0 * (k * k - 1.0) / a0),
+		float((1.0 - k / q + k * k) / a0),
+	};
+}
+
+Biquad Biquad::kHighPass(float sampleRate) noexcept {
+	double const f0 = 38.13547087602444;
+	double const q = 0.5003270373238773;
+	double const k = std::tan(std::numbers::pi * f0 / double(sampleRate));
+	double const a0 = 1.0 + k / q + k * k;
+	return {1.0f, -2.0f, 1.0f, float(2.0 * (k * k - 1.0) / a0), float((1.0 - k / q + k * k) / a0)};
+}
+
+namespace {
+struct Cookbook {
+	double a;
+	double cosw;
+	double alpha;
+
+	Cookbook(float sampleRate, float frequency, float q, float gain) noexcept {
+		double const w0 = 2.0 * std::numbers::pi * double(frequency) / double(sampleRate);
+		a = std::pow(10.0, double(gain) / 40.0);
+		cosw = std::cos(w0);
+		alpha = std::sin(w0) / (2.0 * double(q));
+	}
+};
+
+Biquad normalize(double b0, double b1, double b2, double a0, double a1, double a2) noexcept {
+	return {float(b0 / a0), float(b1 / a0), float(b2 / a0), float(a1 / a0), float(a2 / a0)};
+}
+} // namespace
+
+Biquad Biquad::peak(float sampleRate, float frequency, float q, float gain) noexcept {
+	auto const c = Cookbook(sampleRate, frequency, q, gain);
+	return normalize(1.0 + c.alpha * c.a, -2.0 * c.cosw, 1.0 - c.alpha * c.a, 1.0 + c.alpha / c.a, -2.0 * c.cosw, 1.0 - c.alpha / c.a);
+}
+
+Biquad Biquad::lowShelf(float sampleRate, float frequency, float q, float gain) noexcept {
+	auto const c = Cookbook(sampleRate, frequency, q, gain);
+	double const k = 2.0 * std::sqrt(c.a) * c.alpha;
+	return normalize(c.a * ((c.a + 1.0) - (c.a - 1.0) * c.cosw + k), 2.0 * c.a * ((c.a - 1.0) - (c.a + 1.0) * c.cosw),
+					 c.a * ((c.a + 1.0) - (c.a - 1.0) * c.cosw - k), (c.a + 1.0) + (c.a - 1.0) * c.cosw + k, -2.0 * ((c.a - 1.0) + (c.a + 1.0) * c.cosw),
+					 (c.a + 1.0) + (c.a - 1.0) * c.cosw - k);
+}
+
+Biquad Biquad::highShelf(float sampleRate, float frequency, float q, float gain) noexcept {
+	auto const c = Cookbook(sampleRate, frequency, q, gain);
+	double const k = 2.0 * std::sqrt(c.a) * c.alpha;
+	return normalize(c.a * ((c.a + 1.0) + (c.a - 1.0) * c.cosw + k), -2.0 * c.a * ((c.a - 1.0) + (c.a + 1.0) * c.cosw),
+					 c.a * ((c.a + 1.0) + (c.a - 1.0) * c.cosw - k), (c.a + 1.0) - (c.a - 1.0) * c.cosw + k, 2.0 * ((c.a - 1.0) - (c.a + 1.0) * c.cosw),
+					 (c.a + 1.0) - (c.a - 1.0) * c.cosw - k);
+}
+
+void Biquad4::set(Biquad const& coeffs) noexcept {
+	for (std::size_t lane = 0; lane < lanes_v; ++lane) { set(lane, coeffs); }
+}
+
+void Biquad4::set(std::size_t lane, Biquad const& coeffs) noexcept {
+	assert(lane < lanes_v);
+	m_b0[lane] = coeffs.b0;
+	m_b1[lane] = coeffs.b1;
+	m_b2[lane] = coeffs.b2;
+	m_a1[lane] = coeffs.a1;
+	m_a2[lane] = coeffs.a2;
+}
+
+void Biquad4::reset() noexcept {
+	m_z1 = {};
+	m_z2 = {};
+}
+
+void Biquad4::process(std::span<float> frames) noexcept {
+	using simd::f32x4;
+	assert(frames.size() % lanes_v == 0);
+	auto const b0 = f32x4::load(m_b0.data()), b1 = f32x4::load(m_b1.data()), b2 = f32x4::load(m_b2.data());
+	auto const a1 = f32x4::load(m_a1.data()), a2 = f32x4::load(m_a2.data());
+	auto z1 = f32x4::load(m_z1.data()), z2 = f32x4::load(m_z2.data());
+	for (std::size_t i = 0; i < frames.size(); i += lanes_v) {
+		auto const x = f32x4::load(frames.data() + i);
+		auto const y = b0 * x + z1;
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		y.store(frames.data() + i);
+	}
+	z1.store(m_z1.data());
+	z2.store(m_z2.data());
+}
+} // namespace jk
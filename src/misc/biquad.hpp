@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <span>
+
+namespace jk {
+///
+/// \brief Normalized biquad coefficients (a0 == 1)
+///
+struct Biquad {
+	float b0 = 1.0f;
+	float b1{};
+	float b2{};
+	float a1{};
+	float a2{};
+
+	// ITU-R BS.1770 K-weighting stages
+	static Biquad kShelf(float sampleRate) noexcept;
+	static Biquad kHighPass(float sampleRate) noexcept;
+
+	// RBJ cookbook; gain in dB
+	static Biquad peak(float sampleRate, float frequency, float q, float gain) noexcept;
+	static Biquad lowShelf(float sampleRate, float frequency, float q, float gain) noexcept;
+	static Biquad highShelf(float sampleRate, float frequency, float q, float gain) noexcept;
+};
+
+///
+/// \brief Four independent biquads run in parallel lanes (transposed direct form II)
+///
+/// Frames are interleaved 4-lane floats; lanes can be channels or bands.
+///
+class Biquad4 {
+  public:
+	static constexpr std::size_t lanes_v = 4;
+
+	void set(Biquad const& coeffs) noexcept;
+	void set(std::size_t lane, Biquad const& coeffs) noexcept;
+	void reset() noexcept;
+	void process(std::span<float> frames) noexcept;
+
+  private:
+	alignas(16) std::array<float, lanes_v> m_b0{1.0f, 1.0f, 1.0f, 1.0f};
+	alignas(16) std::array<float, lanes_v> m_b1{};
+	alignas(16) std::array<float, lanes_v> m_b2{};
+	alignas(16) std::array<float, lanes_v> m_a1{};
+	alignas(16) std::array<float, lanes_v> m_a2{};
+	alignas(16) std::array<float, lanes_v> m_z1{};
+	alignas(16) std::array<float, lanes_v> m_z2{};
+};
+} // namespace jk
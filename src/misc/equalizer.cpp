@@ -0,0 +1,90 @@
+#include <misc/equalizer.hpp>
+#include <misc/simd.hpp>
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace jk {
+namespace {
+constexpr float flat_v = 0.01f;
+constexpr std::string_view type_names_v[] = {"peak", "low", "high"};
+
+bool flat(Equalizer::Band const& band) noexcept { return std::abs(band.gain) < flat_v; }
+} // namespace
+
+Biquad Equalizer::Band::coefficients(float sampleRate) const noexcept {
+	auto const f = std::clamp(frequency, 10.0f, sampleRate * 0.49f);
+	auto const width = std::max(q, 0.05f);
+	switch (type) {
+	case Type::eLowShelf: return Biquad::lowShelf(sampleRate, f, width, gain);
+	case Type::eHighShelf: return Biquad::highShelf(sampleRate, f, width, gain);
+	default: return Biquad::peak(sampleRate, f, width, gain);
+	}
+}
+
+bool Equalizer::Preset::flat() const noexcept {
+	return std::all_of(bands.begin(), bands.begin() + std::ptrdiff_t(count), [](Band const& b) { return jk::flat(b); });
+}
+
+void Equalizer::prepare(Preset const& preset, float sampleRate, std::size_t channels) noexcept {
+	m_channels = std::max(channels, std::size_t(1));
+	for (std::size_t i = 0; i < max_bands_v; ++i) {
+		m_bands[i] = i < preset.count ? preset.bands[i] : Band{};
+		m_filters[i].set(m_bands[i].coefficients(sampleRate));
+		m_filters[i].reset();
+	}
+}
+
+void Equalizer::process(std::span<std::int16_t> samples) noexcept {
+	while (!samples.empty()) {
+		auto const frames = std::min(samples.size() / m_channels, block_frames_v);
+		if (frames == 0) { break; }
+		auto const block = samples.first(frames * m_channels);
+		auto const lanes = std::span(m_lanes).first(frames * Biquad4::lanes_v);
+		simd::toLanes(block, m_channels, lanes);
+		bool processed = false;
+		for (std::size_t i = 0; i < max_bands_v; ++i) {
+			if (jk::flat(m_bands[i])) { continue; }
+			m_filters[i].process(lanes);
+			processed = true;
+		}
+		if (processed) { simd::fromLanes(lanes, m_channels, block); }
+		samples = samples.subspan(block.size());
+	}
+}
+
+void Equalizer::apply(Preset const& preset, float sampleRate, std::size_t channels, std::span<std::int16_t> samples) noexcept {
+	prepare(preset, sampleRate, channels);
+	process(samples);
+}
+
+std::ostream& operator<<(std::ostream& out, Equalizer::Preset const& preset) {
+	for (std::size_t i = 0; i < preset.count; ++i) {
+		auto const& band = preset.bands[i];
+		if (i > 0) { out << ' '; }
+		out << type_names_v[std::size_t(band.type)] << ':' << band.frequency << ':' << band.q << ':' << band.gain;
+	}
+	return out;
+}
+
+std::istream& operator>>(std::istream& in, Equalizer::Preset& out) {
+	out = {};
+	for (std::string token; out.count < Equalizer::max_bands_v && in >> token;) {
+		std::replace(token.begin(), token.end(), ':', ' ');
+		auto str = std::istringstream(token);
+		std::string type;
+		Equalizer::Band band;
+		if (!(str >> type >> band.frequency >> band.q >> band.gain)) { continue; }
+		auto const it = std::find(std::begin(type_names_v), std::end(type_names_v), type);
+		if (it == std::end(type_names_v)) { continue; }
+		band.type = Equalizer::Band::Type(it - std::begin(type_names_v));
+		out.bands[out.count++] = band;
+	}
+	// a partially parsed line is still usable
+	in.clear(in.rdstate() & ~std::ios::failbit);
+	return in;
+}
+} // namespace jk
@@ -0,0 +1,59 @@
+#pragma once
+#include <misc/biquad.hpp>
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+
+namespace jk {
+///
+/// \brief Parametric equalizer: a cascade of up to eight biquads, channels processed in parallel lanes
+///
+/// Settings are fixed for a whole render: the player re-renders a track for a new preset and swaps it in at the current
+/// position, fading out and back in around the swap (GainRamp) so the cut doesn't click.
+/// Works in place on interleaved 16-bit samples without allocating; only the first four channels are filtered.
+///
+class Equalizer {
+  public:
+	static constexpr std::size_t max_bands_v = 8;
+	static constexpr std::size_t block_frames_v = 64;
+
+	struct Band {
+		enum class Type : std::uint8_t { ePeak, eLowShelf, eHighShelf };
+
+		Type type{};
+		float frequency = 1000.0f;
+		float q = 0.7071f;
+		// dB
+		float gain{};
+
+		Biquad coefficients(float sampleRate) const noexcept;
+		bool operator==(Band const&) const = default;
+	};
+
+	struct Preset {
+		std::array<Band, max_bands_v> bands{};
+		std::size_t count{};
+
+		std::span<Band const> active() const noexcept { return std::span(bands).first(count); }
+		bool flat() const noexcept;
+		bool operator==(Preset const&) const = default;
+	};
+
+	// Sets the bands and resets filter state
+	void prepare(Preset const& preset, float sampleRate, std::size_t channels) noexcept;
+	void process(std::span<std::int16_t> samples) noexcept;
+	// Whole track: prepare + process
+	void apply(Preset const& preset, float sampleRate, std::size_t channels, std::span<std::int16_t> samples) noexcept;
+
+  private:
+	alignas(16) std::array<float, block_frames_v * Biquad4::lanes_v> m_lanes{};
+	std::array<Biquad4, max_bands_v> m_filters{};
+	std::array<Band, max_bands_v> m_bands{};
+	std::size_t m_channels = 2;
+};
+
+// "<type>:<frequency>:<q>:<gain>" per band, space separated; type is peak / low / high
+std::ostream& operator<<(std::ostream& out, Equalizer::Preset const& preset);
+std::istream& operator>>(std::istream& in, Equalizer::Preset& out);
+} // namespace jk
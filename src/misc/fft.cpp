@@ -0,0 +1,85 @@
+#include <misc/fft.hpp>
+#include <misc/simd.hpp>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+namespace jk {
+namespace {
+void butterflies(float* re, float* im, float const* wr, float const* wi, std::size_t half) noexcept {
+	std::size_t k = 0;
+	float* bre = re + half;
+	float* bim = im + half;
+#if defined(JK_SIMD_SSE2)
+	for (; k + 4 <= half; k += 4) {
+		__m128 const br = _mm_loadu_ps(bre + k), bi = _mm_loadu_ps(bim + k);
+		__m128 const cr = _mm_loadu_ps(wr + k), ci = _mm_loadu_ps(wi + k);
+		__m128 const tr = _mm_sub_ps(_mm_mul_ps(br, cr), _mm_mul_ps(bi, ci));
+		__m128 const ti = _mm_add_ps(_mm_mul_ps(br, ci), _mm_mul_ps(bi, cr));
+		__m128 const ar = _mm_loadu_ps(re + k), ai = _mm_loadu_ps(im + k);
+		_mm_storeu_ps(bre + k, _mm_sub_ps(ar, tr));
+		_mm_storeu_ps(bim + k, _mm_sub_ps(ai, ti));
+		_mm_storeu_ps(re + k, _mm_add_ps(ar, tr));
+		_mm_storeu_ps(im + k, _mm_add_ps(ai, ti));
+	}
+#elif defined(JK_SIMD_NEON)
+	for (; k + 4 <= half; k += 4) {
+		float32x4_t const br = vld1q_f32(bre + k), bi = vld1q_f32(bim + k);
+		float32x4_t const cr = vld1q_f32(wr + k), ci = vld1q_f32(wi + k);
+		float32x4_t const tr = vmlsq_f32(vmulq_f32(br, cr), bi, ci);
+		float32x4_t const ti = vmlaq_f32(vmulq_f32(br, ci), bi, cr);
+		float32x4_t const ar = vld1q_f32(re + k), ai = vld1q_f32(im + k);
+		vst1q_f32(bre + k, vsubq_f32(ar, tr));
+		vst1q_f32(bim + k, vsubq_f32(ai, ti));
+		vst1q_f32(re + k, vaddq_f32(ar, tr));
+		vst1q_f32(im + k, vaddq_f32(ai, ti));
+	}
+#endif
+	for (; k < half; ++k) {
+		float const tr = bre[k] * wr[k] - bim[k] * wi[k];
+		float const ti = bre[k] * wi[k] + bim[k] * wr[k];
+		bre[k] = re[k] - tr;
+		bim[k] = im[k] - ti;
+		re[k] += tr;
+		im[k] += ti;
+	}
+}
+} // namespace
+
+Fft::Fft(std::size_t size) {
+	assert(std::has_single_bit(size));
+	auto const bits = std::countr_zero(size);
+	m_reverse.resize(size);
+	for (std::size_t i = 0; i < size; ++i) {
+		std::uint32_t rev{};
+		for (int b = 0; b < bits; ++b) { rev |= std::uint32_t((i >> b) & 1) << (bits - 1 - b); }
+		m_reverse[i] = rev;
+	}
+	m_cos.reserve(size);
+	m_sin.reserve(size);
+	for (std::size_t half = 1; half < size; half *= 2) {
+		for (std::size_t k = 0; k < half; ++k) {
+			double const angle = -std::numbers::pi * double(k) / double(half);
+			m_cos.push_back(float(std::cos(angle)));
+			m_sin.push_back(float(std::sin(angle)));
+		}
+	}
+}
+
+void Fft::operator()(std::span<float> re, std::span<float> im) const noexcept {
+	assert(re.size() == size() && im.size() == size());
+	for (std::size_t i = 0; i < size(); ++i) {
+		if (auto const j = m_reverse[i]; i < j) {
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+	for (std::size_t half = 1; half < size(); half *= 2) {
+		float const* wr = m_cos.data() + half - 1;
+		float const* wi = m_sin.data() + half - 1;
+		for (std::size_t i = 0; i < size(); i += half * 2) { butterflies(re.data() + i, im.data() + i, wr, wi, half); }
+	}
+}
+} // namespace jk
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Radix-2 complex FFT over split real / imaginary arrays
+///
+/// All tables are built on construction; transforms do not allocate.
+///
+class Fft {
+  public:
+	explicit Fft(std::size_t size);
+
+	std::size_t size() const noexcept { return m_reverse.size(); }
+	void operator()(std::span<float> re, std::span<float> im) const noexcept;
+
+  private:
+	std::vector<std::uint32_t> m_reverse;
+	// twiddles for the stage with half-width h start at index h - 1
+	std::vector<float> m_cos;
+	std::vector<float> m_sin;
+};
+} // namespace jk
@@ -0,0 +1,35 @@
+#include <misc/frame_arena.hpp>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace jk {
+char const* FrameArena::format(char const* fmt, ...) {
+	if (m_used >= m_capacity) { return ""; }
+	char* const ret = m_buffer.get() + m_used;
+	auto const available = m_capacity - m_used;
+	std::va_list args;
+	va_start(args, fmt);
+	int const written = std::vsnprintf(ret, available, fmt, args);
+	va_end(args);
+	if (written < 0) { return ""; }
+	m_used += std::min(std::size_t(written) + 1, available);
+	return ret;
+}
+
+std::string_view FrameArena::concat(std::initializer_list<std::string_view> parts) noexcept {
+	if (m_used >= m_capacity) { return {}; }
+	char* const ret = m_buffer.get() + m_used;
+	// leave room for the terminator
+	auto const available = m_capacity - m_used - 1;
+	std::size_t size{};
+	for (auto const part : parts) {
+		auto const count = std::min(part.size(), available - size);
+		std::copy_n(part.data(), count, ret + size);
+		size += count;
+	}
+	ret[size] = '\0';
+	m_used += size + 1;
+	return {ret, size};
+}
+} // namespace jk
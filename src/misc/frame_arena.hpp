@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
+
+namespace jk {
+///
+/// \brief Bump allocator for text that only lives until the end of the frame
+///
+/// Allocated once up front; reset() every frame. Output is truncated (never reallocated) when full.
+///
+class FrameArena {
+  public:
+	static constexpr std::size_t capacity_v = 16 * 1024;
+
+	explicit FrameArena(std::size_t capacity = capacity_v) : m_buffer(std::make_unique<char[]>(capacity)), m_capacity(capacity) {}
+
+	// printf style, null terminated
+	char const* format(char const* fmt, ...);
+	// Joined and null terminated
+	std::string_view concat(std::initializer_list<std::string_view> parts) noexcept;
+
+	void reset() noexcept { m_used = 0; }
+	std::size_t used() const noexcept { return m_used; }
+	std::size_t capacity() const noexcept { return m_capacity; }
+
+  private:
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity{};
+	std::size_t m_used{};
+};
+} // namespace jk
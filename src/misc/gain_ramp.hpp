@@ -0,0 +1,57 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+namespace jk {
+///
+/// \brief Gain envelope for swapping what's playing mid-track without a click
+///
+/// Ramps down to silence over duration_v and holds there until up(), then ramps back up.
+/// The owner applies gain() every step_v while active(), so each step moves the gain by at most step_v / duration_v.
+///
+class GainRamp {
+  public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr auto duration_v = std::chrono::milliseconds(16);
+	static constexpr auto step_v = std::chrono::milliseconds(1);
+
+	// Starts ramping down (from wherever a ramp up has got to)
+	void down(Clock::time_point now) noexcept {
+		if (m_phase == Phase::eDown) { return; }
+		auto const from = gain(now);
+		m_phase = Phase::eDown;
+		m_since = now - std::chrono::duration_cast<Clock::duration>((1.0f - from) * duration());
+	}
+
+	// Starts ramping up (from silence once swapped, or from wherever a cancelled ramp down has got to)
+	void up(Clock::time_point now) noexcept {
+		if (m_phase != Phase::eDown) { return; }
+		auto const from = gain(now);
+		m_phase = Phase::eUp;
+		m_since = now - std::chrono::duration_cast<Clock::duration>(from * duration());
+	}
+
+	void reset() noexcept { m_phase = Phase::eIdle; }
+
+	bool active() const noexcept { return m_phase != Phase::eIdle; }
+	bool silent(Clock::time_point now) const noexcept { return m_phase == Phase::eDown && now - m_since >= duration_v; }
+	bool done(Clock::time_point now) const noexcept { return m_phase == Phase::eUp && now - m_since >= duration_v; }
+
+	float gain(Clock::time_point now) const noexcept {
+		auto const t = std::clamp((now - m_since) / duration(), 0.0f, 1.0f);
+		switch (m_phase) {
+		case Phase::eDown: return 1.0f - t;
+		case Phase::eUp: return t;
+		default: return 1.0f;
+		}
+	}
+
+  private:
+	enum class Phase { eIdle, eDown, eUp };
+
+	static constexpr std::chrono::duration<float> duration() noexcept { return duration_v; }
+
+	Clock::time_point m_since{};
+	Phase m_phase{};
+};
+} // namespace jk
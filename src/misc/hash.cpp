@@ -0,0 +1,82 @@
+#include <misc/hash.hpp>
+#include <bit>
+#include <cstring>
+
+namespace jk {
+namespace {
+constexpr std::uint64_t p1_v = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t p2_v = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t p3_v = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t p4_v = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t p5_v = 0x27D4EB2F165667C5ULL;
+
+template <typename T>
+T read(std::byte const* bytes) noexcept {
+	T ret{};
+	if constexpr (std::endian::native == std::endian::little) {
+		std::memcpy(&ret, bytes, sizeof(ret));
+	} else {
+		for (std::size_t i = 0; i < sizeof(ret); ++i) { ret |= T(std::uint8_t(bytes[i])) << (i * 8); }
+	}
+	return ret;
+}
+
+constexpr std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept { return std::rotl(acc + input * p2_v, 31) * p1_v; }
+constexpr std::uint64_t merge(std::uint64_t acc, std::uint64_t value) noexcept { return (acc ^ round(0, value)) * p1_v + p4_v; }
+} // namespace
+
+Hash64::Hash64(std::uint64_t seed) noexcept : m_acc{seed + p1_v + p2_v, seed + p2_v, seed, seed - p1_v}, m_seed(seed) {}
+
+Hash64& Hash64::update(std::span<std::byte const> bytes) noexcept {
+	m_total += bytes.size();
+	if (m_buffered > 0) {
+		auto const take = std::min(stripe_v - m_buffered, bytes.size());
+		std::memcpy(m_buffer.data() + m_buffered, bytes.data(), take);
+		m_buffered += take;
+		bytes = bytes.subspan(take);
+		if (m_buffered < stripe_v) { return *this; }
+		for (std::size_t lane = 0; lane < 4; ++lane) { m_acc[lane] = round(m_acc[lane], read<std::uint64_t>(m_buffer.data() + lane * 8)); }
+		m_buffered = 0;
+	}
+	// locals keep the accumulators in registers across the hot loop
+	auto [a, b, c, d] = m_acc;
+	auto const* data = bytes.data();
+	auto const stripes = bytes.size() / stripe_v;
+	for (std::size_t i = 0; i < stripes; ++i, data += stripe_v) {
+		a = round(a, read<std::uint64_t>(data));
+		b = round(b, read<std::uint64_t>(data + 8));
+		c = round(c, read<std::uint64_t>(data + 16));
+		d = round(d, read<std::uint64_t>(data + 24));
+	}
+	m_acc = {a, b, c, d};
+	m_buffered = bytes.size() - stripes * stripe_v;
+	std::memcpy(m_buffer.data(), data, m_buffered);
+	return *this;
+}
+
+std::uint64_t Hash64::digest() const noexcept {
+	std::uint64_t ret{};
+	if (m_total >= stripe_v) {
+		ret = std::rotl(m_acc[0], 1) + std::rotl(m_acc[1], 7) + std::rotl(m_acc[2], 12) + std::rotl(m_acc[3], 18);
+		for (auto const acc : m_acc) { ret = merge(ret, acc); }
+	} else {
+		ret = m_seed + p5_v;
+	}
+	ret += m_total;
+	auto const* data = m_buffer.data();
+	auto remain = m_buffered;
+	for (; remain >= 8; remain -= 8, data += 8) { ret = std::rotl(ret ^ round(0, read<std::uint64_t>(data)), 27) * p1_v + p4_v; }
+	if (remain >= 4) {
+		ret = std::rotl(ret ^ (std::uint64_t(read<std::uint32_t>(data)) * p1_v), 23) * p2_v + p3_v;
+		remain -= 4;
+		data += 4;
+	}
+	for (; remain > 0; --remain, ++data) { ret = std::rotl(ret ^ (std::uint64_t(std::uint8_t(*data)) * p5_v), 11) * p1_v; }
+	ret ^= ret >> 33;
+	ret *= p2_v;
+	ret ^= ret >> 29;
+	ret *= p3_v;
+	ret ^= ret >> 32;
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace jk {
+///
+/// \brief Streaming 64-bit non-cryptographic hash (XXH64)
+///
+/// Fast enough to keep up with disk reads; for identifying content, not for security.
+///
+class Hash64 {
+  public:
+	explicit Hash64(std::uint64_t seed = 0) noexcept;
+
+	static std::uint64_t of(std::span<std::byte const> bytes, std::uint64_t seed = 0) noexcept { return Hash64(seed).update(bytes).digest(); }
+
+	Hash64& update(std::span<std::byte const> bytes) noexcept;
+	std::uint64_t digest() const noexcept;
+
+  private:
+	static constexpr std::size_t stripe_v = 32;
+
+	std::array<std::uint64_t, 4> m_acc{};
+	std::array<std::byte, stripe_v> m_buffer{};
+	std::size_t m_buffered{};
+	std::uint64_t m_total{};
+	std::uint64_t m_seed{};
+};
+} // namespace jk
@@ -0,0 +1,111 @@
+#include <misc/log.hpp>
+#include <misc/mapped_file.hpp>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace jk {
+#if defined(_WIN32)
+std::optional<MappedFile> MappedFile::open(char const* path) {
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) { return std::nullopt; }
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	MappedFile ret;
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		return ret;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		Log::warn("[MappedFile] Failed to map [{}]", path);
+		return std::nullopt;
+	}
+	auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(mapping);
+		Log::warn("[MappedFile] Failed to map [{}]", path);
+		return std::nullopt;
+	}
+	ret.m_data = static_cast<std::byte const*>(data);
+	ret.m_size = std::size_t(size.QuadPart);
+	ret.m_handle = mapping;
+	return ret;
+}
+
+MappedFile::~MappedFile() noexcept {
+	if (m_data) { UnmapViewOfFile(m_data); }
+	if (m_handle) { CloseHandle(m_handle); }
+}
+
+void MappedFile::advise(Hint hint) const noexcept {
+	// no sequential hint for views; prefetching needs Windows 8
+#if _WIN32_WINNT >= 0x0602
+	if (!m_data || hint != Hint::eWillNeed) { return; }
+	WIN32_MEMORY_RANGE_ENTRY range{const_cast<std::byte*>(m_data), m_size};
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	(void)hint;
+#endif
+}
+#else
+std::optional<MappedFile> MappedFile::open(char const* path) {
+	int const fd = ::open(path, O_RDONLY);
+	if (fd < 0) { return std::nullopt; }
+	struct stat st {};
+	if (::fstat(fd, &st) != 0) {
+		::close(fd);
+		return std::nullopt;
+	}
+	MappedFile ret;
+	if (st.st_size == 0) {
+		::close(fd);
+		return ret;
+	}
+	// the mapping outlives the descriptor
+	void* data = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		Log::warn("[MappedFile] Failed to map [{}]", path);
+		return std::nullopt;
+	}
+	ret.m_data = static_cast<std::byte const*>(data);
+	ret.m_size = std::size_t(st.st_size);
+	return ret;
+}
+
+MappedFile::~MappedFile() noexcept {
+	if (m_data) { ::munmap(const_cast<std::byte*>(m_data), m_size); }
+}
+
+void MappedFile::advise(Hint hint) const noexcept {
+	if (!m_data) { return; }
+	int advice = MADV_NORMAL;
+	switch (hint) {
+	case Hint::eSequential: advice = MADV_SEQUENTIAL; break;
+	case Hint::eWillNeed: advice = MADV_WILLNEED; break;
+	default: break;
+	}
+	::madvise(const_cast<std::byte*>(m_data), m_size, advice);
+}
+#endif
+
+void MappedFile::swap(MappedFile& rhs) noexcept {
+	std::swap(m_data, rhs.m_data);
+	std::swap(m_size, rhs.m_size);
+	std::swap(m_handle, rhs.m_handle);
+}
+} // namespace jk
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <span>
+
+namespace jk {
+///
+/// \brief RAII read-only memory mapping of an entire file
+///
+class MappedFile {
+  public:
+	// Expected access pattern, passed on to the kernel's read-ahead
+	enum class Hint { eNormal, eSequential, eWillNeed };
+
+	static std::optional<MappedFile> open(char const* path);
+
+	MappedFile() = default;
+	MappedFile(MappedFile&& rhs) noexcept : MappedFile() { swap(rhs); }
+	MappedFile& operator=(MappedFile rhs) noexcept { return (swap(rhs), *this); }
+	~MappedFile() noexcept;
+
+	std::span<std::byte const> bytes() const noexcept { return {m_data, m_size}; }
+	std::size_t size() const noexcept { return m_size; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	void advise(Hint hint) const noexcept;
+
+  private:
+	void swap(MappedFile& rhs) noexcept;
+
+	std::byte const* m_data{};
+	std::size_t m_size{};
+	void* m_handle{};
+};
+} // namespace jk
@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <optional>
+
+namespace jk {
+///
+/// \brief Bounded lock-free multi producer / single consumer queue
+///
+/// Each slot carries a sequence number: producers claim a slot by advancing the tail and publish it by bumping its sequence;
+/// the consumer only ever touches the head. push() fails instead of waiting when the queue is full.
+///
+template <typename T, std::size_t Capacity>
+class MpscQueue {
+	static_assert(std::has_single_bit(Capacity));
+
+  public:
+	MpscQueue() noexcept {
+		for (std::size_t i = 0; i < Capacity; ++i) { m_slots[i].sequence.store(i, std::memory_order_relaxed); }
+	}
+
+	// Any thread; value is only moved from if it was queued
+	bool push(T&& value) noexcept {
+		auto pos = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			auto& slot = m_slots[pos & mask_v];
+			auto const diff = std::intptr_t(slot.sequence.load(std::memory_order_acquire)) - std::intptr_t(pos);
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					slot.value = std::move(value);
+					slot.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Consumer thread only
+	std::optional<T> pop() noexcept {
+		auto& slot = m_slots[m_head & mask_v];
+		if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) { return std::nullopt; }
+		auto ret = std::move(slot.value);
+		slot.sequence.store(m_head + Capacity, std::memory_order_release);
+		++m_head;
+		return ret;
+	}
+
+	// Consumer thread only; exact if it is also the only producer
+	bool full() const noexcept { return m_tail.load(std::memory_order_relaxed) - m_head >= Capacity; }
+
+  private:
+	static constexpr std::size_t mask_v = Capacity - 1;
+
+	struct Slot {
+		std::atomic<std::size_t> sequence{};
+		T value{};
+	};
+
+	std::array<Slot, Capacity> m_slots{};
+	alignas(64) std::atomic<std::size_t> m_tail{};
+	alignas(64) std::size_t m_head{};
+};
+} // namespace jk
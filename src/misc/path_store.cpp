@@ -0,0 +1,116 @@
+#include <misc/path_store.hpp>
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <limits>
+
+namespace jk {
+namespace {
+constexpr std::uint64_t hash(std::string_view str) noexcept {
+	std::uint64_t ret = 14695981039346656037ULL;
+	for (char const ch : str) { ret = (ret ^ std::uint8_t(ch)) * 1099511628211ULL; }
+	return ret;
+}
+} // namespace
+
+PathStore::Id PathStore::add(std::string_view path) {
+	assert(m_entries.size() < std::numeric_limits<Id>::max());
+	auto const name = split(path);
+	auto const filename = path.substr(name);
+	Entry const entry{intern(path.substr(0, name)), {m_names.append(filename), std::uint32_t(filename.size())}};
+	m_entries.push_back(entry);
+	return Id(m_entries.size() - 1);
+}
+
+void PathStore::clear() noexcept { *this = {}; }
+
+PathStore PathStore::fork() {
+	auto index = std::move(m_index);
+	m_index = {};
+	// without the index: only the chunk pointers are copied
+	auto ret = *this;
+	ret.m_index = std::move(index);
+	return ret;
+}
+
+std::string_view PathStore::directory(Id id) const noexcept {
+	assert(id < m_entries.size());
+	return dirAt(m_entries[id].dir);
+}
+
+std::string_view PathStore::filename(Id id) const noexcept {
+	assert(id < m_entries.size());
+	auto const& name = m_entries[id].name;
+	return {m_names[name.location], name.size};
+}
+
+std::string PathStore::path(Id id) const {
+	auto const dir = directory(id);
+	auto const name = filename(id);
+	std::string ret;
+	ret.reserve(dir.size() + name.size());
+	ret.append(dir).append(name);
+	return ret;
+}
+
+bool PathStore::equals(Id id, std::string_view path) const noexcept {
+	auto const dir = directory(id);
+	return path.size() == dir.size() + m_entries[id].name.size && path.starts_with(dir) && path.substr(dir.size()) == filename(id);
+}
+
+bool PathStore::equals(Id lhs, Id rhs) const noexcept {
+	// directories are interned: equal paths share one
+	return m_entries[lhs].dir == m_entries[rhs].dir && filename(lhs) == filename(rhs);
+}
+
+std::uint64_t PathStore::hash(Id id) const noexcept { return jk::hash(filename(id)) ^ (m_dirs[m_entries[id].dir].hash * 0x9e3779b97f4a7c15ULL); }
+
+std::uint64_t PathStore::hash(std::string_view path) const noexcept {
+	auto const name = split(path);
+	return jk::hash(path.substr(name)) ^ (jk::hash(path.substr(0, name)) * 0x9e3779b97f4a7c15ULL);
+}
+
+std::size_t PathStore::bytes() const noexcept {
+	return m_entries.bytes() + m_names.bytes() + m_dirs.bytes() + m_dirChars.bytes() + m_index.capacity() * sizeof(std::uint32_t);
+}
+
+std::uint32_t PathStore::Chars::append(std::string_view str) {
+	assert(str.size() < chunk_chars_v);
+	auto const size = str.size() + 1;
+	if (m_chunks.empty() || m_used + size > chunk_chars_v) {
+		m_chunks.push_back(std::make_shared<char[]>(chunk_chars_v));
+		m_used = 0;
+	}
+	std::copy(str.begin(), str.end(), m_chunks.back().get() + m_used);
+	// chunks are zeroed: already null terminated
+	auto const ret = std::uint32_t((m_chunks.size() - 1) << 16 | m_used);
+	m_used += size;
+	return ret;
+}
+
+std::uint32_t PathStore::intern(std::string_view dir) {
+	// an index handed off by fork() is rebuilt here
+	if ((m_dirs.size() + 1) * 2 > m_index.size()) { rehash(std::bit_ceil(std::max((m_dirs.size() + 1) * 4, std::size_t(64)))); }
+	auto const dirHash = jk::hash(dir);
+	auto const mask = m_index.size() - 1;
+	for (auto slot = std::size_t(dirHash) & mask;; slot = (slot + 1) & mask) {
+		auto const index = m_index[slot];
+		if (index == 0) {
+			m_dirs.push_back({{m_dirChars.append(dir), std::uint32_t(dir.size())}, dirHash});
+			m_index[slot] = std::uint32_t(m_dirs.size());
+			return std::uint32_t(m_dirs.size() - 1);
+		}
+		if (m_dirs[index - 1].hash == dirHash && dirAt(index - 1) == dir) { return index - 1; }
+	}
+}
+
+void PathStore::rehash(std::size_t slots) {
+	assert(std::has_single_bit(slots));
+	m_index.assign(slots, 0);
+	for (std::uint32_t i = 0; i < m_dirs.size(); ++i) {
+		auto slot = std::size_t(m_dirs[i].hash) & (slots - 1);
+		while (m_index[slot] != 0) { slot = (slot + 1) & (slots - 1); }
+		m_index[slot] = i + 1;
+	}
+}
+} // namespace jk
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Append-only store of file paths, split into interned directories and filenames
+///
+/// Each path costs one small entry plus its filename; directories shared by many paths are stored once.
+/// Storage is in fixed-size chunks that never move, shared by copies: a copy costs a pointer per chunk, and keeps reading
+/// what was added before it was made while the original carries on adding (beyond the copy's size()).
+/// Views handed out stay valid for the lifetime of the store (or any copy). Filenames are null terminated.
+///
+class PathStore {
+  public:
+	using Id = std::uint32_t;
+
+	// Where the filename starts: past the last separator (0 if none)
+	static constexpr std::size_t split(std::string_view path) noexcept {
+		auto const sep = path.find_last_of("/\\");
+		return sep == std::string_view::npos ? 0 : sep + 1;
+	}
+
+	Id add(std::string_view path);
+	void clear() noexcept;
+	// O(chunks): a copy that carries on adding, taking over the directory index; this one should only be read from now on
+	// (adding to it again first rebuilds its index)
+	PathStore fork();
+
+	// Includes the trailing separator (if any)
+	std::string_view directory(Id id) const noexcept;
+	// Directories are interned: ids in the same directory (and only those) share one
+	std::uint32_t directoryIndex(Id id) const noexcept { return m_entries[id].dir; }
+	std::string_view filename(Id id) const noexcept;
+	std::string path(Id id) const;
+	bool equals(Id id, std::string_view path) const noexcept;
+	// Same path (ids of the same path added more than once differ)
+	bool equals(Id lhs, Id rhs) const noexcept;
+	// Equal for equal paths: hash(path) == hash(id) if equals(id, path)
+	std::uint64_t hash(Id id) const noexcept;
+	std::uint64_t hash(std::string_view path) const noexcept;
+
+	std::size_t size() const noexcept { return m_entries.size(); }
+	std::size_t directories() const noexcept { return m_dirs.size(); }
+	// Heap bytes referenced (shared chunks included)
+	std::size_t bytes() const noexcept;
+
+  private:
+	static constexpr std::size_t chunk_items_v = 1024;
+	static constexpr std::size_t chunk_chars_v = 16 * 1024;
+
+	// Fixed-size chunks of T, appended to in place
+	template <typename T>
+	class Chunks {
+	  public:
+		T const& operator[](std::size_t index) const noexcept { return m_chunks[index / chunk_items_v][index % chunk_items_v]; }
+		std::size_t size() const noexcept { return m_size; }
+		std::size_t bytes() const noexcept { return m_chunks.size() * chunk_items_v * sizeof(T); }
+
+		void push_back(T const& item) {
+			if (m_size % chunk_items_v == 0) { m_chunks.push_back(std::make_shared<T[]>(chunk_items_v)); }
+			m_chunks.back()[m_size++ % chunk_items_v] = item;
+		}
+
+	  private:
+		std::vector<std::shared_ptr<T[]>> m_chunks;
+		std::size_t m_size{};
+	};
+
+	// Null terminated strings, located by (chunk << 16 | offset); a string never spans chunks
+	class Chars {
+	  public:
+		char const* operator[](std::uint32_t location) const noexcept { return m_chunks[location >> 16].get() + (location & 0xffff); }
+		std::size_t bytes() const noexcept { return m_chunks.size() * chunk_chars_v; }
+
+		std::uint32_t append(std::string_view str);
+
+	  private:
+		std::vector<std::shared_ptr<char[]>> m_chunks;
+		std::size_t m_used{};
+	};
+
+	struct Slice {
+		std::uint32_t location{};
+		std::uint32_t size{};
+	};
+	struct Entry {
+		std::uint32_t dir{};
+		Slice name;
+	};
+	struct Dir {
+		Slice chars;
+		std::uint64_t hash{};
+	};
+
+	std::uint32_t intern(std::string_view dir);
+	void rehash(std::size_t slots);
+	std::string_view dirAt(std::uint32_t index) const noexcept { return {m_dirChars[m_dirs[index].chars.location], m_dirs[index].chars.size}; }
+
+	Chunks<Entry> m_entries;
+	Chars m_names;
+	Chunks<Dir> m_dirs;
+	Chars m_dirChars;
+	// only used by add(), so not shared: open addressed, directory index + 1, 0 if empty
+	std::vector<std::uint32_t> m_index;
+};
+} // namespace jk
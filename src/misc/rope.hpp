@@ -0,0 +1,282 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Persistent sequence: a height balanced tree over immutable chunks of up to chunk_v items
+///
+/// Edits return a new Rope in O(log n), sharing everything but the nodes on the edited paths (and a chunk or two) with the original,
+/// so keeping earlier versions around costs about as much as the edits themselves. Copies are O(1).
+/// Chunks are at least half full (unless there's only one): where an edit leaves a small one, it's repacked with its neighbours.
+/// Nodes are never modified once built: any version can be read from any thread.
+///
+template <typename T>
+class Rope {
+  public:
+	static constexpr std::size_t chunk_v = 128;
+	static constexpr std::size_t half_v = chunk_v / 2;
+
+	Rope() = default;
+	explicit Rope(std::span<T const> items) : m_root(build(items)) {}
+
+	std::size_t size() const noexcept { return m_root ? m_root->size : 0; }
+	bool empty() const noexcept { return !m_root; }
+	// O(log n); index must be in range
+	T const& operator[](std::size_t index) const noexcept;
+
+	Rope insert(std::size_t index, Rope const& items) const;
+	Rope insert(std::size_t index, std::span<T const> items) const { return insert(index, Rope(items)); }
+	Rope erase(std::size_t first, std::size_t count = 1) const;
+	Rope assign(std::size_t index, T value) const;
+	Rope slice(std::size_t first, std::size_t count) const;
+	static Rope concat(Rope const& lhs, Rope const& rhs) { return Rope(join(lhs.m_root, rhs.m_root)); }
+
+	// Visits items in order, a chunk (std::span<T const>) at a time, until f returns false; returns false if stopped early
+	template <typename F>
+	bool each(F&& f) const {
+		return visit(m_root.get(), f);
+	}
+	std::vector<T> flatten() const;
+
+  private:
+	struct Node {
+		std::shared_ptr<Node const> left;
+		std::shared_ptr<Node const> right;
+		std::vector<T> items; // leaves only
+		std::size_t size{};
+		int height{}; // leaves are 0
+	};
+	using Ptr = std::shared_ptr<Node const>;
+
+	explicit Rope(Ptr root) noexcept : m_root(std::move(root)) {}
+
+	static int height(Ptr const& node) noexcept { return node ? node->height : -1; }
+	static Ptr leaf(std::vector<T> items);
+	static Ptr node(Ptr left, Ptr right);
+	static Ptr balance(Ptr const& left, Ptr const& right);
+	static Ptr link(Ptr const& left, Ptr const& right);
+	static Ptr join(Ptr left, Ptr right);
+	static std::pair<Ptr, Ptr> split(Ptr const& root, std::size_t index);
+	static Ptr const& first(Ptr const& root) noexcept { return root->height == 0 ? root : first(root->left); }
+	static Ptr const& last(Ptr const& root) noexcept { return root->height == 0 ? root : last(root->right); }
+	static Ptr dropFirst(Ptr const& root);
+	static Ptr dropLast(Ptr const& root);
+	static Ptr tidy(Ptr root);
+	static Ptr assign(Ptr const& root, std::size_t index, T value);
+	static Ptr build(std::span<T const> items);
+
+	template <typename F>
+	static bool visit(Node const* node, F& f) {
+		if (!node) { return true; }
+		if (node->height == 0) { return f(std::span<T const>(node->items)); }
+		return visit(node->left.get(), f) && visit(node->right.get(), f);
+	}
+
+	Ptr m_root;
+};
+
+// impl
+
+template <typename T>
+T const& Rope<T>::operator[](std::size_t index) const noexcept {
+	auto const* node = m_root.get();
+	while (node->height > 0) {
+		if (index < node->left->size) {
+			node = node->left.get();
+		} else {
+			index -= node->left->size;
+			node = node->right.get();
+		}
+	}
+	return node->items[index];
+}
+
+template <typename T>
+Rope<T> Rope<T>::insert(std::size_t index, Rope const& items) const {
+	auto [head, tail] = split(m_root, index);
+	return Rope(join(join(head, items.m_root), tail));
+}
+
+template <typename T>
+Rope<T> Rope<T>::erase(std::size_t first, std::size_t count) const {
+	auto [head, rest] = split(m_root, first);
+	// a cut end with nothing to join it to (erasing a head or a tail) is left to tidy()
+	return Rope(tidy(join(head, split(rest, count).second)));
+}
+
+template <typename T>
+Rope<T> Rope<T>::assign(std::size_t index, T value) const {
+	if (index >= size()) { return *this; }
+	return Rope(assign(m_root, index, std::move(value)));
+}
+
+template <typename T>
+Rope<T> Rope<T>::slice(std::size_t first, std::size_t count) const {
+	// both ends may have been cut short
+	return Rope(tidy(split(split(m_root, first).second, count).first));
+}
+
+template <typename T>
+std::vector<T> Rope<T>::flatten() const {
+	std::vector<T> ret;
+	ret.reserve(size());
+	each([&ret](std::span<T const> chunk) {
+		ret.insert(ret.end(), chunk.begin(), chunk.end());
+		return true;
+	});
+	return ret;
+}
+
+template <typename T>
+auto Rope<T>::leaf(std::vector<T> items) -> Ptr {
+	if (items.empty()) { return {}; }
+	auto ret = std::make_shared<Node>();
+	ret->size = items.size();
+	ret->items = std::move(items);
+	return ret;
+}
+
+template <typename T>
+auto Rope<T>::node(Ptr left, Ptr right) -> Ptr {
+	auto ret = std::make_shared<Node>();
+	ret->size = left->size + right->size;
+	ret->height = std::max(left->height, right->height) + 1;
+	ret->left = std::move(left);
+	ret->right = std::move(right);
+	return ret;
+}
+
+template <typename T>
+auto Rope<T>::balance(Ptr const& left, Ptr const& right) -> Ptr {
+	// link() never leaves the sides more than two apart: one single or double rotation restores the balance
+	if (left->height > right->height + 1) {
+		auto const& l = *left;
+		if (height(l.left) >= height(l.right)) { return node(l.left, node(l.right, right)); }
+		auto const& x = *l.right;
+		return node(node(l.left, x.left), node(x.right, right));
+	}
+	if (right->height > left->height + 1) {
+		auto const& r = *right;
+		if (height(r.right) >= height(r.left)) { return node(node(left, r.left), r.right); }
+		auto const& x = *r.left;
+		return node(node(left, x.left), node(x.right, r.right));
+	}
+	return node(left, right);
+}
+
+template <typename T>
+auto Rope<T>::link(Ptr const& left, Ptr const& right) -> Ptr {
+	if (!left) { return right; }
+	if (!right) { return left; }
+	// descend the taller side's inner spine to a subtree of the other's height
+	if (left->height > right->height + 1) { return balance(left->left, link(left->right, right)); }
+	if (right->height > left->height + 1) { return balance(link(left, right->left), right->right); }
+	if (left->height == 0 && right->height == 0 && left->size + right->size <= chunk_v) {
+		auto items = left->items;
+		items.insert(items.end(), right->items.begin(), right->items.end());
+		return leaf(std::move(items));
+	}
+	return node(left, right);
+}
+
+template <typename T>
+auto Rope<T>::join(Ptr left, Ptr right) -> Ptr {
+	if (!left) { return right; }
+	if (!right) { return left; }
+	if (last(left)->size >= half_v && first(right)->size >= half_v) { return link(left, right); }
+	// repack the chunks either side of the seam (and a neighbour, if that's still short of half) into as few as fit
+	std::vector<T> items;
+	auto const take = [&items](Ptr const& leaf, bool front) { items.insert(front ? items.begin() : items.end(), leaf->items.begin(), leaf->items.end()); };
+	take(last(left), false);
+	left = dropLast(left);
+	take(first(right), false);
+	right = dropFirst(right);
+	while (items.size() < half_v && (left || right)) {
+		if (left) {
+			take(last(left), true);
+			left = dropLast(left);
+		} else {
+			take(first(right), false);
+			right = dropFirst(right);
+		}
+	}
+	return link(link(left, build(items)), right);
+}
+
+template <typename T>
+auto Rope<T>::split(Ptr const& root, std::size_t index) -> std::pair<Ptr, Ptr> {
+	if (!root || index == 0) { return {{}, root}; }
+	if (index >= root->size) { return {root, {}}; }
+	if (root->height == 0) {
+		auto const& items = root->items;
+		auto const mid = items.begin() + std::ptrdiff_t(index);
+		return {leaf({items.begin(), mid}), leaf({mid, items.end()})};
+	}
+	auto const left = root->left->size;
+	if (index < left) {
+		// neighbours before the split: no new seams, only the cut ends
+		auto [head, tail] = split(root->left, index);
+		return {std::move(head), link(tail, root->right)};
+	}
+	if (index > left) {
+		auto [head, tail] = split(root->right, index - left);
+		return {link(root->left, head), std::move(tail)};
+	}
+	return {root->left, root->right};
+}
+
+template <typename T>
+auto Rope<T>::dropFirst(Ptr const& root) -> Ptr {
+	if (root->height == 0) { return {}; }
+	return link(dropFirst(root->left), root->right);
+}
+
+template <typename T>
+auto Rope<T>::dropLast(Ptr const& root) -> Ptr {
+	if (root->height == 0) { return {}; }
+	return link(root->left, dropLast(root->right));
+}
+
+template <typename T>
+auto Rope<T>::tidy(Ptr root) -> Ptr {
+	if (!root || root->height == 0) { return root; }
+	if (first(root)->size < half_v) { root = join(first(root), dropFirst(root)); }
+	if (root->height > 0 && last(root)->size < half_v) { root = join(dropLast(root), last(root)); }
+	return root;
+}
+
+template <typename T>
+auto Rope<T>::assign(Ptr const& root, std::size_t index, T value) -> Ptr {
+	if (root->height == 0) {
+		auto items = root->items;
+		items[index] = std::move(value);
+		return leaf(std::move(items));
+	}
+	auto const left = root->left->size;
+	if (index < left) { return node(assign(root->left, index, std::move(value)), root->right); }
+	return node(root->left, assign(root->right, index - left, std::move(value)));
+}
+
+template <typename T>
+auto Rope<T>::build(std::span<T const> items) -> Ptr {
+	// spread evenly rather than leaving a short last chunk: each ends up more than half full
+	auto const chunks = (items.size() + chunk_v - 1) / chunk_v;
+	std::vector<Ptr> level;
+	level.reserve(chunks);
+	for (std::size_t i = 0; i < chunks; ++i) {
+		auto const chunk = items.subspan(items.size() * i / chunks, items.size() * (i + 1) / chunks - items.size() * i / chunks);
+		level.push_back(leaf({chunk.begin(), chunk.end()}));
+	}
+	while (level.size() > 1) {
+		std::vector<Ptr> next;
+		next.reserve((level.size() + 1) / 2);
+		for (std::size_t i = 0; i < level.size(); i += 2) { next.push_back(i + 1 < level.size() ? link(level[i], level[i + 1]) : level[i]); }
+		level = std::move(next);
+	}
+	return level.empty() ? Ptr() : std::move(level.front());
+}
+} // namespace jk
@@ -0,0 +1,23 @@
+#include <misc/sample_store.hpp>
+#include <algorithm>
+#include <cassert>
+
+namespace jk {
+SampleStore SampleStore::make(std::span<std::int16_t const> samples, std::size_t channels, std::size_t sampleRate) {
+	assert(channels > 0);
+	SampleStore ret;
+	ret.m_channels = channels;
+	ret.m_sampleRate = sampleRate;
+	ret.m_frames = samples.size() / channels;
+	samples = samples.first(ret.m_frames * channels);
+	ret.m_samples.assign(samples.begin(), samples.end());
+	return ret;
+}
+
+std::size_t SampleStore::read(std::size_t first, std::span<std::int16_t> out) const {
+	if (first >= m_frames) { return 0; }
+	auto const count = std::min(out.size() / m_channels, m_frames - first);
+	std::copy_n(m_samples.begin() + std::ptrdiff_t(first * m_channels), count * m_channels, out.begin());
+	return count;
+}
+} // namespace jk
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace jk {
+///
+/// \brief Read-only interleaved 16-bit audio
+///
+class SampleStore {
+  public:
+	static SampleStore make(std::span<std::int16_t const> samples, std::size_t channels, std::size_t sampleRate);
+
+	std::size_t channels() const noexcept { return m_channels; }
+	std::size_t sampleRate() const noexcept { return m_sampleRate; }
+	std::size_t frames() const noexcept { return m_frames; }
+	// Resident size of sample data
+	std::size_t bytes() const noexcept { return m_samples.capacity() * sizeof(std::int16_t); }
+
+	// Copy frames [first, first + out.size() / channels()) into out (interleaved); returns frames read
+	std::size_t read(std::size_t first, std::span<std::int16_t> out) const;
+
+  private:
+	std::vector<std::int16_t> m_samples;
+	std::size_t m_channels{};
+	std::size_t m_sampleRate{};
+	std::size_t m_frames{};
+};
+} // namespace jk
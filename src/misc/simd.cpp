@@ -0,0 +1,218 @@
+#include <misc/simd.hpp>
+#include <algorithm>
+#include <cassert>
+
+namespace jk::simd {
+namespace {
+Peak peakScalar(std::span<std::int16_t const> samples, Peak ret) noexcept {
+	for (std::int16_t const s : samples) {
+		ret.min = s < ret.min ? s : ret.min;
+		ret.max = s > ret.max ? s : ret.max;
+		ret.sumSquares += std::uint64_t(std::int32_t(s) * std::int32_t(s));
+	}
+	ret.count += samples.size();
+	return ret;
+}
+} // namespace
+
+Peak peak(std::span<std::int16_t const> samples) noexcept {
+	if (samples.empty()) { return {}; }
+	Peak ret{samples[0], samples[0]};
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	if (samples.size() >= 8) {
+		__m128i vmin = _mm_set1_epi16(samples[0]);
+		__m128i vmax = vmin;
+		__m128i vsum = _mm_setzero_si128();
+		__m128i const zero = _mm_setzero_si128();
+		for (; i + 8 <= samples.size(); i += 8) {
+			__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(samples.data() + i));
+			vmin = _mm_min_epi16(vmin, v);
+			vmax = _mm_max_epi16(vmax, v);
+			// pairwise sums of squares fit in 32 bits unsigned (2 * 32768^2), widen to 64 before accumulating
+			__m128i const sq = _mm_madd_epi16(v, v);
+			vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(sq, zero));
+			vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(sq, zero));
+		}
+		alignas(16) std::int16_t mins[8], maxs[8];
+		alignas(16) std::uint64_t sums[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(mins), vmin);
+		_mm_store_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+		_mm_store_si128(reinterpret_cast<__m128i*>(sums), vsum);
+		for (int j = 0; j < 8; ++j) {
+			ret.min = mins[j] < ret.min ? mins[j] : ret.min;
+			ret.max = maxs[j] > ret.max ? maxs[j] : ret.max;
+		}
+		ret.sumSquares = sums[0] + sums[1];
+		ret.count = i;
+	}
+#elif defined(JK_SIMD_NEON)
+	if (samples.size() >= 8) {
+		int16x8_t vmin = vdupq_n_s16(samples[0]);
+		int16x8_t vmax = vmin;
+		uint64x2_t vsum = vdupq_n_u64(0);
+		for (; i + 8 <= samples.size(); i += 8) {
+			int16x8_t const v = vld1q_s16(samples.data() + i);
+			vmin = vminq_s16(vmin, v);
+			vmax = vmaxq_s16(vmax, v);
+			int32x4_t const lo = vmull_s16(vget_low_s16(v), vget_low_s16(v));
+			int32x4_t const hi = vmull_s16(vget_high_s16(v), vget_high_s16(v));
+			vsum = vpadalq_u32(vsum, vreinterpretq_u32_s32(lo));
+			vsum = vpadalq_u32(vsum, vreinterpretq_u32_s32(hi));
+		}
+		ret.min = vminvq_s16(vmin);
+		ret.max = vmaxvq_s16(vmax);
+		ret.sumSquares = vgetq_lane_u64(vsum, 0) + vgetq_lane_u64(vsum, 1);
+		ret.count = i;
+	}
+#endif
+	return peakScalar(samples.subspan(i), ret);
+}
+
+void toFloat(std::span<std::int16_t const> samples, std::span<float> out) noexcept {
+	assert(out.size() >= samples.size());
+	float const scale = 1.0f / 32768.0f;
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	__m128 const vscale = _mm_set1_ps(scale);
+	for (; i + 8 <= samples.size(); i += 8) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(samples.data() + i));
+		// sign extend by unpacking into the high halves and shifting back down
+		__m128i const lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i const hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out.data() + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+		_mm_storeu_ps(out.data() + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+	}
+#elif defined(JK_SIMD_NEON)
+	for (; i + 8 <= samples.size(); i += 8) {
+		int16x8_t const v = vld1q_s16(samples.data() + i);
+		vst1q_f32(out.data() + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+		vst1q_f32(out.data() + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+	}
+#endif
+	for (; i < samples.size(); ++i) { out[i] = float(samples[i]) * scale; }
+}
+
+void toLanes(std::span<std::int16_t const> samples, std::size_t channels, std::span<float> out) noexcept {
+	assert(channels > 0 && out.size() >= samples.size() / channels * 4);
+	auto const frames = samples.size() / channels;
+	auto const used = std::min(channels, std::size_t(4));
+	float const scale = 1.0f / 32768.0f;
+	for (std::size_t f = 0; f < frames; ++f) {
+		auto const* in = samples.data() + f * channels;
+		float* lanes = out.data() + f * 4;
+		for (std::size_t c = 0; c < 4; ++c) { lanes[c] = c < used ? float(in[c]) * scale : 0.0f; }
+	}
+}
+
+void fromLanes(std::span<float const> frames, std::size_t channels, std::span<std::int16_t> out) noexcept {
+	assert(channels > 0 && frames.size() >= out.size() / channels * 4);
+	auto const count = out.size() / channels;
+	auto const used = std::min(channels, std::size_t(4));
+	for (std::size_t f = 0; f < count; ++f) {
+		auto* samples = out.data() + f * channels;
+		std::int16_t lanes[4];
+#if defined(JK_SIMD_SSE2)
+		auto const scaled = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(frames.data() + f * 4), _mm_set1_ps(32768.0f)));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(lanes), _mm_packs_epi32(scaled, scaled));
+#elif defined(JK_SIMD_NEON)
+		vst1_s16(lanes, vqmovn_s32(vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(frames.data() + f * 4), 32768.0f))));
+#else
+		for (std::size_t c = 0; c < 4; ++c) { lanes[c] = std::int16_t(std::clamp(std::lrint(frames[f * 4 + c] * 32768.0f), -32768L, 32767L)); }
+#endif
+		for (std::size_t c = 0; c < used; ++c) { samples[c] = lanes[c]; }
+	}
+}
+
+void multiply(std::span<float> inout, std::span<float const> rhs) noexcept {
+	assert(rhs.size() >= inout.size());
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	for (; i + 4 <= inout.size(); i += 4) { _mm_storeu_ps(inout.data() + i, _mm_mul_ps(_mm_loadu_ps(inout.data() + i), _mm_loadu_ps(rhs.data() + i))); }
+#elif defined(JK_SIMD_NEON)
+	for (; i + 4 <= inout.size(); i += 4) { vst1q_f32(inout.data() + i, vmulq_f32(vld1q_f32(inout.data() + i), vld1q_f32(rhs.data() + i))); }
+#endif
+	for (; i < inout.size(); ++i) { inout[i] *= rhs[i]; }
+}
+
+void magnitudes(std::span<float const> re, std::span<float const> im, std::span<float> out) noexcept {
+	assert(re.size() >= out.size() && im.size() >= out.size());
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	for (; i + 4 <= out.size(); i += 4) {
+		__m128 const r = _mm_loadu_ps(re.data() + i), m = _mm_loadu_ps(im.data() + i);
+		_mm_storeu_ps(out.data() + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m))));
+	}
+#elif defined(JK_SIMD_NEON)
+	for (; i + 4 <= out.size(); i += 4) {
+		float32x4_t const r = vld1q_f32(re.data() + i), m = vld1q_f32(im.data() + i);
+		vst1q_f32(out.data() + i, vsqrtq_f32(vmlaq_f32(vmulq_f32(r, r), m, m)));
+	}
+#endif
+	for (; i < out.size(); ++i) { out[i] = std::sqrt(re[i] * re[i] + im[i] * im[i]); }
+}
+
+void within(std::span<float const> values, float lo, float hi, bool invert, std::span<std::uint8_t> inout) noexcept {
+	assert(values.size() >= inout.size());
+	std::uint8_t const flip = invert ? 0xff : 0;
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	__m128 const vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+	__m128i const vflip = _mm_set1_epi8(char(flip));
+	for (; i + 16 <= inout.size(); i += 16) {
+		__m128i lanes[4];
+		for (std::size_t j = 0; j < 4; ++j) {
+			__m128 const v = _mm_loadu_ps(values.data() + i + j * 4);
+			lanes[j] = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(v, vlo), _mm_cmple_ps(v, vhi)));
+		}
+		// lanes are 0 / -1: saturating packs narrow them to 0 / -1 bytes
+		__m128i const bytes = _mm_packs_epi16(_mm_packs_epi32(lanes[0], lanes[1]), _mm_packs_epi32(lanes[2], lanes[3]));
+		auto* dst = reinterpret_cast<__m128i*>(inout.data() + i);
+		_mm_storeu_si128(dst, _mm_and_si128(_mm_loadu_si128(dst), _mm_xor_si128(bytes, vflip)));
+	}
+#elif defined(JK_SIMD_NEON)
+	float32x4_t const vlo = vdupq_n_f32(lo), vhi = vdupq_n_f32(hi);
+	for (; i + 16 <= inout.size(); i += 16) {
+		uint32x4_t lanes[4];
+		for (std::size_t j = 0; j < 4; ++j) {
+			float32x4_t const v = vld1q_f32(values.data() + i + j * 4);
+			lanes[j] = vandq_u32(vcgeq_f32(v, vlo), vcleq_f32(v, vhi));
+		}
+		uint16x8_t const front = vcombine_u16(vmovn_u32(lanes[0]), vmovn_u32(lanes[1]));
+		uint16x8_t const back = vcombine_u16(vmovn_u32(lanes[2]), vmovn_u32(lanes[3]));
+		uint8x16_t const bytes = veorq_u8(vcombine_u8(vmovn_u16(front), vmovn_u16(back)), vdupq_n_u8(flip));
+		vst1q_u8(inout.data() + i, vandq_u8(vld1q_u8(inout.data() + i), bytes));
+	}
+#endif
+	for (; i < inout.size(); ++i) {
+		std::uint8_t const in = values[i] >= lo && values[i] <= hi ? 0xff : 0;
+		inout[i] &= in ^ flip;
+	}
+}
+
+void equal(std::span<std::uint8_t const> values, std::uint8_t value, bool invert, std::span<std::uint8_t> inout) noexcept {
+	assert(values.size() >= inout.size());
+	std::uint8_t const flip = invert ? 0xff : 0;
+	std::size_t i = 0;
+#if defined(JK_SIMD_SSE2)
+	__m128i const vvalue = _mm_set1_epi8(char(value));
+	__m128i const vflip = _mm_set1_epi8(char(flip));
+	for (; i + 16 <= inout.size(); i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(values.data() + i));
+		auto* dst = reinterpret_cast<__m128i*>(inout.data() + i);
+		_mm_storeu_si128(dst, _mm_and_si128(_mm_loadu_si128(dst), _mm_xor_si128(_mm_cmpeq_epi8(v, vvalue), vflip)));
+	}
+#elif defined(JK_SIMD_NEON)
+	uint8x16_t const vvalue = vdupq_n_u8(value);
+	uint8x16_t const vflip = vdupq_n_u8(flip);
+	for (; i + 16 <= inout.size(); i += 16) {
+		uint8x16_t const v = vld1q_u8(values.data() + i);
+		vst1q_u8(inout.data() + i, vandq_u8(vld1q_u8(inout.data() + i), veorq_u8(vceqq_u8(v, vvalue), vflip)));
+	}
+#endif
+	for (; i < inout.size(); ++i) {
+		std::uint8_t const in = values[i] == value ? 0xff : 0;
+		inout[i] &= in ^ flip;
+	}
+}
+} // namespace jk::simd
@@ -0,0 +1,103 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define JK_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define JK_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace jk::simd {
+///
+/// \brief Four float lanes, one per channel (or band) processed in parallel
+///
+struct f32x4 {
+#if defined(JK_SIMD_SSE2)
+	__m128 v;
+
+	static f32x4 load(float const* src) noexcept { return {_mm_loadu_ps(src)}; }
+	static f32x4 splat(float f) noexcept { return {_mm_set1_ps(f)}; }
+	void store(float* dst) const noexcept { _mm_storeu_ps(dst, v); }
+
+	friend f32x4 operator+(f32x4 a, f32x4 b) noexcept { return {_mm_add_ps(a.v, b.v)}; }
+	friend f32x4 operator-(f32x4 a, f32x4 b) noexcept { return {_mm_sub_ps(a.v, b.v)}; }
+	friend f32x4 operator*(f32x4 a, f32x4 b) noexcept { return {_mm_mul_ps(a.v, b.v)}; }
+	friend f32x4 max(f32x4 a, f32x4 b) noexcept { return {_mm_max_ps(a.v, b.v)}; }
+	friend f32x4 abs(f32x4 a) noexcept { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+#elif defined(JK_SIMD_NEON)
+	float32x4_t v;
+
+	static f32x4 load(float const* src) noexcept { return {vld1q_f32(src)}; }
+	static f32x4 splat(float f) noexcept { return {vdupq_n_f32(f)}; }
+	void store(float* dst) const noexcept { vst1q_f32(dst, v); }
+
+	friend f32x4 operator+(f32x4 a, f32x4 b) noexcept { return {vaddq_f32(a.v, b.v)}; }
+	friend f32x4 operator-(f32x4 a, f32x4 b) noexcept { return {vsubq_f32(a.v, b.v)}; }
+	friend f32x4 operator*(f32x4 a, f32x4 b) noexcept { return {vmulq_f32(a.v, b.v)}; }
+	friend f32x4 max(f32x4 a, f32x4 b) noexcept { return {vmaxq_f32(a.v, b.v)}; }
+	friend f32x4 abs(f32x4 a) noexcept { return {vabsq_f32(a.v)}; }
+#else
+	float v[4];
+
+	static f32x4 load(float const* src) noexcept { return {{src[0], src[1], src[2], src[3]}}; }
+	static f32x4 splat(float f) noexcept { return {{f, f, f, f}}; }
+	void store(float* dst) const noexcept {
+		for (int i = 0; i < 4; ++i) { dst[i] = v[i]; }
+	}
+
+	friend f32x4 operator+(f32x4 a, f32x4 b) noexcept { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+	friend f32x4 operator-(f32x4 a, f32x4 b) noexcept { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+	friend f32x4 operator*(f32x4 a, f32x4 b) noexcept { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+	friend f32x4 max(f32x4 a, f32x4 b) noexcept {
+		return {{a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]}};
+	}
+	friend f32x4 abs(f32x4 a) noexcept { return {{std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3])}}; }
+#endif
+
+	f32x4& operator+=(f32x4 rhs) noexcept { return *this = *this + rhs; }
+};
+
+///
+/// \brief Extrema and energy of a run of 16-bit samples
+///
+struct Peak {
+	std::int16_t min{};
+	std::int16_t max{};
+	std::uint64_t sumSquares{};
+	std::uint64_t count{};
+
+	constexpr Peak& operator+=(Peak const& rhs) noexcept {
+		if (count == 0) { return *this = rhs; }
+		if (rhs.count == 0) { return *this; }
+		min = rhs.min < min ? rhs.min : min;
+		max = rhs.max > max ? rhs.max : max;
+		sumSquares += rhs.sumSquares;
+		count += rhs.count;
+		return *this;
+	}
+};
+
+Peak peak(std::span<std::int16_t const> samples) noexcept;
+
+// Convert samples to float, scaled to [-1, 1]
+void toFloat(std::span<std::int16_t const> samples, std::span<float> out) noexcept;
+// Spread interleaved samples into 4-lane frames (unused lanes are zeroed), scaled to [-1, 1]
+void toLanes(std::span<std::int16_t const> samples, std::size_t channels, std::span<float> out) noexcept;
+// Gather 4-lane frames back into interleaved samples (channels past 4 are left untouched), saturated
+void fromLanes(std::span<float const> frames, std::size_t channels, std::span<std::int16_t> out) noexcept;
+
+// inout[i] *= rhs[i]
+void multiply(std::span<float> inout, std::span<float const> rhs) noexcept;
+// out[i] = |re[i] + i * im[i]|
+void magnitudes(std::span<float const> re, std::span<float const> im, std::span<float> out) noexcept;
+
+// Masks hold 0 / 0xff per row, and are narrowed down a column at a time
+// inout[i] &= (lo <= values[i] <= hi) != invert
+void within(std::span<float const> values, float lo, float hi, bool invert, std::span<std::uint8_t> inout) noexcept;
+// inout[i] &= (values[i] == value) != invert
+void equal(std::span<std::uint8_t const> values, std::uint8_t value, bool invert, std::span<std::uint8_t> inout) noexcept;
+} // namespace jk::simd
@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace jk {
+///
+/// \brief Lock-free single producer / single consumer hand-off of the latest value
+///
+/// The producer fills back() and publishes it; the consumer always reads the most recently published value.
+/// Neither side ever waits on the other.
+///
+template <typename T>
+class TripleBuffer {
+  public:
+	T& back() noexcept { return m_slots[m_back]; }
+	void publish() noexcept { m_back = m_middle.exchange(std::uint8_t(m_back | dirty_v), std::memory_order_acq_rel) & index_v; }
+
+	T const& front() noexcept {
+		if (m_middle.load(std::memory_order_relaxed) & dirty_v) { m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & index_v; }
+		return m_slots[m_front];
+	}
+
+  private:
+	static constexpr std::uint8_t index_v = 0x3;
+	static constexpr std::uint8_t dirty_v = 0x4;
+
+	std::array<T, 3> m_slots{};
+	std::uint8_t m_back = 0;
+	std::atomic<std::uint8_t> m_middle = 1;
+	std::uint8_t m_front = 2;
+};
+} // namespace jk
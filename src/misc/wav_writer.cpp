@@ -0,0 +1,63 @@
+#include <misc/wav_writer.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace jk {
+namespace {
+template <typename T>
+void writeLE(std::ostream& out, T value) {
+	std::array<char, sizeof(T)> bytes;
+	for (std::size_t i = 0; i < sizeof(T); ++i) { bytes[i] = char((std::uint64_t(value) >> (i * 8)) & 0xFF); }
+	out.write(bytes.data(), std::streamsize(bytes.size()));
+}
+
+void writeHeader(std::ostream& out, std::size_t channels, std::size_t sampleRate, std::uint32_t dataSize) {
+	auto const blockAlign = std::uint16_t(channels * sizeof(std::int16_t));
+	out.write("RIFF", 4);
+	writeLE(out, std::uint32_t(36 + dataSize));
+	out.write("WAVEfmt ", 8);
+	writeLE(out, std::uint32_t(16));
+	writeLE(out, std::uint16_t(1)); // PCM
+	writeLE(out, std::uint16_t(channels));
+	writeLE(out, std::uint32_t(sampleRate));
+	writeLE(out, std::uint32_t(sampleRate * blockAlign));
+	writeLE(out, blockAlign);
+	writeLE(out, std::uint16_t(16));
+	out.write("data", 4);
+	writeLE(out, dataSize);
+}
+} // namespace
+
+bool WavWriter::open(std::string const& path, std::size_t channels, std::size_t sampleRate) {
+	m_file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	if (!m_file) { return false; }
+	m_channels = channels;
+	m_sampleRate = sampleRate;
+	m_bytes = 0;
+	writeHeader(m_file, channels, sampleRate, 0);
+	return bool(m_file);
+}
+
+bool WavWriter::write(std::span<std::int16_t const> samples) {
+	if (!m_file) { return false; }
+	auto const room = std::size_t((max_data_v - m_bytes) / sizeof(std::int16_t));
+	samples = samples.first(std::min(samples.size(), room));
+	if constexpr (std::endian::native == std::endian::little) {
+		m_file.write(reinterpret_cast<char const*>(samples.data()), std::streamsize(samples.size_bytes()));
+	} else {
+		for (auto const sample : samples) { writeLE(m_file, std::uint16_t(sample)); }
+	}
+	m_bytes += samples.size_bytes();
+	return bool(m_file);
+}
+
+bool WavWriter::finish() {
+	if (!m_file.is_open()) { return false; }
+	m_file.seekp(0);
+	writeHeader(m_file, m_channels, m_sampleRate, std::uint32_t(m_bytes));
+	bool const ret = bool(m_file.flush());
+	m_file.close();
+	return ret;
+}
+} // namespace jk
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+
+namespace jk {
+///
+/// \brief Streams interleaved 16-bit PCM into a canonical WAV file
+///
+/// Sizes in the header are patched on finish(); data beyond 4 GiB is dropped (the format can't describe it).
+///
+class WavWriter {
+  public:
+	static constexpr std::uint64_t max_data_v = 0xFFFFFFFFULL - 36;
+
+	bool open(std::string const& path, std::size_t channels, std::size_t sampleRate);
+	bool write(std::span<std::int16_t const> samples);
+	bool finish();
+
+	bool isOpen() const noexcept { return m_file.is_open(); }
+	std::size_t channels() const noexcept { return m_channels; }
+	std::size_t sampleRate() const noexcept { return m_sampleRate; }
+	std::uint64_t bytes() const noexcept { return m_bytes; }
+
+  private:
+	std::ofstream m_file;
+	std::uint64_t m_bytes{};
+	std::size_t m_channels{};
+	std::size_t m_sampleRate{};
+};
+} // namespace jk
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+#include <source_location>
+
+namespace jk::test {
+///
+/// \brief Minimal checks for the standalone tests: failures are printed and counted, and main() returns result()
+///
+inline int g_failures{};
+
+inline bool check(bool pred, char const* expr, std::source_location const loc = std::source_location::current()) {
+	if (!pred) {
+		std::fprintf(stderr, "%s:%u: check failed: %s\n", loc.file_name(), unsigned(loc.line()), expr);
+		++g_failures;
+	}
+	return pred;
+}
+
+inline int result() {
+	if (g_failures > 0) { std::fprintf(stderr, "%d checks failed\n", g_failures); }
+	return g_failures > 0 ? 1 : 0;
+}
+} // namespace jk::test
+
+#define JK_CHECK(expr) ::jk::test::check(static_cast<bool>(expr), #expr)
@@ -0,0 +1,113 @@
+#include <check.hpp>
+#include <misc/equalizer.hpp>
+#include <misc/gain_ramp.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numbers>
+#include <vector>
+
+// A preset change mid-playback, as the player does it: the track is re-rendered, then swapped in at silence between a ramp down
+// and a ramp up. capo holds each gain the player sets until the next tick (GainRamp::step_v), so that's what's modelled here.
+
+namespace {
+using namespace jk;
+using Clock = GainRamp::Clock;
+
+constexpr float rate_v = 48000.0f;
+constexpr std::size_t channels_v = 2;
+constexpr std::size_t frames_v = std::size_t(rate_v);
+constexpr float tone_v = 1000.0f;
+constexpr float amplitude_v = 4000.0f;
+
+std::vector<std::int16_t> tone() {
+	std::vector<std::int16_t> ret(frames_v * channels_v);
+	for (std::size_t frame = 0; frame < frames_v; ++frame) {
+		auto const sample = std::int16_t(amplitude_v * std::sin(2.0f * std::numbers::pi_v<float> * tone_v * float(frame) / rate_v));
+		for (std::size_t channel = 0; channel < channels_v; ++channel) { ret[frame * channels_v + channel] = sample; }
+	}
+	return ret;
+}
+
+std::vector<std::int16_t> render(Equalizer::Preset const& preset) {
+	auto ret = tone();
+	Equalizer{}.apply(preset, rate_v, channels_v, ret);
+	return ret;
+}
+
+// Largest step between consecutive samples
+float jump(std::vector<float> const& out) {
+	float ret{};
+	for (std::size_t i = 1; i < out.size(); ++i) { ret = std::max(ret, std::abs(out[i] - out[i - 1])); }
+	return ret;
+}
+
+// Of the first channel
+float jump(std::vector<std::int16_t> const& samples) {
+	std::vector<float> out;
+	for (std::size_t i = 0; i < samples.size(); i += channels_v) { out.push_back(samples[i]); }
+	return jump(out);
+}
+
+float peak(std::vector<std::int16_t> const& samples) {
+	float ret{};
+	for (auto const sample : samples) { ret = std::max(ret, std::abs(float(sample))); }
+	return ret;
+}
+} // namespace
+
+int main() {
+	Equalizer::Preset boost;
+	boost.bands[boost.count++] = {Equalizer::Band::Type::ePeak, tone_v, 1.0f, 12.0f};
+	auto const before = render({});
+	auto const after = render(boost);
+	JK_CHECK(peak(after) > 3.5f * peak(before));
+
+	// requested at the crest of a cycle, where a hard cut jumps the furthest
+	auto const request = frames_v / 2 + std::size_t(rate_v / tone_v / 4.0f);
+	auto const tick = std::size_t(rate_v * std::chrono::duration<float>(GainRamp::step_v).count());
+	auto const start = Clock::time_point{};
+	auto const at = [start](std::size_t frame) { return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(double(frame) / rate_v)); };
+
+	GainRamp ramp;
+	bool swapped{};
+	float gain = 1.0f;
+	std::vector<float> faded;
+	std::vector<float> cut;
+	faded.reserve(frames_v);
+	for (std::size_t frame = 0; frame < frames_v; ++frame) {
+		if (frame % tick == 0 || frame == request) {
+			auto const now = at(frame);
+			if (frame >= request && !swapped) {
+				if (ramp.silent(now)) {
+					ramp.up(now);
+					swapped = true;
+				} else {
+					ramp.down(now);
+				}
+			}
+			if (ramp.done(now)) { ramp.reset(); }
+			gain = ramp.gain(now);
+		}
+		auto const& source = swapped ? after : before;
+		faded.push_back(gain * float(source[frame * channels_v]));
+		cut.push_back(float((frame < request ? before : after)[frame * channels_v]));
+	}
+
+	JK_CHECK(swapped && !ramp.active());
+	// the signals' own steepest slope, plus one held gain step at the louder one's peak
+	auto const step = std::chrono::duration<float>(GainRamp::step_v) / std::chrono::duration<float>(GainRamp::duration_v);
+	auto const bound = std::max(jump(before), jump(after)) + step * peak(after) + 1.0f;
+	auto const fadedJump = jump(faded);
+	auto const cutJump = jump(cut);
+	std::printf("max step: natural %.0f, faded %.0f (bound %.0f), hard cut %.0f\n", std::max(jump(before), jump(after)), fadedJump, bound, cutJump);
+	JK_CHECK(fadedJump <= bound);
+	// the test would notice a hard cut
+	JK_CHECK(cutJump > 2.0f * bound);
+	// untouched outside the ramps
+	auto const settled = request + 2 * std::size_t(rate_v * std::chrono::duration<float>(GainRamp::duration_v).count()) + 2 * tick;
+	JK_CHECK(faded[request - 1] == float(before[(request - 1) * channels_v]));
+	JK_CHECK(faded[settled] == float(after[settled * channels_v]));
+	return test::result();
+}
@@ -0,0 +1,110 @@
+#include <check.hpp>
+#include <misc/path_store.hpp>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random paths added to a PathStore checked against a plain list of them, forking now and then as the player does when a
+// published tracklist still holds the store: every fork must keep reading what it had while the new one carries on adding.
+
+namespace {
+using namespace jk;
+using Paths = std::vector<std::string>;
+
+struct Snapshot {
+	PathStore store;
+	std::size_t size{};
+};
+
+std::string randomPath(std::mt19937& rng, std::size_t index) {
+	std::string ret;
+	// a few hundred directories, some nested, some paths without any, both separators
+	switch (rng() % 8) {
+	case 0: break;
+	case 1: ret = "C:\\music\\d" + std::to_string(rng() % 50) + "\\"; break;
+	default: ret = "/music/d" + std::to_string(rng() % 300) + (rng() % 2 == 0 ? "/sub/" : "/"); break;
+	}
+	// repeats of earlier filenames too: equal names in different directories must not compare equal
+	ret += "t" + std::to_string(rng() % 4 == 0 ? rng() % 100 : index) + std::string(rng() % 64, 'x') + ".wav";
+	return ret;
+}
+
+// Ids in [first, size)
+bool matches(PathStore const& store, Paths const& model, std::size_t first, std::size_t size, std::mt19937& rng) {
+	if (store.size() < size) { return false; }
+	for (std::size_t i = first; i < size; ++i) {
+		auto const id = PathStore::Id(i);
+		auto const& path = model[i];
+		auto const split = PathStore::split(path);
+		if (store.path(id) != path || store.directory(id) != path.substr(0, split) || store.filename(id) != path.substr(split)) { return false; }
+		// null terminated
+		if (store.filename(id).data()[store.filename(id).size()] != '\0') { return false; }
+		if (!store.equals(id, path) || store.hash(id) != store.hash(path)) { return false; }
+		// against another random one
+		auto const other = PathStore::Id(rng() % size);
+		if (store.equals(id, other) != (model[other] == path)) { return false; }
+		if (store.equals(id, model[other]) != (model[other] == path)) { return false; }
+		auto const sameDir = store.directory(other) == store.directory(id);
+		if ((store.directoryIndex(id) == store.directoryIndex(other)) != sameDir) { return false; }
+	}
+	return true;
+}
+} // namespace
+
+int main() {
+	std::mt19937 rng(47);
+	PathStore store;
+	Paths model;
+	std::vector<Snapshot> snapshots;
+
+	for (std::size_t round = 0; round < 40; ++round) {
+		// enough to fill several entry and character chunks over the rounds
+		auto const first = model.size();
+		auto const count = 1 + rng() % 3000;
+		for (std::size_t i = 0; i < count; ++i) {
+			// the same path again now and then: a new id that equals the old one
+			auto path = model.empty() || rng() % 16 != 0 ? randomPath(rng, model.size()) : model[rng() % model.size()];
+			auto const id = store.add(path);
+			JK_CHECK(id == model.size());
+			model.push_back(std::move(path));
+		}
+		JK_CHECK(matches(store, model, first, model.size(), rng));
+		if (rng() % 3 == 0) {
+			// the old one is only read from now on
+			auto forked = store.fork();
+			snapshots.push_back({std::move(store), model.size()});
+			store = std::move(forked);
+		}
+		if (rng() % 10 == 0 && !snapshots.empty()) {
+			// a copy reads what was added before it was made
+			auto const& snapshot = snapshots[rng() % snapshots.size()];
+			auto copy = snapshot.store;
+			JK_CHECK(copy.size() == snapshot.size);
+			JK_CHECK(matches(copy, model, 0, snapshot.size, rng));
+		}
+	}
+
+	std::size_t intact{};
+	for (auto const& snapshot : snapshots) {
+		JK_CHECK(snapshot.store.size() == snapshot.size);
+		intact += matches(snapshot.store, model, 0, snapshot.size, rng) ? 1 : 0;
+	}
+	std::printf("%zu paths in %zu directories, %zu/%zu forks intact, %zu bytes\n", model.size(), store.directories(), intact, snapshots.size(), store.bytes());
+	JK_CHECK(intact == snapshots.size());
+
+	// adding to a store forked from rebuilds its directory index: directories are still interned
+	if (!snapshots.empty()) {
+		auto& old = snapshots.back().store;
+		auto const directories = old.directories();
+		auto const id = old.add(model.front());
+		JK_CHECK(old.equals(id, PathStore::Id(0)));
+		JK_CHECK(old.directories() == directories);
+		JK_CHECK(old.directoryIndex(id) == old.directoryIndex(PathStore::Id(0)));
+	}
+
+	store.clear();
+	JK_CHECK(store.size() == 0 && store.directories() == 0);
+	JK_CHECK(store.path(store.add(model.back())) == model.back());
+	return test::result();
+}
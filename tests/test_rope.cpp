@@ -0,0 +1,154 @@
+#include <check.hpp>
+#include <misc/rope.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Random edits of a Rope checked against the same edits of a std::vector, keeping earlier versions around (as undo does):
+// each must still read exactly as it did when it was made.
+
+namespace {
+using namespace jk;
+using Items = std::vector<int>;
+
+struct Version {
+	Rope<int> rope;
+	Items model;
+};
+
+bool matches(Rope<int> const& rope, Items const& model) {
+	if (rope.size() != model.size() || rope.flatten() != model) { return false; }
+	for (std::size_t i = 0; i < model.size(); i += 1 + model.size() / 16) {
+		if (rope[i] != model[i]) { return false; }
+	}
+	return true;
+}
+
+// Every chunk fits in a leaf and is at least half full, unless it's the only one
+bool chunked(Rope<int> const& rope) {
+	auto const whole = rope.size() <= Rope<int>::chunk_v;
+	return rope.each([whole](std::span<int const> chunk) {
+		return !chunk.empty() && chunk.size() <= Rope<int>::chunk_v && (whole || chunk.size() >= Rope<int>::half_v);
+	});
+}
+
+// Items not seen before, so a misplaced one can't match by accident
+Items fresh(int& next, std::size_t count) {
+	Items ret(count);
+	for (auto& item : ret) { item = next++; }
+	return ret;
+}
+} // namespace
+
+int main() {
+	std::mt19937 rng(47);
+	auto const below = [&rng](std::size_t n) { return std::size_t(rng() % (n + 1)); };
+	int next{};
+
+	auto const initial = fresh(next, 1000);
+	std::vector<Version> versions{{Rope<int>(initial), initial}};
+	JK_CHECK(matches(versions.back().rope, versions.back().model));
+
+	for (int step = 0; step < 5000; ++step) {
+		// mostly the latest version, sometimes an older one (an edit after undo)
+		auto const& from = rng() % 8 == 0 ? versions[below(versions.size() - 1)] : versions.back();
+		auto rope = from.rope;
+		auto model = from.model;
+		auto const size = model.size();
+		switch (rng() % 6) {
+		case 0: {
+			// a few items, or a large block now and then
+			auto const items = fresh(next, rng() % 16 == 0 ? below(600) : below(4));
+			auto const at = below(size);
+			rope = rope.insert(at, items);
+			model.insert(model.begin() + std::ptrdiff_t(at), items.begin(), items.end());
+			break;
+		}
+		case 1: {
+			auto const first = below(size);
+			auto const count = rng() % 16 == 0 ? below(size - first) : below(std::min<std::size_t>(3, size - first));
+			rope = rope.erase(first, count);
+			model.erase(model.begin() + std::ptrdiff_t(first), model.begin() + std::ptrdiff_t(first + count));
+			break;
+		}
+		case 2: {
+			if (size == 0) { break; }
+			auto const at = below(size - 1);
+			rope = rope.assign(at, next);
+			model[at] = next++;
+			break;
+		}
+		case 3: {
+			// moving a block, as bulk moves do: slice it out and insert it elsewhere
+			auto const first = below(size);
+			auto const count = below(std::min<std::size_t>(64, size - first));
+			auto const block = rope.slice(first, count);
+			JK_CHECK(matches(block, Items(model.begin() + std::ptrdiff_t(first), model.begin() + std::ptrdiff_t(first + count))));
+			rope = rope.erase(first, count);
+			auto const items = Items(model.begin() + std::ptrdiff_t(first), model.begin() + std::ptrdiff_t(first + count));
+			model.erase(model.begin() + std::ptrdiff_t(first), model.begin() + std::ptrdiff_t(first + count));
+			auto const at = below(model.size());
+			rope = rope.insert(at, block);
+			model.insert(model.begin() + std::ptrdiff_t(at), items.begin(), items.end());
+			break;
+		}
+		case 4: {
+			auto const& other = versions[below(versions.size() - 1)];
+			rope = Rope<int>::concat(rope, other.rope);
+			model.insert(model.end(), other.model.begin(), other.model.end());
+			// keep the size in check
+			if (model.size() > 20000) {
+				rope = rope.slice(model.size() - 5000, 5000);
+				model.erase(model.begin(), model.end() - 5000);
+			}
+			break;
+		}
+		default: {
+			// clear and rebuild, as a restore does
+			if (rng() % 50 != 0) { break; }
+			auto const items = fresh(next, below(300));
+			rope = Rope<int>(items);
+			model = items;
+			break;
+		}
+		}
+		JK_CHECK(matches(rope, model));
+		JK_CHECK(rope.empty() == model.empty());
+		JK_CHECK(chunked(rope));
+		versions.push_back({std::move(rope), std::move(model)});
+	}
+
+	// persistence: no edit touched an earlier version
+	std::size_t intact{};
+	for (auto const& version : versions) { intact += matches(version.rope, version.model) ? 1 : 0; }
+	std::printf("%zu versions, %zu intact, latest has %zu items\n", versions.size(), intact, versions.back().model.size());
+	JK_CHECK(intact == versions.size());
+
+	// a long run of single item edits, as clicking through a list does: chunks don't wear down to a few items each
+	auto rope = versions.back().rope;
+	auto model = versions.back().model;
+	for (int step = 0; step < 20000; ++step) {
+		auto const at = below(model.size());
+		if (step % 2 == 0 || model.empty()) {
+			rope = rope.insert(at, Items{next});
+			model.insert(model.begin() + std::ptrdiff_t(at), next++);
+		} else if (at < model.size()) {
+			rope = rope.erase(at);
+			model.erase(model.begin() + std::ptrdiff_t(at));
+		}
+	}
+	std::size_t chunks{};
+	rope.each([&chunks](std::span<int const>) { return ++chunks > 0; });
+	std::printf("after single item edits: %zu items in %zu chunks\n", model.size(), chunks);
+	JK_CHECK(matches(rope, model));
+	JK_CHECK(chunked(rope));
+	JK_CHECK(chunks <= model.size() / Rope<int>::half_v + 1);
+
+	// out of range edits are clamped or ignored
+	auto const& last = versions.back();
+	JK_CHECK(matches(last.rope.assign(last.model.size(), -1), last.model));
+	JK_CHECK(matches(last.rope.erase(last.model.size(), 10), last.model));
+	JK_CHECK(last.rope.slice(last.model.size(), 10).empty());
+	return test::result();
+}